@@ -104,7 +104,7 @@ mcdbxs_TIEHASH(CLASS, filename)
   OUTPUT:
     RETVAL
 
-U32
+UV
 mcdbxs_SCALAR(this)
     struct mcdbxs_read * this;
   CODE:
@@ -168,7 +168,7 @@ mcdbxs_FETCH(this, k)
         /* messiness required to detect Perl calling FETCH for values()
          * after having obtained all FIRSTKEY/NEXTKEY; needed to support
          * (duplicated) keys with multiple values, permitted in mcdb */
-        if (this->iter.eod && MCDB_HEADER_SZ == mcdb_datapos(&this->m)-klen-8) {
+        if (this->iter.eod && this->m.map->data == mcdb_datapos(&this->m)-klen-8) {
             this->values = true;
             mcdb_iter_init(&this->iter, &this->m);
             if (!mcdb_iter(&this->iter) || !mcdb_iter(&this->iter)) {
@@ -66,7 +66,7 @@ static int
 mcdblua_size(lua_State * const restrict L)
 {
     struct mcdb * const restrict m = mcdblua_struct(L);
-    lua_pushnumber(L, (int)mcdb_numrecs(m));
+    lua_pushnumber(L, (lua_Number)mcdb_numrecs(m));
     return 1;
 }
 
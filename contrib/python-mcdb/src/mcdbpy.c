@@ -635,6 +635,8 @@ mcdbpy_make_new(PyTypeObject * const type,
     if (self != NULL) {
         self->fname    = NULL;
         self->m.head[0]= NULL;
+        self->m.sub    = NULL;
+        self->m.spill  = NULL;
         self->m.fd     = -1;
     }
     return (PyObject *)self;
@@ -719,7 +721,9 @@ static const char mcdbpy_make_object_doc[] =
   "\n"
   "  __members__:\n"
   "    mk.name    - mcdb filename\n"
-  "    mk.fd      - fd underlying mcdb (-1 after finish())\n";
+  "    mk.fd      - fd underlying mcdb (-1 after finish())\n"
+  "    mk.gen_errno - errno if finish() did not increment generation sidecar\n"
+  "                   (0 otherwise)\n";
 
 
 
@@ -861,6 +865,9 @@ static PyMemberDef mcdbpy_make_members[] = {
   {"fd",   T_INT,       offsetof(struct mcdbpy_make, m.fd),  READONLY,
    "file descriptor"
   },
+  {"gen_errno", T_INT,  offsetof(struct mcdbpy_make, m.gen_errno), READONLY,
+   "errno if generation sidecar not incremented (else 0)"
+  },
   { NULL }
 };
 
@@ -209,7 +209,7 @@ static VALUE
 mcdbrb_size (const VALUE obj)
 {
     struct mcdb * const restrict m = mcdbrb_Data_Cast_Struct(obj, struct mcdb);
-    return UINT2NUM(mcdb_numrecs(m));
+    return ULL2NUM(mcdb_numrecs(m));
 }
 
 static VALUE
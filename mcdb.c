@@ -47,8 +47,10 @@
 #include "nointr.h"
 #include "uint32.h"
 #include "plasma/plasma_attr.h"
+#include "plasma/plasma_atomic.h"
 #include "plasma/plasma_membar.h"
 #include "plasma/plasma_stdtypes.h"  /* SIZE_MAX */
+#include "plasma/plasma_sysconf.h"
 
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -57,8 +59,18 @@
 #include <errno.h>
 #include <limits.h>
 #include <string.h>
+#include <time.h>               /* clock_gettime(), time() */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #ifdef _THREAD_SAFE
+#include <pthread.h>            /* pthread_key_t, pthread_{get,set}specific() */
 #include "plasma/plasma_spin.h" /* plasma_spin_lock_t, plasma_spin_lock_*() */
 static plasma_spin_lock_t mcdb_global_spinlock = PLASMA_SPIN_LOCK_INITIALIZER;
 #else
@@ -66,6 +78,12 @@ static plasma_spin_lock_t mcdb_global_spinlock = PLASMA_SPIN_LOCK_INITIALIZER;
 #define plasma_spin_lock_release(spin) (void)0
 #endif
 
+#if defined(__linux__) && defined(_THREAD_SAFE)
+#include <sys/inotify.h>        /* inotify_init1(), inotify_add_watch() */
+#include <signal.h>             /* sigfillset(), pthread_sigmask() */
+#define MCDB_WATCH_INOTIFY_SUPPORTED
+#endif
+
 #ifndef O_CLOEXEC /* O_CLOEXEC available since Linux 2.6.23 */
 #define O_CLOEXEC 0
 #endif
@@ -83,43 +101,178 @@ extern int madvise(caddr_t, size_t, int);
 
 /* Note: tagc of 0 ('\0') is reserved to indicate no tag */
 
-bool
-mcdb_findtagstart(struct mcdb * const restrict m,
-                  const char * const restrict key, const size_t klen,
-                  const unsigned char tagc)
+__attribute_nonnull__
+__attribute_pure__
+static inline uint32_t
+mcdb_hash_tag_fn(uint32_t (* const hash_fn)(uint32_t, const void * restrict,
+                                            size_t),
+                 const uint32_t hash_init,
+                 const char * const restrict key, const size_t klen,
+                 const unsigned char tagc);
+
+static inline uint32_t
+mcdb_hash_tag_fn(uint32_t (* const hash_fn)(uint32_t, const void * restrict,
+                                            size_t),
+                 const uint32_t hash_init,
+                 const char * const restrict key, const size_t klen,
+                 const unsigned char tagc)
 {
-    const unsigned char * restrict ptr;
-    uint32_t khash;
-    if (m->map->hash_fn == uint32_hash_djb) {
+    if (hash_fn == uint32_hash_djb) {
+        const uint32_t khash_init = /*init hash value; hash tagc if tagc not 0*/
+          (tagc != 0)
+            ? uint32_hash_djb_uchar(hash_init, tagc)
+            : hash_init;
+        return uint32_hash_djb(khash_init, key, klen);
+    }
+    else if (hash_fn == uint32_hash_wy) {
+        /* (not chainable; tagc folded into seed (see uint32_hash_wy_tag())) */
+        return (tagc != 0)
+          ? uint32_hash_wy_tag(hash_init, tagc, key, klen)
+          : uint32_hash_wy(hash_init, key, klen);
+    }
+    else if (hash_fn == uint32_hash_crc32c) {
         const uint32_t khash_init = /*init hash value; hash tagc if tagc not 0*/
           (tagc != 0)
-            ? uint32_hash_djb_uchar(UINT32_HASH_DJB_INIT, tagc)
-            : UINT32_HASH_DJB_INIT;
-        khash = uint32_hash_djb(khash_init, key, klen);
+            ? uint32_hash_crc32c(hash_init, (const char *)&tagc, 1u)
+            : hash_init;
+        return uint32_hash_crc32c(khash_init, key, klen);
     }
     else {
         const uint32_t khash_init = /*init hash value; hash tagc if tagc not 0*/
           (tagc != 0)
-            ? m->map->hash_fn(m->map->hash_init, (const char *)&tagc, 1u)
-            : m->map->hash_init;
-        khash = m->map->hash_fn(khash_init, key, klen);
+            ? hash_fn(hash_init, (const char *)&tagc, 1u)
+            : hash_init;
+        return hash_fn(khash_init, key, klen);
     }
+}
 
-    /* (hash function should not change on refresh,
-     *  else move mcdb_thread_refresh_self() before khash calculation)*/
-    (void) mcdb_thread_refresh_self(m);
-    /* (ignore rc; continue with previous map in case of failure) */
+__attribute_nonnull__
+__attribute_pure__
+static inline uint32_t
+mcdb_hash_tag(const struct mcdb_mmap * const restrict map,
+              const char * const restrict key, const size_t klen,
+              const unsigned char tagc);
+
+static inline uint32_t
+mcdb_hash_tag(const struct mcdb_mmap * const restrict map,
+              const char * const restrict key, const size_t klen,
+              const unsigned char tagc)
+{
+    return mcdb_hash_tag_fn(map->hash_fn, map->hash_init, key, klen, tagc);
+}
+
+/* key fingerprint (MCDB_HDR_WIDE) (see mcdb.h); stored bigendian in m->kfp
+ * (fingerprint of record key, which is tagc followed by key if tagc not 0) */
+__attribute_nonnull__
+static inline void
+mcdb_hash_kfp(struct mcdb * const restrict m,
+              const char * const restrict key, const size_t klen,
+              const unsigned char tagc);
+
+static inline void
+mcdb_hash_kfp(struct mcdb * const restrict m,
+              const char * const restrict key, const size_t klen,
+              const unsigned char tagc)
+{
+    const uint32_t seed = ~m->map->hash_init;
+    const uint32_t kfp = (tagc != 0)
+      ? uint32_hash_wy_tag(seed, tagc, key, klen)
+      : uint32_hash_wy(seed, key, klen);
+    uint32_strpack_bigendian_aligned_macro(&m->kfp, kfp);
+}
+
+/* MPH index (see mcdb.h): set m->kpos to MPH table entry for khash, and set
+ * m->hpos, m->hslots to overflow table (m->kpos < m->hpos until MPH probed) */
+__attribute_nonnull__
+static inline bool
+mcdb_findstart_mph(struct mcdb * const restrict m, const uint32_t khash,
+                   const unsigned char * const restrict dirent);
+
+static inline bool
+mcdb_findstart_mph(struct mcdb * const restrict m, const uint32_t khash,
+                   const unsigned char * const restrict dirent)
+{
+    const struct mcdb_mmap * const restrict map = m->map;
+    const uint32_t msz = m->hslots;
+    const uint32_t nb  = (msz + 3) >> 2;
+    const uint32_t j   = mcdb_mph_bucket(khash, nb) << 1;
+    const unsigned char * const restrict pilot = map->ptr + m->hpos + j;
+    const uintptr_t tpos = m->hpos
+      + ((((uintptr_t)nb << 1) + MCDB_PAD_MASK) & ~(uintptr_t)MCDB_PAD_MASK);
+    m->kpos  = tpos + ((uintptr_t)mcdb_mph_pos(khash,
+                                               ((uint32_t)pilot[0] << 8)
+                                               | pilot[1], msz) << map->b);
+    m->hpos  = tpos + ((uintptr_t)msz << map->b);
+    m->hslots= uint32_strunpack_bigendian_aligned_macro(dirent+12) << 1;
+    __builtin_prefetch(map->ptr+m->kpos,0,PLASMA_ATTR_MM_HINT_T1);
+    uint32_strpack_bigendian_aligned_macro(&m->khash, khash);/*store bigendian*/
+    return true;
+}
+
+/* check filter section (see mcdb.h); false if khash definitely not in mcdb */
+__attribute_nonnull__
+__attribute_pure__
+static inline bool
+mcdb_filter_check(const struct mcdb_mmap * const restrict map,
+                  const uint32_t khash);
+
+static inline bool
+mcdb_filter_check(const struct mcdb_mmap * const restrict map,
+                  const uint32_t khash)
+{
+    const unsigned char * const restrict blk = map->filter
+      + ((uintptr_t)mcdb_filter_block(khash, map->filter_nb) << 5);
+    uint32_t bit;
+    for (uint32_t i = 0; i < 8; ++i) {
+        bit = mcdb_filter_bit(khash, i);
+        if (!(blk[bit >> 3] & (1u << (bit & 7))))
+            return false;
+    }
+    return true;
+}
+
+__attribute_nonnull__
+static inline bool
+mcdb_findstart_khash(struct mcdb * const restrict m, const uint32_t khash);
+
+static inline bool
+mcdb_findstart_khash(struct mcdb * const restrict m, const uint32_t khash)
+{
+    const unsigned char * restrict ptr;
+    const struct mcdb_mmap * const restrict map = m->map;
+    const uint32_t sb = map->slot_bits;
+
+    /* (most keys not in mcdb rejected after reading one filter cache line) */
+    if (map->filter != NULL && !mcdb_filter_check(map, khash))
+        return (m->loop = false);
 
     /* (size of data in lvl1 hash table element is 16-bytes (shift 4 bits)) */
-    ptr = m->map->ptr + ((khash & MCDB_SLOT_MASK) << 4);
+    ptr = map->dir + ((uintptr_t)mcdb_slot_index(khash, sb) << 4);
     m->hpos  = uint64_strunpack_bigendian_aligned_macro(ptr);
     m->hslots= uint32_strunpack_bigendian_aligned_macro(ptr+8);
     m->loop  = 0;
     if (__builtin_expect((!m->hslots), 0))
         return false;
-    /* (size of data in lvl2 hash table element is 16-bytes (shift 4 bits)) */
-    m->kpos  = m->hpos
-             +(((uintptr_t)((khash>>MCDB_SLOT_BITS) % m->hslots)) << m->map->b);
+    if (__builtin_expect((map->flags & (MCDB_HDR_MPH|MCDB_HDR_BUCKET)), 0)) {
+        if (map->flags & MCDB_HDR_MPH)
+            return mcdb_findstart_mph(m, khash, ptr);
+        /* (bucketized; 64-byte bucket holds 8 entries) */
+        m->kpos = m->hpos
+          + ((uintptr_t)mcdb_slot_home(khash, m->hslots >> 3, sb, map->flags)
+             << 6);
+    }
+    /* (size of lvl2 hash table element is 8 or 16 bytes (b = 3 or 4)) */
+    /* (specialized home entry calculation for each reduce; avoid modulo) */
+    else if (map->flags & MCDB_HDR_POW2)
+        m->kpos = m->hpos
+          + ((uintptr_t)((khash >> sb) & (m->hslots - 1)) << map->b);
+    else if (map->flags & MCDB_HDR_MULSHIFT)
+        m->kpos = m->hpos
+          + ((uintptr_t)(((uint64_t)(uint32_t)((khash >> sb) * 0x9E3779B1u)
+                          * m->hslots) >> 32) << map->b);
+    else
+        m->kpos = m->hpos
+          + ((uintptr_t)((khash >> sb) % m->hslots) << map->b);
     ptr = m->map->ptr + m->kpos;             /*prefetch for mcdb_findtagnext()*/
     __builtin_prefetch(ptr,0,PLASMA_ATTR_MM_HINT_T1);
     __builtin_prefetch(ptr+64,0,PLASMA_ATTR_MM_HINT_T1);
@@ -127,6 +280,254 @@ mcdb_findtagstart(struct mcdb * const restrict m,
     return true;
 }
 
+bool
+mcdb_findtagstart(struct mcdb * const restrict m,
+                  const char * const restrict key, const size_t klen,
+                  const unsigned char tagc)
+{
+    /* (hash function might change on refresh (recorded in mcdb header),
+     *  so mcdb_thread_refresh_self() before khash calculation)*/
+    (void) mcdb_thread_refresh_self(m);
+    /* (ignore rc; continue with previous map in case of failure) */
+
+    if (m->map->flags & MCDB_HDR_WIDE)
+        mcdb_hash_kfp(m, key, klen, tagc);
+    return mcdb_findstart_khash(m, mcdb_hash_tag(m->map, key, klen, tagc));
+}
+
+bool
+mcdb_findtagstart_hashed(struct mcdb * const restrict m,
+                         const char * const restrict key, const size_t klen,
+                         const unsigned char tagc,
+                         const struct mcdb_khash * const restrict kh)
+{
+    /* (khash used only if computed with hash func and seed of map (which
+     *  might change on refresh); otherwise hash key as mcdb_findtagstart())*/
+    (void) mcdb_thread_refresh_self(m);
+    /* (ignore rc; continue with previous map in case of failure) */
+
+    if (m->map->flags & MCDB_HDR_WIDE)
+        mcdb_hash_kfp(m, key, klen, tagc);
+    return mcdb_findstart_khash(m,
+      (kh->hash_fn == m->map->hash_fn && kh->hash_init == m->map->hash_init)
+        ? kh->khash
+        : mcdb_hash_tag(m->map, key, klen, tagc));
+}
+
+bool
+mcdb_khash_init(struct mcdb_khash * const restrict kh,
+                const uint32_t hash_id, const uint32_t hash_init,
+                const char * const restrict key, const size_t klen,
+                const unsigned char tagc)
+{
+    uint32_t init;
+    if (!mcdb_hash_lookup(hash_id, &init, &kh->hash_fn))
+        return false;
+    kh->hash_init = hash_init;
+    kh->khash = mcdb_hash_tag_fn(kh->hash_fn, hash_init, key, klen, tagc);
+    return true;
+}
+
+void
+mcdb_khash_init_map(struct mcdb_khash * const restrict kh,
+                    const struct mcdb_mmap * const restrict map,
+                    const char * const restrict key, const size_t klen,
+                    const unsigned char tagc)
+{
+    kh->hash_fn   = map->hash_fn;
+    kh->hash_init = map->hash_init;
+    kh->khash     = mcdb_hash_tag(map, key, klen, tagc);
+}
+
+/* probe MPH table entry (see mcdb_findstart_mph());
+ * set m->kpos to overflow table home entry for subsequent probes */
+__attribute_nonnull__
+static bool
+mcdb_findtagnext_mph(struct mcdb * const restrict m,
+                     const char * const restrict key, const size_t klen,
+                     const unsigned char tagc);
+
+static bool
+mcdb_findtagnext_mph(struct mcdb * const restrict m,
+                     const char * const restrict key, const size_t klen,
+                     const unsigned char tagc)
+{
+    const unsigned char * const restrict mptr = m->map->ptr;
+    const unsigned char * ptr = mptr + m->kpos;
+    const uint32_t khash = *(uint32_t *)ptr; /* m->khash stored bigendian */
+    const uintptr_t vpos = (m->map->b == 3)
+      ? uint32_strunpack_bigendian_aligned_macro(ptr+4)
+      : uint64_strunpack_bigendian_aligned_macro(ptr+8);
+    m->kpos = (m->hslots)
+      ? m->hpos + ((uintptr_t)mcdb_slot_home(
+                     uint32_strunpack_bigendian_aligned_macro(&m->khash),
+                     m->hslots, m->map->slot_bits, m->map->flags) << m->map->b)
+      : m->hpos;
+    if (vpos && khash == m->khash
+        && (!(m->map->flags & MCDB_HDR_WIDE)
+            || *(uint32_t *)(ptr+4) == m->kfp)) {
+        ptr = mptr + vpos + 8;
+        m->klen = uint32_strunpack_bigendian_macro(ptr-8);
+        m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
+        m->dpos = vpos + 8 + m->klen;
+        if (m->klen == klen+(tagc!=0)
+            && (tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen)==0)
+            return (m->loop = 1);
+    }
+    return false;
+}
+
+/* bitmask of entries in 64-byte bucket with khash matching (bigendian) khash
+ * (compare all 8 khash in bucket at once; no byteswap of khash needed) */
+__attribute_nonnull__
+__attribute_pure__
+static inline uint32_t
+mcdb_bucket_match(const unsigned char * const restrict bk,const uint32_t khash);
+
+static inline uint32_t
+mcdb_bucket_match(const unsigned char * const restrict bk,const uint32_t khash)
+{
+  #if defined(__AVX2__)
+    const __m256i k = _mm256_set1_epi32((int)khash);
+    const __m256i v = _mm256_loadu_si256((const __m256i *)bk);
+    return (uint32_t)
+      _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, k)));
+  #elif defined(__SSE2__)
+    const __m128i k = _mm_set1_epi32((int)khash);
+    const __m128i v0 = _mm_loadu_si128((const __m128i *)bk);
+    const __m128i v1 = _mm_loadu_si128((const __m128i *)(bk+16));
+    return (uint32_t)
+        _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v0, k)))
+      | (uint32_t)
+        _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v1, k))) << 4;
+  #elif defined(__ARM_NEON) && defined(__aarch64__)
+    static const uint32_t bits[4] = { 1, 2, 4, 8 };
+    const uint32x4_t w  = vld1q_u32(bits);
+    const uint32x4_t k  = vdupq_n_u32(khash);
+    const uint32x4_t v0 = vceqq_u32(vld1q_u32((const uint32_t *)bk), k);
+    const uint32x4_t v1 = vceqq_u32(vld1q_u32((const uint32_t *)(bk+16)), k);
+    return vaddvq_u32(vandq_u32(v0, w)) | (vaddvq_u32(vandq_u32(v1, w)) << 4);
+  #else
+    const uint32_t * const restrict kh = (const uint32_t *)bk;
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < 8; ++i)
+        mask |= (uint32_t)(kh[i] == khash) << i;
+    return mask;
+  #endif
+}
+
+/* probe bucketized open hash table (see mcdb.h)
+ * (m->kpos is current bucket; m->loop % 8 is next entry in current bucket) */
+__attribute_nonnull__
+static bool
+mcdb_findtagnext_bucket(struct mcdb * const restrict m,
+                        const char * const restrict key, const size_t klen,
+                        const unsigned char tagc);
+
+static bool
+mcdb_findtagnext_bucket(struct mcdb * const restrict m,
+                        const char * const restrict key, const size_t klen,
+                        const unsigned char tagc)
+{
+    const unsigned char * ptr;
+    const unsigned char * const restrict mptr = m->map->ptr;
+    const uintptr_t hslots_end= m->hpos + (((uintptr_t)m->hslots) << 3);
+    uintptr_t vpos;
+    uint32_t mask;
+    uint32_t u;
+
+    while (m->loop < m->hslots) {
+        const unsigned char * const restrict bk = mptr + m->kpos;
+        const uint32_t base = m->loop & ~7u;
+        mask = mcdb_bucket_match(bk, m->khash) & (0xFFu << (m->loop & 7));
+        while (mask) {
+            u = (uint32_t)__builtin_ctz(mask);
+            mask &= mask - 1;
+            vpos = uint32_strunpack_bigendian_aligned_macro(bk+32+(u<<2));
+            if (!vpos) /* (khash 0 matches empty entries at end of bucket) */
+                return (m->loop = false);
+            m->loop = base + u + 1;
+            ptr = mptr + vpos + 8;
+            m->klen = uint32_strunpack_bigendian_macro(ptr-8);
+            m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
+            m->dpos = vpos + 8 + m->klen;
+            if (m->klen == klen+(tagc!=0)
+                && (tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen)==0) {
+                if (u == 7 && (m->kpos += 64) == hslots_end)
+                    m->kpos = m->hpos;  /* (next call begins at next bucket) */
+                return true;
+            }
+        }
+        if (*(uint32_t *)(bk+60) == 0) /* last entry in bucket empty; done */
+            break;
+        m->loop = base + 8;
+        if ((m->kpos += 64) == hslots_end)
+            m->kpos = m->hpos;
+    }
+    return (m->loop = false);
+}
+
+/* probe Robin Hood ordered open hash table; stop at first entry which has
+ * displacement from its home entry less than the displacement of the probe */
+__attribute_nonnull__
+static bool
+mcdb_findtagnext_rh(struct mcdb * const restrict m,
+                    const char * const restrict key, const size_t klen,
+                    const unsigned char tagc);
+
+static bool
+mcdb_findtagnext_rh(struct mcdb * const restrict m,
+                    const char * const restrict key, const size_t klen,
+                    const unsigned char tagc)
+{
+    const unsigned char * ptr;
+    const unsigned char * const restrict mptr = m->map->ptr;
+    const uint32_t b = m->map->b;
+    const uintptr_t hslots_end= m->hpos + (((uintptr_t)m->hslots) << b);
+    uintptr_t vpos;
+    uint32_t khash;
+    uint32_t u;
+
+    while (m->loop < m->hslots) {
+        ptr = mptr + m->kpos;
+        u = (uint32_t)((m->kpos - m->hpos) >> b);   /* entry index */
+        m->kpos += (1u << b);
+        if (__builtin_expect((m->kpos == hslots_end), 0))
+            m->kpos = m->hpos;
+        khash= *(uint32_t *)ptr; /* m->khash stored bigendian */
+        vpos = (b != 4)
+          ? uint32_strunpack_bigendian_aligned_macro(ptr+4)
+          : uint64_strunpack_bigendian_aligned_macro(ptr+8);
+        if (!vpos)
+            break;
+        if (khash != m->khash) {
+            const uint32_t home =
+              mcdb_slot_home(uint32_strunpack_bigendian_aligned_macro(ptr),
+                             m->hslots, m->map->slot_bits, m->map->flags);
+            if ((u >= home ? u - home : u + m->hslots - home) < m->loop)
+                break;  /* resident entry displacement less than probe */
+            ++m->loop;
+            continue;
+        }
+        ++m->loop;
+        if ((m->map->flags & MCDB_HDR_WIDE) && *(uint32_t *)(ptr+4) != m->kfp)
+            continue;  /* (fingerprint mismatch; key differs) */
+        if (b == 5) {  /* record inlined in entry unless entry klen is ~0 */
+            m->rpos = (uint32_t)vpos;
+            if (*(uint32_t *)(ptr+8) != ~0u)
+                vpos = (uintptr_t)(ptr - mptr) + 8;
+        }
+        ptr = mptr + vpos + 8;
+        m->klen = uint32_strunpack_bigendian_macro(ptr-8);
+        m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
+        m->dpos = vpos + 8 + m->klen;
+        if (m->klen == klen+(tagc!=0)
+            && (tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen)==0)
+            return true;
+    }
+    return (m->loop = false);
+}
+
 bool
 mcdb_findtagnext(struct mcdb * const restrict m,
                  const char * const restrict key, const size_t klen,
@@ -134,14 +535,25 @@ mcdb_findtagnext(struct mcdb * const restrict m,
 {
     const unsigned char * ptr;
     const unsigned char * const restrict mptr = m->map->ptr;
-    const uintptr_t hslots_end= m->hpos + (((uintptr_t)m->hslots) << m->map->b);
+    const uint32_t b = m->map->b;
+    const uintptr_t hslots_end= m->hpos + (((uintptr_t)m->hslots) << b);
     uintptr_t vpos;
     uint32_t khash;
 
-    if (m->map->b == 3) {
+    /* (m->kpos < m->hpos only if MPH table entry not yet probed) */
+    if (__builtin_expect((m->kpos < m->hpos), 0)
+        && mcdb_findtagnext_mph(m, key, klen, tagc))
+        return true;
+
+    if (__builtin_expect((m->map->flags & MCDB_HDR_BUCKET), 0))
+        return mcdb_findtagnext_bucket(m, key, klen, tagc);
+    if (__builtin_expect((m->map->flags & MCDB_HDR_ROBINHOOD), 0))
+        return mcdb_findtagnext_rh(m, key, klen, tagc);
+
+    if (b != 4) {  /* (b == 3, or b == 5 (MCDB_HDR_INLINE)) */
         while (m->loop < m->hslots) {
             ptr = mptr + m->kpos;
-            m->kpos += 8;
+            m->kpos += (1u << b);
             if (__builtin_expect((m->kpos == hslots_end), 0))
                 m->kpos = m->hpos;
             khash= *(uint32_t *)ptr; /* m->khash stored bigendian */
@@ -150,6 +562,11 @@ mcdb_findtagnext(struct mcdb * const restrict m,
                 break;
             ++m->loop;
             if (khash == m->khash) {
+                if (b == 5) {  /* record inlined in entry unless klen ~0 */
+                    m->rpos = (uint32_t)vpos;
+                    if (*(uint32_t *)(ptr+8) != ~0u)
+                        vpos = (uintptr_t)(ptr - mptr) + 8;
+                }
                 ptr = mptr + vpos + 8;
                 m->klen = uint32_strunpack_bigendian_macro(ptr-8);
                 m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
@@ -161,22 +578,30 @@ mcdb_findtagnext(struct mcdb * const restrict m,
         }
     }
     else {
+        /* (entry klen, or key fingerprint (stored bigendian) if wide) */
+        uint32_t kcmp;
+        if (m->map->flags & MCDB_HDR_WIDE)
+            kcmp = m->kfp;
+        else
+            uint32_strpack_bigendian_aligned_macro(&kcmp,
+                                                   (uint32_t)klen+(tagc!=0));
         while (m->loop < m->hslots) {
             ptr = mptr + m->kpos;
             m->kpos += 16;
             if (__builtin_expect((m->kpos == hslots_end), 0))
                 m->kpos = m->hpos;
             khash   = *(uint32_t *)ptr; /* m->khash stored bigendian */
-            m->klen = uint32_strunpack_bigendian_aligned_macro(ptr+4);
             vpos    = uint64_strunpack_bigendian_aligned_macro(ptr+8);
             if (!vpos)
                 break;
             ++m->loop;
-            if (khash == m->khash && m->klen == klen+(tagc!=0)) {
-                m->dpos = vpos + 8 + m->klen;
+            if (khash == m->khash && *(uint32_t *)(ptr+4) == kcmp) {
                 ptr = mptr + vpos + 8;
+                m->klen = uint32_strunpack_bigendian_macro(ptr-8);
                 m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
-                if ((tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen) == 0)
+                m->dpos = vpos + 8 + m->klen;
+                if (m->klen == klen+(tagc!=0)
+                    && (tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen)==0)
                     return true;
             }
         }
@@ -184,6 +609,111 @@ mcdb_findtagnext(struct mcdb * const restrict m,
     return (m->loop = false);
 }
 
+/* Batched lookup interleaves the dependent cache misses of many lookups.
+ * Each stage is run across a window of keys before the next stage begins,
+ * so that the loads for one key are in flight while others are processed:
+ *   1. hash key and prefetch slot header entry
+ *      (keys of window hashed at once if djb; see uint32_hash_djb_multi())
+ *   2. read slot header entry and prefetch hash table entry
+ *   3. read hash table entry and prefetch key/data record (if khash matches)
+ *   4. mcdb_findtagnext() (probing entries and records now in cache)
+ * (MCDB_BATCH_WINDOW is a bit more than the number of line fill buffers
+ *  (outstanding L1 cache misses) in modern CPUs; ample to hide latency) */
+#define MCDB_BATCH_WINDOW 16
+
+size_t
+mcdb_findtag_batch(struct mcdb * const restrict m, const size_t n,
+                   const char * const * const restrict keys,
+                   const size_t * const restrict klens,
+                   const unsigned char tagc)
+{
+    uint32_t khash[MCDB_BATCH_WINDOW];
+    bool start[MCDB_BATCH_WINDOW];
+    uint32_t djb_init;
+    bool djb;
+    size_t found = 0;
+    size_t i;
+    size_t j;
+    size_t w;
+
+    for (i = 0; i < n; i += w) {
+        struct mcdb * const restrict mw = m + i;
+        w = (n - i < MCDB_BATCH_WINDOW) ? n - i : MCDB_BATCH_WINDOW;
+
+        /* stage 1: hash key; prefetch lvl1 hash table (slot header) entry */
+        for (j = 0, djb = true; j < w; ++j) {
+            (void) mcdb_thread_refresh_self(mw+j);
+            djb &= (mw[j].map->hash_fn == uint32_hash_djb
+                    && mw[j].map->hash_init == mw[0].map->hash_init);
+        }
+        if (djb) {/* (multi-buffer; hash keys of window in SIMD lanes) */
+            djb_init = /*init hash value; hash tagc if tagc not 0*/
+              (tagc != 0)
+                ? uint32_hash_djb_uchar(mw[0].map->hash_init, tagc)
+                : mw[0].map->hash_init;
+            uint32_hash_djb_multi(djb_init, keys+i, klens+i, w, khash);
+        }
+        for (j = 0; j < w; ++j) {
+            if (!djb)
+                khash[j] = mcdb_hash_tag(mw[j].map,keys[i+j],klens[i+j],tagc);
+            if (mw[j].map->flags & MCDB_HDR_WIDE)
+                mcdb_hash_kfp(mw+j, keys[i+j], klens[i+j], tagc);
+            __builtin_prefetch(mw[j].map->dir
+                               + ((uintptr_t)mcdb_slot_index(
+                                    khash[j], mw[j].map->slot_bits) << 4),
+                               0, PLASMA_ATTR_MM_HINT_T0);
+            if (mw[j].map->filter != NULL)
+                __builtin_prefetch(mw[j].map->filter
+                                   + ((uintptr_t)mcdb_filter_block(
+                                        khash[j], mw[j].map->filter_nb) << 5),
+                                   0, PLASMA_ATTR_MM_HINT_T0);
+        }
+
+        /* stage 2: read slot header; prefetch lvl2 hash table entry */
+        for (j = 0; j < w; ++j)
+            start[j] = mcdb_findstart_khash(mw+j, khash[j]);
+
+        /* stage 3: read lvl2 hash table entry; prefetch key/data record */
+        for (j = 0; j < w; ++j) {
+            const unsigned char * const restrict ptr = mw[j].map->ptr+mw[j].kpos;
+            uintptr_t vpos;
+            if (!start[j])
+                continue;
+            if (mw[j].map->flags & MCDB_HDR_BUCKET) {
+                const uint32_t mask = mcdb_bucket_match(ptr, mw[j].khash);
+                vpos = (mask)
+                  ? uint32_strunpack_bigendian_aligned_macro(
+                      ptr+32+((uint32_t)__builtin_ctz(mask)<<2))
+                  : 0;
+                if (vpos)
+                    __builtin_prefetch(mw[j].map->ptr+vpos,0,
+                                       PLASMA_ATTR_MM_HINT_T0);
+                continue;
+            }
+            vpos = (mw[j].map->b != 4)
+              ? uint32_strunpack_bigendian_aligned_macro(ptr+4)
+              : uint64_strunpack_bigendian_aligned_macro(ptr+8);
+            /* (no need to prefetch record inlined in entry (b == 5)) */
+            if (vpos && *(uint32_t *)ptr == mw[j].khash /*m->khash bigendian*/
+                && (mw[j].map->b != 5 || *(uint32_t *)(ptr+8) == ~0u)
+                && (!(mw[j].map->flags & MCDB_HDR_WIDE)
+                    || *(uint32_t *)(ptr+4) == mw[j].kfp))
+                __builtin_prefetch(mw[j].map->ptr+vpos,0,PLASMA_ATTR_MM_HINT_T0);
+        }
+
+        /* stage 4: probe hash table entries and compare keys */
+        for (j = 0; j < w; ++j) {
+            if (start[j]
+                && mcdb_findtagnext(mw+j, keys[i+j], klens[i+j], tagc))
+                ++found;
+            else
+                mw[j].loop = 0;
+        }
+    }
+
+    return found;
+}
+
 /* read value from mmap const db into buffer and return pointer to buffer
  * (return NULL if position (offset) or length to read will be out-of-bounds)
  * Note: caller must terminate with '\0' if desired, i.e. buf[len] = '\0';
@@ -198,44 +728,90 @@ mcdb_read(const struct mcdb * const restrict m, const uintptr_t pos,
       : NULL;
 }
 
+uint64_t
+mcdb_numrecs64(struct mcdb * const restrict m)
+{
+    if (m->map->nrecs == ~(uint64_t)0 && !mcdb_validate_slots(m))
+        return 0;  /*(v2 map->nrecs is set in mcdb_mmap_init_header())*/
+    return m->map->nrecs; /* mcdb_make limits n to INT_MAX (~2 billion)
+                           * unless MCDB_HDR_WIDE (see mcdb_make_finish()) */
+}
+
 uint32_t
 mcdb_numrecs(struct mcdb * const restrict m)
 {
-    struct mcdb_mmap * const restrict map = m->map;
-    if (map->n == ~0) {
-        const unsigned char * const restrict ptr = map->ptr;
-        uint32_t u = 0;
-        for (unsigned int i = 8; i < MCDB_HEADER_SZ; i += 16)
-            u += uint32_strunpack_bigendian_aligned_macro(ptr+i);
-        map->n = u >> 1;  /* (hslots / 2) */
+    const uint64_t n = mcdb_numrecs64(m);
+    return (n < UINT32_MAX) ? (uint32_t)n : UINT32_MAX;
+}
+
+/* validate slot directory: open hash tables must be contiguous, beginning
+ * at hpos and ending at end; returns total hslots, or ~0 if not valid */
+__attribute_nonnull__
+__attribute_pure__
+static uint64_t
+mcdb_validate_dir(const unsigned char * const restrict dir, const uint32_t sb,
+                  const uint32_t b, const uint32_t flags,
+                  uint64_t hpos, const uint64_t end);
+
+static uint64_t
+mcdb_validate_dir(const unsigned char * const restrict dir, const uint32_t sb,
+                  const uint32_t b, const uint32_t flags,
+                  uint64_t hpos, const uint64_t end)
+{
+    uint64_t total = 0;
+    uint32_t hslots;
+    uint32_t novf;
+    for (uintptr_t u = 0; u < ((uintptr_t)16 << sb); u += 16) {
+        if (__builtin_expect(
+              (uint64_strunpack_bigendian_aligned_macro(dir+u) != hpos), 0))
+            return ~(uint64_t)0;
+        hslots = uint32_strunpack_bigendian_aligned_macro(dir+u+8);
+        total += hslots;
+        hpos  += ((uint64_t)hslots << b);
+        if ((flags & MCDB_HDR_BUCKET) && (hslots & 7))
+            return ~(uint64_t)0;  /* (8 entries per bucket) */
+        if (flags & MCDB_HDR_MPH) { /* pilots and overflow table */
+            novf  = uint32_strunpack_bigendian_aligned_macro(dir+u+12);
+            hpos += ((((uint64_t)(hslots+3) >> 2) << 1) + MCDB_PAD_MASK)
+                  & ~(uint64_t)MCDB_PAD_MASK;
+            hpos += ((uint64_t)novf << (b+1));
+            hslots = novf;  /* (overflow table size power of 2 if POW2) */
+        }
+        if ((flags & MCDB_HDR_POW2) && (hslots & (hslots - 1)))
+            return ~(uint64_t)0;  /* (table size power of 2) */
     }
-    return map->n; /* mcdb_make currently limits n to INT_MAX (~2 billion) */
+    return (hpos == end) ? total : ~(uint64_t)0;
 }
 
 bool
 mcdb_validate_slots(struct mcdb * const restrict m)
 {
-    const unsigned char * const restrict ptr = m->map->ptr;
-    uint32_t u = 0;
-    const uint32_t bits = m->map->b;
-    uint64_t hpos;
-    uint64_t hpos_next;
-    uint32_t hslots;
-    uint32_t numrecs = 0;
-    if (MCDB_HEADER_SZ > m->map->size)
+    struct mcdb_mmap * const restrict map = m->map;
+    uint64_t total;
+    if (map->dir == NULL)
         return false;
-    hpos_next  = uint64_strunpack_bigendian_aligned_macro(ptr);
-    do {
-        hpos = uint64_strunpack_bigendian_aligned_macro(ptr+u);
-        numrecs += (hslots = uint32_strunpack_bigendian_aligned_macro(ptr+u+8));
-        if (/* __builtin_expect( (*(uint32_t *)(ptr+u+12)) == 0, 1) && */
-            __builtin_expect( (hpos == hpos_next), 1)) /*(skip padding == 0)*/
-            hpos_next += ((uintptr_t)hslots << bits);
-        else
+    if (map->version == 1) {
+        const uint64_t hpos = uint64_strunpack_bigendian_aligned_macro(map->dir);
+        if (hpos < MCDB_HEADER_SZ || (hpos & MCDB_PAD_MASK))
+            return false;
+        total = mcdb_validate_dir(map->dir, MCDB_SLOT_BITS, map->b, 0,
+                                  hpos, map->size);
+        if (total == ~(uint64_t)0)
             return false;
-    } while ((u += 16) < MCDB_HEADER_SZ);
-    m->map->n = numrecs >> 1;  /* (hslots / 2) */
-    return (hpos_next == m->map->size);
+        map->nrecs = total >> 1;  /* (hslots / 2) */
+        map->n     = (uint32_t)map->nrecs;
+        return true;
+    }
+    else {
+        /* (map->nrecs set from v2 header num records) */
+        const uint64_t mask = (map->flags & MCDB_HDR_BUCKET)
+          ? 63          /* (bucketized tables are 64-byte aligned) */
+          : MCDB_PAD_MASK;
+        total = mcdb_validate_dir(map->dir, map->slot_bits, map->b, map->flags,
+                                  (map->eod + mask) & ~mask,
+                                  (uint64_t)(map->dir - map->ptr));
+        return (total != ~(uint64_t)0);
+    }
 }
 
 bool
@@ -269,8 +845,8 @@ mcdb_iter_init(struct mcdb_iter * const restrict iter,
      * Minimum rec size is 8 bytes for klen, dlen; 7 or fewer bytes are padding
      */
     unsigned char * const ptr = m->map->ptr;
-    iter->ptr  = ptr + MCDB_HEADER_SZ;
-    iter->eod  = ptr + uint64_strunpack_bigendian_aligned_macro(ptr) - 7;
+    iter->ptr  = ptr + m->map->data;
+    iter->eod  = ptr + m->map->eod;
     __builtin_prefetch(iter->ptr,0,PLASMA_ATTR_MM_HINT_T0);
     iter->klen = 0;                     /*(non-faulting prefetch ld if 0 recs)*/
     iter->dlen = 0;
@@ -284,70 +860,828 @@ mcdb_iter_init(struct mcdb_iter * const restrict iter,
 }
 
 
-/* Note: __attribute_noinline__ is used to mark less frequent code paths
- * to prevent inlining of seldoms used paths, hopefully improving instruction
- * cache hits.
- */
+/* layered lookup of delta mcdb (MCDB_HDR_DELTA) over base mcdb
+ * (records of key in delta, upserts or tombstone, hide records of key in base;
+ *  base is searched only if key is not in delta) */
+
+bool
+mcdb_overlay_findtagstart(struct mcdb_overlay * const restrict o,
+                          const char * const restrict key, const size_t klen,
+                          const unsigned char tagc)
+{
+    /* (hash key once for delta and base, if same hash func and seed) */
+    struct mcdb_khash kh;
+    mcdb_khash_init_map(&kh, o->delta.map, key, klen, tagc);
+    o->shadow = false;
+    if (mcdb_findtagstart_hashed(&o->delta, key, klen, tagc, &kh)) {
+        o->cur = &o->delta;
+        return true;
+    }
+    o->cur = &o->base;
+    return mcdb_findtagstart_hashed(&o->base, key, klen, tagc, &kh);
+}
+
+bool
+mcdb_overlay_findtagnext(struct mcdb_overlay * const restrict o,
+                         const char * const restrict key, const size_t klen,
+                         const unsigned char tagc)
+{
+    if (o->cur == &o->delta) {
+        struct mcdb * const restrict m = &o->delta;
+        struct mcdb_khash kh;
+        while (mcdb_findtagnext(m, key, klen, tagc)) {
+            o->shadow = true;
+            /* (op byte follows data; omit from m->dlen) */
+            if (m->dlen != 0
+                && m->map->ptr[m->dpos + --m->dlen] == MCDB_DELTA_UPSERT)
+                return true;
+        }
+        if (o->shadow)  /* key upserted or deleted in delta */
+            return false;
+        /* (reuse khash of key from delta lookup (stored bigendian)) */
+        kh.khash     = uint32_strunpack_bigendian_aligned_macro(&m->khash);
+        kh.hash_init = m->map->hash_init;
+        kh.hash_fn   = m->map->hash_fn;
+        o->cur = &o->base;
+        if (!mcdb_findtagstart_hashed(&o->base, key, klen, tagc, &kh))
+            return false;
+    }
+    return mcdb_findtagnext(&o->base, key, klen, tagc);
+}
+
+bool
+mcdb_overlay_iter(struct mcdb_overlay_iter * const restrict it)
+{
+    struct mcdb_iter * const restrict iter = &it->iter;
+    if (it->phase == 0) {
+        /* records of base with keys not in delta */
+        while (mcdb_iter(iter)) {
+            if (!mcdb_find(&it->m, (char *)mcdb_iter_keyptr(iter), iter->klen))
+                return true;
+        }
+        mcdb_iter_init(iter, &it->o->delta);
+        it->phase = 1;
+    }
+    else if (it->phase == 2) {
+        ++iter->ptr;   /* (restore iter->ptr past op byte of prior record) */
+        it->phase = 1;
+    }
+    /* upserts in delta */
+    while (mcdb_iter(iter)) {
+        if (iter->dlen != 0 && iter->ptr[-1] == MCDB_DELTA_UPSERT) {
+            --iter->ptr;   /* (omit op byte from data) */
+            --iter->dlen;
+            it->phase = 2;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+mcdb_overlay_iter_init(struct mcdb_overlay_iter * const restrict it,
+                       struct mcdb_overlay * const restrict o)
+{
+    mcdb_iter_init(&it->iter, &o->base);
+    it->o     = o;
+    it->m.map = o->delta.map;
+    it->phase = 0;
+}
+
+/* shard set (see mcdb.h) */
+
+bool
+mcdb_shardset_findtagstart(struct mcdb_shardset * const restrict s,
+                           struct mcdb * const restrict m,
+                           const char * const restrict key, const size_t klen,
+                           const unsigned char tagc)
+{
+    /* (all shards have same hash func; khash routes and then finds key) */
+    const uint32_t khash = mcdb_hash_tag(s->shards[0], key, klen, tagc);
+    m->map = s->shards[mcdb_shard_index(khash, s->n)];
+    if (m->map->flags & MCDB_HDR_WIDE)
+        mcdb_hash_kfp(m, key, klen, tagc);
+    return mcdb_findstart_khash(m, khash);
+}
+
+__attribute_nonnull__
+static void
+mcdb_shardset_unload(struct mcdb_mmap * const restrict manifest,
+                     struct mcdb_mmap ** const restrict shards,
+                     const uint32_t n, void (* const fn_free)(void *));
+
+static void
+mcdb_shardset_unload(struct mcdb_mmap * const restrict manifest,
+                     struct mcdb_mmap ** const restrict shards,
+                     const uint32_t n, void (* const fn_free)(void *))
+{
+    for (uint32_t i = 0; i < n; ++i)
+        mcdb_mmap_destroy(shards[i]);
+    fn_free(shards);
+    mcdb_mmap_destroy(manifest);
+}
+
+/* open shard i named in manifest (relative to dir of manifest) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static struct mcdb_mmap *
+mcdb_shardset_shard(const struct mcdb_shardset * const restrict s,
+                    struct mcdb * const restrict m, const uint32_t i);
+
+static struct mcdb_mmap *
+mcdb_shardset_shard(const struct mcdb_shardset * const restrict s,
+                    struct mcdb * const restrict m, const uint32_t i)
+{
+    struct mcdb_mmap *map = NULL;
+    char num[10];
+    char *fname;
+    if (!mcdb_find(m, num, uint32_to_ascii_base10(i, num))
+        || mcdb_datalen(m) == 0
+        || memchr(mcdb_dataptr(m), '\0', mcdb_datalen(m)) != NULL)
+        return (errno = EINVAL, NULL);
+    fname = s->fn_malloc(s->dlen + mcdb_datalen(m) + 1);
+    if (fname == NULL)
+        return NULL;
+    memcpy(fname, s->fname, s->dlen);
+    memcpy(fname+s->dlen, mcdb_dataptr(m), mcdb_datalen(m));
+    fname[s->dlen + mcdb_datalen(m)] = '\0';
+    map = mcdb_mmap_create(NULL, NULL, fname, s->fn_malloc, s->fn_free);
+    s->fn_free(fname);
+    return map;
+}
+
+/* open manifest and all shards of manifest (or none) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_shardset_load(const struct mcdb_shardset * const restrict s,
+                   struct mcdb_mmap ** const restrict manifest,
+                   struct mcdb_mmap *** const restrict shards,
+                   uint32_t * const restrict nshards);
+
+static bool
+mcdb_shardset_load(const struct mcdb_shardset * const restrict s,
+                   struct mcdb_mmap ** const restrict manifest,
+                   struct mcdb_mmap *** const restrict shards,
+                   uint32_t * const restrict nshards)
+{
+    struct mcdb m;
+    struct mcdb_mmap **sh = NULL;
+    uint32_t n = 0;
+    uint32_t i = 0;
+    m.map = mcdb_mmap_create(NULL, NULL, s->fname, s->fn_malloc, s->fn_free);
+    if (m.map == NULL)
+        return false;
+    if ((m.map->flags & MCDB_HDR_SHARDSET) && mcdb_find(&m, "n", 1)) {
+        const unsigned char * const p = mcdb_dataptr(&m);
+        for (uint32_t u = 0; u < mcdb_datalen(&m); ++u)
+            n = ((uint32_t)(p[u]-'0') <= 9u && n <= MCDB_SHARDS_MAX)
+              ? n * 10 + (p[u]-'0')
+              : ~0u;
+    }
+    if (n == 0 || n > MCDB_SHARDS_MAX
+        || (sh = s->fn_malloc(n * sizeof(struct mcdb_mmap *))) == NULL) {
+        if (sh == NULL && n != 0 && n <= MCDB_SHARDS_MAX)
+            errno = ENOMEM;
+        else
+            errno = EINVAL;
+        mcdb_mmap_destroy(m.map);
+        return false;
+    }
+    for (; i < n && (sh[i] = mcdb_shardset_shard(s, &m, i)) != NULL; ++i) {
+        if (sh[i]->hash_id != sh[0]->hash_id
+            || sh[i]->hash_init != sh[0]->hash_init
+            || sh[i]->hash_fn != sh[0]->hash_fn
+            || (sh[i]->flags & (MCDB_HDR_DELTA|MCDB_HDR_SHARDSET))) {
+            mcdb_mmap_destroy(sh[i]);
+            errno = EINVAL;
+            break;
+        }
+    }
+    if (i != n) {
+        mcdb_shardset_unload(m.map, sh, i, s->fn_free);
+        return false;
+    }
+    *manifest = m.map;
+    *shards   = sh;
+    *nshards  = n;
+    return true;
+}
+
+bool
+mcdb_shardset_open(struct mcdb_shardset * const restrict s,
+                   const char * const restrict fname,
+                   void * (* const fn_malloc)(size_t),
+                   void (* const fn_free)(void *))
+{
+    const size_t flen = strlen(fname);
+    const char * const slash = strrchr(fname, '/');
+    s->manifest  = NULL;
+    s->shards    = NULL;
+    s->n         = 0;
+    s->dlen      = (slash != NULL) ? (uint32_t)(slash - fname + 1) : 0;
+    s->fn_malloc = fn_malloc;
+    s->fn_free   = fn_free;
+    if ((s->fname = fn_malloc(flen+1)) == NULL)
+        return false;
+    memcpy(s->fname, fname, flen+1);
+    if (mcdb_shardset_load(s, &s->manifest, &s->shards, &s->n))
+        return true;
+    fn_free(s->fname);
+    s->fname = NULL;
+    return false;
+}
+
+bool
+mcdb_shardset_refresh(struct mcdb_shardset * const restrict s)
+{
+    struct mcdb_mmap *manifest;
+    struct mcdb_mmap **shards;
+    uint32_t n;
+    if (!mcdb_mmap_refresh_check(s->manifest))
+        return true;
+    if (!mcdb_shardset_load(s, &manifest, &shards, &n))
+        return false;  /* (continue with previous set) */
+    mcdb_shardset_unload(s->manifest, s->shards, s->n, s->fn_free);
+    s->manifest = manifest;
+    s->shards   = shards;
+    s->n        = n;
+    return true;
+}
+
+void
+mcdb_shardset_close(struct mcdb_shardset * const restrict s)
+{
+    if (s == NULL || s->fname == NULL) return;
+    mcdb_shardset_unload(s->manifest, s->shards, s->n, s->fn_free);
+    s->fn_free(s->fname);
+    s->fname    = NULL;
+    s->manifest = NULL;
+    s->shards   = NULL;
+    s->n        = 0;
+}
+
+/* Note: __attribute_noinline__ is used to mark less frequent code paths
+ * to prevent inlining of seldoms used paths, hopefully improving instruction
+ * cache hits.
+ */
+
+
+__attribute_nonnull__
+inline
+static void
+mcdb_mmap_unmap(struct mcdb_mmap * const restrict map);
+
+inline
+static void
+mcdb_mmap_unmap(struct mcdb_mmap * const restrict map)
+{
+    if (map->ptr)
+        munmap(map->ptr, map->size);
+    map->ptr  = NULL;
+    map->dir  = NULL;
+    map->filter = NULL;
+    map->size = 0;    /* map->size initialization required for mcdb_read() */
+}
+
+bool
+mcdb_hash_lookup(const uint32_t hash_id, uint32_t * const restrict hash_init,
+                 uint32_t (** const restrict hash_fn)(uint32_t,
+                                                      const void * restrict,
+                                                      size_t))
+{
+    switch (hash_id) {
+      case MCDB_HASH_DJB:
+        *hash_init = UINT32_HASH_DJB_INIT;
+        *hash_fn   = uint32_hash_djb;
+        return true;
+      case MCDB_HASH_CRC32C:
+        *hash_init = UINT32_HASH_CRC32C_INIT;
+        *hash_fn   = uint32_hash_crc32c;
+        return true;
+      case MCDB_HASH_WY:
+        *hash_init = UINT32_HASH_WY_INIT;
+        *hash_fn   = uint32_hash_wy;
+        return true;
+      default:
+        return false;
+    }
+}
+
+__attribute_noinline__
+bool
+mcdb_mmap_init_header(struct mcdb_mmap * const restrict map)
+{
+    unsigned char * const restrict ptr = map->ptr;
+
+    if (map->size >= MCDB_HDR_SZ && ptr[0] == (unsigned char)MCDB_HDR_MAGIC[0]){
+        /* v2 header */
+        uint64_t dir, data, eod, nrecs, fpos, fsz;
+        uint32_t hash_id, hash_seed;
+        if (memcmp(ptr, MCDB_HDR_MAGIC, MCDB_HDR_MAGIC_SZ) != 0)
+            return (errno = EINVAL, false);
+        map->slot_bits = uint32_strunpack_bigendian_aligned_macro(ptr+24);
+        if (uint32_strunpack_bigendian_aligned_macro(ptr+8) != MCDB_HDR_VERSION
+            || (uint32_strunpack_bigendian_aligned_macro(ptr+12)
+                & ~(uint32_t)MCDB_HDR_FLAGS_KNOWN)
+            || map->slot_bits < MCDB_SLOT_BITS
+            || map->slot_bits > MCDB_SLOT_BITS_MAX)
+            return (errno = ENOTSUP, false);
+        hash_id   = uint32_strunpack_bigendian_aligned_macro(ptr+16);
+        hash_seed = uint32_strunpack_bigendian_aligned_macro(ptr+20);
+        map->b    = uint32_strunpack_bigendian_aligned_macro(ptr+28);
+        dir       = uint64_strunpack_bigendian_aligned_macro(ptr+32);
+        data      = uint64_strunpack_bigendian_aligned_macro(ptr+40);
+        eod       = uint64_strunpack_bigendian_aligned_macro(ptr+48);
+        nrecs     = uint64_strunpack_bigendian_aligned_macro(ptr+56);
+        fpos      = uint64_strunpack_bigendian_aligned_macro(ptr+64);
+        fsz       = uint64_strunpack_bigendian_aligned_macro(ptr+72);
+        map->flags = uint32_strunpack_bigendian_aligned_macro(ptr+12)
+                   & MCDB_HDR_LAYOUT;  /* (at most one layout flag) */
+        /* (b == 5 if and only if MCDB_HDR_INLINE; not with MPH or BUCKET)
+         * (b == 4 if MCDB_HDR_WIDE; not with BUCKET) */
+        if ((map->b != 3 && map->b != 4 && map->b != 5)
+            || (map->b == 5) != ((uint32_strunpack_bigendian_aligned_macro(
+                                    ptr+12) & MCDB_HDR_INLINE) != 0)
+            || (map->flags & (map->flags - 1))
+            || ((map->flags & MCDB_HDR_BUCKET) && map->b != 3)
+            || ((map->flags & MCDB_HDR_MPH) && map->b == 5)
+            || ((uint32_strunpack_bigendian_aligned_macro(ptr+12)
+                 & MCDB_HDR_WIDE) && map->b != 4)
+            || (uint32_strunpack_bigendian_aligned_macro(ptr+12)
+                & MCDB_HDR_REDUCE) == MCDB_HDR_REDUCE
+            || data < MCDB_HDR_SZ || eod < data || dir < eod
+            || (dir & MCDB_PAD_MASK) || dir > map->size
+            || map->size - dir < ((uint64_t)16 << map->slot_bits)
+            || (nrecs > INT_MAX
+                && !(uint32_strunpack_bigendian_aligned_macro(ptr+12)
+                     & MCDB_HDR_WIDE)))
+            return (errno = EINVAL, false);
+        if (uint32_strunpack_bigendian_aligned_macro(ptr+12) & MCDB_HDR_FILTER){
+            if (fpos < dir + ((uint64_t)16 << map->slot_bits)
+                || (fpos & (MCDB_FILTER_ALIGN-1))
+                || fpos > map->size || map->size - fpos < fsz
+                || fsz == 0 || (fsz & 31) || (fsz >> 5) > UINT_MAX)
+                return (errno = EINVAL, false);
+            map->filter    = ptr + fpos;
+            map->filter_nb = (uint32_t)(fsz >> 5);
+        }
+        else {
+            map->filter    = NULL;
+            map->filter_nb = 0;
+        }
+        if (hash_id == MCDB_HASH_CUSTOM) {
+            /* caller must set custom hash_fn after mcdb_mmap_init() */
+            map->hash_fn = uint32_hash_djb;
+        }
+        else if (!mcdb_hash_lookup(hash_id, &map->hash_init, &map->hash_fn))
+            return (errno = ENOTSUP, false);
+        map->hash_init = hash_seed;
+        map->hash_id   = hash_id;
+        map->version   = MCDB_HDR_VERSION;
+        map->flags     = uint32_strunpack_bigendian_aligned_macro(ptr+12);
+        map->dir       = ptr + dir;
+        map->data      = (uintptr_t)data;
+        map->eod       = (uintptr_t)eod;
+        map->nrecs     = nrecs;
+        map->n         = nrecs < UINT32_MAX ? (uint32_t)nrecs : UINT32_MAX;
+    }
+    else if (map->size >= MCDB_HEADER_SZ && ptr[0] == 0) {
+        /* v1 (no header; begins with slot directory) */
+        const uint64_t hpos = uint64_strunpack_bigendian_aligned_macro(ptr);
+        if (hpos < MCDB_HEADER_SZ || (hpos & MCDB_PAD_MASK) || hpos > map->size)
+            return (errno = EINVAL, false);
+        map->b         = map->size < UINT_MAX || *(uint32_t *)ptr == 0 ? 3u : 4u;
+        map->hash_init = UINT32_HASH_DJB_INIT;
+        map->hash_fn   = uint32_hash_djb;
+        map->hash_id   = MCDB_HASH_CUSTOM; /*(v1 does not record hash func)*/
+        map->version   = 1;
+        map->flags     = 0;
+        map->slot_bits = MCDB_SLOT_BITS;
+        map->dir       = ptr;
+        map->filter    = NULL;
+        map->filter_nb = 0;
+        map->data      = MCDB_HEADER_SZ;
+        /* end of data is beginning of open hash tables minus MCDB_PAD_MASK
+         * padding (see comments in mcdb_iter_init()) */
+        map->eod       = hpos - 7;
+        map->nrecs     = ~(uint64_t)0; /*(computed by mcdb_numrecs64())*/
+        map->n         = ~0;
+    }
+    else
+        return (errno = EINVAL, false);
+
+    /* (offsets in header are checked against mmap size above, in constant
+     *  time; the slot directory (up to 2^20 entries) is not walked on each
+     *  open and refresh, as with v1 mcdb; see mcdb_validate_slots()) */
+    return true;
+}
+
+__attribute_noinline__
+bool
+mcdb_mmap_init(struct mcdb_mmap * const restrict map, int fd)
+{
+    struct stat st;
+    void * restrict x;
+
+    mcdb_mmap_unmap(map);
+
+    if (fstat(fd, &st) != 0) return false;
+  #if !defined(_LP64) && !defined(__LP64__)
+    if (st.st_size > (off_t)SIZE_MAX) return (errno = EFBIG, false);
+  #endif
+    x = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (x == MAP_FAILED) return false;             /*(touch page w/ mcdb hdr)*/
+    __builtin_prefetch((char *)x, 0, PLASMA_ATTR_MM_HINT_T0);
+  #if 0 /* disable; does not appear to improve performance */
+    /*(peformance hit when hitting an uncached mcdb on my 32-bit Pentium-M)*/
+    if (st.st_size > 4194304) /*(skip syscall overhead if < 4 MB (arbitrary))*/
+        posix_madvise(((char *)x), st.st_size, POSIX_MADV_RANDOM);
+	/*(addr (x) must be aligned on _SC_PAGESIZE for madvise portability)*/
+  #endif
+    map->ptr   = (unsigned char *)x;
+    map->size  = (uintptr_t)st.st_size;
+    map->mtime = st.st_mtime;
+    map->next  = NULL;
+    map->refcnt= 0;
+    map->retired = NULL;
+    if (!mcdb_mmap_init_header(map)) {
+        const int errsave = errno;
+        mcdb_mmap_unmap(map);
+        errno = errsave;
+        return false;
+    }
+    return true;
+}
+
+__attribute_noinline__
+void
+mcdb_mmap_prefault(const struct mcdb_mmap * const restrict map)
+{
+    /* improves performance on uncached mcdb (if about to make *many* queries)
+     * by asking operating system to prefault pages into memory from disk
+     * (call only if mcdb fits into filesystem cache in physical memory) */
+    posix_madvise(((char *)map->ptr), map->size,
+                  POSIX_MADV_WILLNEED | POSIX_MADV_RANDOM);
+}
+
+bool
+mcdb_mmap_filter_mlock(const struct mcdb_mmap * const restrict map)
+{
+    /* (mlock() addr must be aligned on _SC_PAGESIZE for portability) */
+    uintptr_t addr, end;
+    if (map->filter == NULL)
+        return true;
+    addr = (uintptr_t)map->filter;
+    end  = addr + ((uintptr_t)map->filter_nb << 5);
+    addr&= ~((uintptr_t)plasma_sysconf_pagesize() - 1u);
+    return (0 == mlock((void *)addr, (size_t)(end - addr)));
+}
+
+/* Change notification for mcdb_mmap_refresh_check()
+ *
+ * A struct mcdb_watch is shared by all generations of an mcdb_mmap (copied to
+ * newer maps by mcdb_mmap_reopen_threadsafe()) and is released along with
+ * map->dfd in mcdb_mmap_destroy().  map->watch_seq is *w->gen when mmap file
+ * was opened, and readers detect an update when *w->gen changes (memory load).
+ * w->gen points to the generation number in the mmap'd generation sidecar file
+ * (incremented by mcdb_makefn_finish()), or to w->seq, which is incremented by
+ * a single inotify watcher thread when the mmap file in the watched directory
+ * is replaced, written, or touched.  Otherwise (w->gen == NULL, including if
+ * watcher is not available, e.g. in child after fork()), stat() of mmap file
+ * is rate-limited to once per w->interval milliseconds.
+ * (w->wd and w->gen == &w->seq are modified only while holding spinlock) */
+
+struct mcdb_watch {
+  uint64_t *gen;              /* generation num (or NULL to use interval) */
+  uint64_t seq;               /* incremented when mmap file changes (inotify)*/
+  uint32_t next_check;        /* (ms) clock time of next stat() of mmap file */
+  uint32_t interval;          /* (ms) interval between stat() of mmap file */
+  int wd;                     /* inotify watch descriptor (-1 if none) */
+  struct mcdb_watch *wnext;   /* list of inotify watches */
+  void (*fn_free)(void *);    /* fn ptr to free() */
+  char fname[];               /* basename of mmap file */
+};
+
+/* coarse monotonic clock in milliseconds (wraps; compare differences)
+ * (CLOCK_MONOTONIC_COARSE is read from vDSO on Linux without syscall) */
+__attribute_noinline__
+static uint32_t
+mcdb_watch_clock_ms(void);
+
+static uint32_t
+mcdb_watch_clock_ms(void)
+{
+  #if defined(CLOCK_MONOTONIC_COARSE) || defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+   #ifdef CLOCK_MONOTONIC_COARSE
+    if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0)
+   #else
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+   #endif
+        return (uint32_t)ts.tv_sec * 1000u + (uint32_t)ts.tv_nsec / 1000000u;
+  #endif
+    return (uint32_t)time(NULL) * 1000u;
+}
+
+/* true if interval has elapsed since last stat() of mmap file
+ * (only one thread wins the update of w->next_check in each interval) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_watch_interval(struct mcdb_watch * const restrict w);
+
+static bool
+mcdb_watch_interval(struct mcdb_watch * const restrict w)
+{
+    const uint32_t next = plasma_atomic_ld_nopt(&w->next_check);
+    const uint32_t now  = mcdb_watch_clock_ms();
+    return (int32_t)(now - next) >= 0
+        && plasma_atomic_CAS_32(&w->next_check, next, now + w->interval);
+}
+
+#ifdef MCDB_WATCH_INOTIFY_SUPPORTED
+
+static struct mcdb_watch *mcdb_watches;     /* (protected by spinlock) */
+static int mcdb_watch_ifd = -1;
+static bool mcdb_watch_running;             /* watcher thread running */
+static pthread_once_t mcdb_watch_once = PTHREAD_ONCE_INIT;
+
+/* inotify watches fall back to interval stat() (must hold spinlock) */
+static void
+mcdb_watch_stopped(void)
+{
+    struct mcdb_watch *w;
+    mcdb_watch_running = false;
+    for (w = mcdb_watches; w != NULL; w = w->wnext) {
+        if (w->gen == &w->seq)
+            plasma_atomic_store_explicit(&w->gen, NULL, memory_order_release);
+    }
+}
+
+static void *
+mcdb_watch_thread(void * const arg  __attribute_unused__)
+{
+    char buf[4096] __attribute_aligned__((__alignof__(struct inotify_event)));
+    const struct inotify_event *ev;
+    struct mcdb_watch *w;
+    ssize_t n, i;
+
+    for (;;) {
+        n = read(mcdb_watch_ifd, buf, sizeof(buf));
+        if (__builtin_expect( (n <= 0), 0)) {
+            if (n == -1 && errno == EINTR)
+                continue;
+            break;
+        }
+        (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
+        for (i = 0; i < n; i += (ssize_t)(sizeof(struct inotify_event)+ev->len)){
+            ev = (const struct inotify_event *)(buf+i);
+            for (w = mcdb_watches; w != NULL; w = w->wnext) {
+                if (ev->mask & IN_Q_OVERFLOW)/*(events lost; assume changed)*/
+                    plasma_atomic_fetch_add_u64(&w->seq,1,memory_order_release);
+                else if (ev->wd != w->wd)
+                    continue;
+                else if (ev->mask & IN_IGNORED) { /* directory went away */
+                    w->wd = -1;     /* fall back to interval stat() */
+                    plasma_atomic_store_explicit(&w->gen, NULL,
+                                                 memory_order_release);
+                }
+                else if (ev->len != 0 && 0 == strcmp(ev->name, w->fname))
+                    plasma_atomic_fetch_add_u64(&w->seq,1,memory_order_release);
+            }
+        }
+        plasma_spin_lock_release(&mcdb_global_spinlock);
+    }
+
+    /* watcher failed; all watches fall back to interval stat() */
+    (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
+    mcdb_watch_stopped();
+    plasma_spin_lock_release(&mcdb_global_spinlock);
+    return NULL;
+}
+
+/* hold spinlock across fork() so that lock is consistent in child, and
+ * fall back to interval stat() in child, in which watcher thread not running*/
+static void
+mcdb_watch_atfork_prepare(void)
+{
+    (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
+}
+
+static void
+mcdb_watch_atfork_parent(void)
+{
+    plasma_spin_lock_release(&mcdb_global_spinlock);
+}
+
+static void
+mcdb_watch_atfork_child(void)
+{
+    mcdb_watch_stopped();
+    plasma_spin_lock_release(&mcdb_global_spinlock);
+}
+
+static void
+mcdb_watch_thread_init(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t sigs, osigs;
+    int rc;
+
+    if ((mcdb_watch_ifd = inotify_init1(IN_CLOEXEC)) == -1)
+        return;
+    if (pthread_atfork(mcdb_watch_atfork_prepare, mcdb_watch_atfork_parent,
+                       mcdb_watch_atfork_child) != 0
+        || pthread_attr_init(&attr) != 0) {
+        (void) nointr_close(mcdb_watch_ifd);
+        mcdb_watch_ifd = -1;
+        return;
+    }
+    (void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    (void) pthread_attr_setstacksize(&attr, 65536);
+    sigfillset(&sigs);  /* watcher thread does not handle signals */
+    (void) pthread_sigmask(SIG_SETMASK, &sigs, &osigs);
+    mcdb_watch_running = true;
+    rc = pthread_create(&thread, &attr, mcdb_watch_thread, NULL);
+    (void) pthread_sigmask(SIG_SETMASK, &osigs, NULL);
+    (void) pthread_attr_destroy(&attr);
+    if (rc != 0)
+        mcdb_watch_running = false;
+}
+
+/* add inotify watch on directory containing mmap file */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static int
+mcdb_watch_inotify_add(const struct mcdb_mmap * const restrict map);
+
+static int
+mcdb_watch_inotify_add(const struct mcdb_mmap * const restrict map)
+{
+    const uint32_t mask = IN_ONLYDIR | IN_CREATE | IN_MOVED_TO
+                        | IN_CLOSE_WRITE | IN_ATTRIB;
+    char path[32] = "/proc/self/fd/";
+    char *dname = path;
+    const char *b;
+    bool alloc = false;
+    int wd;
+
+    if (pthread_once(&mcdb_watch_once, mcdb_watch_thread_init) != 0
+        || !plasma_atomic_load_explicit(&mcdb_watch_running,
+                                        memory_order_acquire))
+        return -1;
 
+    if (map->dfd != -1) {   /* (path to map->dfd; map->dfd might be renamed) */
+        char d[12];
+        size_t i = sizeof(d), n = 14; /*(n = strlen("/proc/self/fd/"))*/
+        unsigned int u = (unsigned int)map->dfd;
+        do { d[--i] = (char)('0' + u % 10); } while ((u /= 10) != 0);
+        memcpy(path+n, d+i, sizeof(d)-i);
+        path[n+sizeof(d)-i] = '\0';
+    }
+    else if ((b = strrchr(map->fname, '/')) == NULL)
+        memcpy(path, ".", 2);
+    else if (b == map->fname)
+        memcpy(path, "/", 2);
+    else {
+        if ((dname = map->fn_malloc((size_t)(b - map->fname) + 1)) == NULL)
+            return -1;
+        memcpy(dname, map->fname, (size_t)(b - map->fname));
+        dname[b - map->fname] = '\0';
+        alloc = true;
+    }
+
+    wd = inotify_add_watch(mcdb_watch_ifd, dname, mask);
+    if (alloc && map->fn_free)
+        map->fn_free(dname);
+    return wd;
+}
+
+#endif /* MCDB_WATCH_INOTIFY_SUPPORTED */
 
+/* mmap generation number from generation sidecar file <fname>.gen */
 __attribute_nonnull__
-inline
-static void
-mcdb_mmap_unmap(struct mcdb_mmap * const restrict map);
+__attribute_warn_unused_result__
+static uint64_t *
+mcdb_watch_genmap(const struct mcdb_mmap * const restrict map);
 
-inline
-static void
-mcdb_mmap_unmap(struct mcdb_mmap * const restrict map)
+static uint64_t *
+mcdb_watch_genmap(const struct mcdb_mmap * const restrict map)
 {
-    if (map->ptr)
-        munmap(map->ptr, map->size);
-    map->ptr  = NULL;
-    map->size = 0;    /* map->size initialization required for mcdb_read() */
+    struct stat st;
+    void *p = MAP_FAILED;
+    char buf[sizeof(map->fnamebuf)+4];
+    const size_t flen = strlen(map->fname);
+    char * const fngen = (flen+5 <= sizeof(buf)) ? buf : map->fn_malloc(flen+5);
+    int fd;
+
+    if (fngen == NULL)
+        return NULL;
+    memcpy(fngen, map->fname, flen);
+    memcpy(fngen+flen, ".gen", 5);
+  #ifdef AT_FDCWD
+    if (map->dfd != -1)
+        fd = nointr_openat(map->dfd, fngen, O_RDONLY|O_NONBLOCK|O_CLOEXEC, 0);
+    else
+  #endif
+    fd = nointr_open(fngen, O_RDONLY|O_NONBLOCK|O_CLOEXEC, 0);
+    if (fngen != buf)
+        map->fn_free(fngen);
+    if (fd == -1)
+        return NULL;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(uint64_t))
+        p = mmap(0, sizeof(uint64_t), PROT_READ, MAP_SHARED, fd, 0);
+    (void) nointr_close(fd);
+    return (p != MAP_FAILED) ? (uint64_t *)p : NULL;
 }
 
-__attribute_noinline__
 bool
-mcdb_mmap_init(struct mcdb_mmap * const restrict map, int fd)
+mcdb_mmap_watch(struct mcdb_mmap * const restrict map,
+                const unsigned int interval_ms, const int flags)
 {
-    struct stat st;
-    void * restrict x;
+    struct mcdb_watch *w;
+    const char * const b = strrchr(map->fname, '/');
+    const char * const fname = (b != NULL) ? b+1 : map->fname;
+    const size_t flen = strlen(fname);
 
-    mcdb_mmap_unmap(map);
+    if (map->watch != NULL)
+        return true;
+    if (map->fn_malloc == NULL
+        || (w = map->fn_malloc(sizeof(struct mcdb_watch)+flen+1)) == NULL)
+        return false;
+    w->gen        = NULL;
+    w->seq        = 0;
+    w->interval   = interval_ms;
+    w->next_check = mcdb_watch_clock_ms() + interval_ms;
+    w->wd         = -1;
+    w->wnext      = NULL;
+    w->fn_free    = map->fn_free;
+    memcpy(w->fname, fname, flen+1);
 
-    if (fstat(fd, &st) != 0) return false;
-  #if !defined(_LP64) && !defined(__LP64__)
-    if (st.st_size > (off_t)SIZE_MAX) return (errno = EFBIG, false);
-  #endif
-    x = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
-    if (x == MAP_FAILED) return false;             /*(touch page w/ mcdb hdr)*/
-    __builtin_prefetch((char *)x, 0, PLASMA_ATTR_MM_HINT_T0);
-  #if 0 /* disable; does not appear to improve performance */
-    /*(peformance hit when hitting an uncached mcdb on my 32-bit Pentium-M)*/
-    if (st.st_size > 4194304) /*(skip syscall overhead if < 4 MB (arbitrary))*/
-        posix_madvise(((char *)x), st.st_size, POSIX_MADV_RANDOM);
-	/*(addr (x) must be aligned on _SC_PAGESIZE for madvise portability)*/
+    if ((flags & MCDB_WATCH_GENERATION)
+        && (w->gen = mcdb_watch_genmap(map)) != NULL)
+        ;
+  #ifdef MCDB_WATCH_INOTIFY_SUPPORTED
+    else if ((flags & MCDB_WATCH_INOTIFY)
+             && (w->wd = mcdb_watch_inotify_add(map)) != -1) {
+        w->gen = &w->seq;
+        (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
+        w->wnext = mcdb_watches;
+        mcdb_watches = w;
+        plasma_spin_lock_release(&mcdb_global_spinlock);
+    }
   #endif
-    map->ptr   = (unsigned char *)x;
-    map->size  = (uintptr_t)st.st_size;
-    map->b     = st.st_size < UINT_MAX || *(uint32_t *)x == 0 ? 3u : 4u;
-    map->n     = ~0;
-    map->mtime = st.st_mtime;
-    map->next  = NULL;
-    map->refcnt= 0;
-    map->hash_init = UINT32_HASH_DJB_INIT;
-    map->hash_fn   = uint32_hash_djb;
+
+    /* map opened prior to watch; load generation num, then stat() mmap file
+     * and force refresh if mmap file replaced after map opened */
+    if (w->gen != NULL) {
+        map->watch_seq = plasma_atomic_load_explicit(w->gen,
+                                                     memory_order_acquire);
+        if (mcdb_mmap_refresh_check(map))
+            map->watch_seq = ~map->watch_seq;
+    }
+    plasma_membar_StoreStore();
+    map->watch = w;
     return true;
 }
 
-__attribute_noinline__
-void
-mcdb_mmap_prefault(const struct mcdb_mmap * const restrict map)
+/* release watch (called from mcdb_mmap_destroy()) */
+__attribute_nonnull__
+static void
+mcdb_watch_free(struct mcdb_watch * const restrict w);
+
+static void
+mcdb_watch_free(struct mcdb_watch * const restrict w)
 {
-    /* improves performance on uncached mcdb (if about to make *many* queries)
-     * by asking operating system to prefault pages into memory from disk
-     * (call only if mcdb fits into filesystem cache in physical memory) */
-    posix_madvise(((char *)map->ptr), map->size,
-                  POSIX_MADV_WILLNEED | POSIX_MADV_RANDOM);
+  #ifdef MCDB_WATCH_INOTIFY_SUPPORTED
+    if (mcdb_watch_ifd != -1) {
+        /* inotify returns same wd for multiple watches on same directory */
+        struct mcdb_watch **xp;
+        const struct mcdb_watch *x;
+        int wd = -1;
+        (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
+        for (xp = &mcdb_watches; *xp != NULL; xp = &(*xp)->wnext) {
+            if (*xp == w) {
+                *xp = w->wnext;
+                wd = w->wd;
+                break;
+            }
+        }
+        for (x = mcdb_watches; x != NULL && wd != -1; x = x->wnext) {
+            if (x->wd == wd)
+                wd = -1;
+        }
+        plasma_spin_lock_release(&mcdb_global_spinlock);
+        if (wd != -1)
+            (void) inotify_rm_watch(mcdb_watch_ifd, wd);
+    }
+  #endif
+    if (w->gen != NULL && w->gen != &w->seq) /* generation sidecar mmap */
+        munmap(w->gen, sizeof(uint64_t));
+    if (w->fn_free)
+        w->fn_free(w);
 }
 
 __attribute_noinline__
@@ -377,6 +1711,10 @@ mcdb_mmap_destroy(struct mcdb_mmap * const restrict map)
         map->dfd = -1;
     }
   #endif
+    if (map != NULL && map->watch != NULL) {
+        mcdb_watch_free(map->watch);
+        map->watch = NULL;
+    }
     mcdb_mmap_free(map);
 }
 
@@ -388,6 +1726,12 @@ mcdb_mmap_reopen(struct mcdb_mmap * const restrict map)
     bool rc;
 
     const int oflags = O_RDONLY | O_NONBLOCK | O_CLOEXEC;
+    if (map->watch != NULL) { /*(change after this point triggers refresh)*/
+        const uint64_t * const gen = map->watch->gen;
+        if (gen != NULL)
+            map->watch_seq = plasma_atomic_load_explicit(gen,
+                                                         memory_order_acquire);
+    }
   #ifdef AT_FDCWD
     if (map->dfd != -1) {
         if ((fd = nointr_openat(map->dfd, map->fname, oflags, 0)) == -1)
@@ -409,7 +1753,16 @@ bool
 mcdb_mmap_refresh_check(const struct mcdb_mmap * const restrict map)
 {
     struct stat st;
+    struct mcdb_watch * const w = map->watch;
     plasma_membar_ld_datadep(); /*(thread ld order dep b/w map and map->ptr)*/
+    if (w != NULL && __builtin_expect( (map->ptr != NULL), 1)) {
+        const uint64_t * const gen = plasma_atomic_ld_nopt(&w->gen);
+        if (gen != NULL)
+            return (plasma_atomic_load_explicit(gen, memory_order_acquire)
+                    != map->watch_seq);
+        if (!mcdb_watch_interval(w))
+            return false;
+    }
     return (map->ptr == NULL
             || ( (
                   #ifdef AT_FDCWD
@@ -531,124 +1884,534 @@ mcdb_mmap_create(struct mcdb_mmap * restrict map,
     }
 }
 
+/* Registration of use of an mcdb_mmap by threads
+ *
+ * Querying threads register use of an mcdb_mmap in a per-thread record
+ * (struct mcdb_reader) instead of modifying a shared reference count or
+ * taking a shared lock, so that readers do not write to shared cache lines.
+ * A map pointer stored in a reader record acts as a hazard pointer: the map
+ * (and each newer map in the map->next chain) is not released while present
+ * in any reader record.  cnt[] is the num of registrations held by the thread.
+ * Records are cache line aligned, linked into a global list, never free'd,
+ * and are reused after a thread exits (registrations still held by a thread
+ * when it exits are released by the thread-specific data destructor).
+ *
+ * map->refcnt counts shared references: the reference held by the shared
+ * (root) map pointer (initial reference from mcdb_mmap_create()), plus any
+ * registrations by threads without a reader record (e.g. out of slots).
+ * The shared reference moves to the newest map when the root map pointer is
+ * advanced.  High bits of map->refcnt flag reopen in progress (0x80000000)
+ * and map added to list of outdated maps pending release (0x40000000).
+ *
+ * Outdated maps are released in order (oldest first) by mcdb_mmap_reclaim()
+ * once unreferenced.  The global spinlock protects only the list of outdated
+ * maps and list of reader records, and is taken only when a thread adds a
+ * reader record, when mcdb is reopened, and when an outdated map might be
+ * released, and not when registering or unregistering use of current map. */
+
+#define MCDB_READER_SLOTS 14
+
+struct mcdb_reader {
+  struct mcdb_mmap *map[MCDB_READER_SLOTS]; /* registered maps (or NULL) */
+  uint32_t cnt[MCDB_READER_SLOTS];          /* registrations of each map */
+  struct mcdb_reader *next;                 /* global list of reader records */
+  uint32_t inuse;                           /* record owned by a thread */
+} __attribute_aligned__((64));
+
+static struct mcdb_reader *mcdb_readers;    /* (protected by spinlock) */
+static struct mcdb_mmap *mcdb_retired;      /* (protected by spinlock) */
+
+__attribute_pure__
+static inline uint32_t
+mcdb_reader_find(const struct mcdb_reader * const restrict r,
+                 const struct mcdb_mmap * const map)
+{
+    uint32_t i = 0;
+    while (i < MCDB_READER_SLOTS && r->map[i] != map)
+        ++i;
+    return i;
+}
+
+/* release slot in reader record (mark no longer in use by this thread) */
+#define mcdb_reader_clear(r,i) \
+  plasma_atomic_store_explicit(&(r)->map[(i)], NULL, memory_order_release)
+
+/* load shared map ptr or map->next (published by other threads) */
+#define mcdb_mmap_ld_acquire(mapptr) \
+  plasma_atomic_load_explicit((mapptr), memory_order_acquire)
+
+/* add map to end of list of outdated maps (must hold spinlock) */
+__attribute_nonnull__
+static void
+mcdb_mmap_retire_locked(struct mcdb_mmap * const restrict map);
+
+static void
+mcdb_mmap_retire_locked(struct mcdb_mmap * const restrict map)
+{
+    struct mcdb_mmap **xp = &mcdb_retired;
+    if (plasma_atomic_fetch_or_u32(&map->refcnt, 0x40000000u,
+                                   memory_order_acq_rel) & 0x40000000u)
+        return; /* already in list */
+    while (*xp != NULL)
+        xp = &(*xp)->retired;
+    map->retired = NULL;
+    *xp = map;
+}
+
+/* outdated map may be released if unreferenced and if no older outdated map
+ * (whose users might traverse map->next chain to newest map) is pending
+ * (must hold spinlock) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_mmap_reclaimable(const struct mcdb_mmap * const map);
+
+static bool
+mcdb_mmap_reclaimable(const struct mcdb_mmap * const map)
+{
+    const struct mcdb_reader *r;
+    const struct mcdb_mmap *x;
+    const struct mcdb_mmap *y;
+    uint32_t i;
+
+    if (plasma_atomic_load_explicit(&map->refcnt, memory_order_acquire)
+        & ~0x40000000u)
+        return false;
+
+    for (r = mcdb_readers; r != NULL; r = r->next) {
+        for (i = 0; i < MCDB_READER_SLOTS; ++i) {
+            if (plasma_atomic_load_explicit(&r->map[i], memory_order_acquire)
+                == map)
+                return false;
+        }
+    }
+
+    for (x = mcdb_retired; x != map; x = x->retired) {
+        for (y = mcdb_mmap_ld_acquire(&x->next); y != NULL;
+             y = mcdb_mmap_ld_acquire(&y->next)) {
+            if (y == map)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/* release outdated maps that are no longer referenced
+ * (map, if not NULL, is newest map in chain and is added to list of outdated
+ *  maps after last shared reference has been released) */
 __attribute_noinline__
-struct mcdb_mmap *
-mcdb_mmap_thread_registration(struct mcdb_mmap ** const restrict mapptr,
-                              const int flags)
+static void
+mcdb_mmap_reclaim(struct mcdb_mmap * const restrict map);
+
+static void
+mcdb_mmap_reclaim(struct mcdb_mmap * const restrict map)
 {
-    struct mcdb_mmap *map;
-    struct mcdb_mmap *next = NULL;
+    struct mcdb_mmap **xp;
+    struct mcdb_mmap *x;
     struct mcdb_mmap *unmap = NULL;
-    const bool register_use_incr = ((flags & MCDB_REGISTER_USE_INCR) != 0);
-    #define register_use_decr (!register_use_incr)
 
-    /* use file-scoped global spinlock to protect scan of multiple mcdb_mmap's
-     * (care has been taken to avoid blocking operations while holding lock) */
+    (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
+    if (map != NULL)
+        mcdb_mmap_retire_locked(map);
+    plasma_membar_seq_cst(); /*(hazard ptrs published before root ptr reload)*/
+    xp = &mcdb_retired;
+    while ((x = *xp) != NULL) {
+        if (mcdb_mmap_reclaimable(x)) {
+            *xp = x->retired;
+            x->retired = unmap;
+            unmap = x;
+        }
+        else
+            xp = &x->retired;
+    }
+    plasma_spin_lock_release(&mcdb_global_spinlock);
+
+    /* release unused maps after releasing lock to minimize time holding lock */
+    while ((x = unmap) != NULL) {
+        unmap = x->retired;
+        if (mcdb_mmap_ld_acquire(&x->next) != NULL)
+            x->fname = NULL;   /* fname shared with newer map in chain */
+        mcdb_mmap_free(x);
+    }
+}
+
+#ifdef _THREAD_SAFE
+
+static pthread_key_t mcdb_reader_key;
+static pthread_once_t mcdb_reader_once = PTHREAD_ONCE_INIT;
+static bool mcdb_reader_key_ok;
 
-    if (__builtin_expect( (!(flags & MCDB_REGISTER_ALREADY_LOCKED)), 1))
-        (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
-    plasma_membar_ccfence();
+static void
+mcdb_reader_exit(void * const r)
+{
+    /* release registrations still held by exiting thread (which would pin
+     * maps forever if left in reader record), then reuse record */
+    struct mcdb_reader * const restrict rd = (struct mcdb_reader *)r;
+    bool held = false;
+    uint32_t i;
+    for (i = 0; i < MCDB_READER_SLOTS; ++i) {
+        if (rd->map[i] != NULL) {
+            rd->cnt[i] = 0;
+            mcdb_reader_clear(rd, i);
+            held = true;
+        }
+    }
+    if (held)
+        mcdb_mmap_reclaim(NULL);
+    plasma_atomic_store_explicit(&rd->inuse, 0, memory_order_release);
+}
+
+static void
+mcdb_reader_key_init(void)
+{
+    mcdb_reader_key_ok =
+      (0 == pthread_key_create(&mcdb_reader_key, mcdb_reader_exit));
+}
+
+/* delete key when mcdb.o is unloaded (e.g. dlclose() of module linking
+ * libmcdb.a), so that pthread_exit() does not call unmapped destructor
+ * (libmcdb.so and libnss_mcdb.so.2 are additionally linked -z nodelete) */
+__attribute__((destructor))
+static void
+mcdb_reader_key_fini(void);
+
+__attribute__((destructor))
+static void
+mcdb_reader_key_fini(void)
+{
+    if (mcdb_reader_key_ok) {
+        mcdb_reader_key_ok = false;
+        (void) pthread_key_delete(mcdb_reader_key);
+    }
+}
+
+__attribute_noinline__
+__attribute_warn_unused_result__
+static struct mcdb_reader *
+mcdb_reader_alloc(void);
+
+static struct mcdb_reader *
+mcdb_reader_alloc(void)
+{
+    struct mcdb_reader *r;
+    void *p;
 
-    map = *mapptr;
+    for (r = plasma_atomic_load_explicit(&mcdb_readers, memory_order_acquire);
+         r != NULL; r = r->next) {
+        if (plasma_atomic_load_explicit(&r->inuse, memory_order_relaxed) == 0
+            && plasma_atomic_CAS_32(&r->inuse, 0, 1))
+            break;
+    }
 
-    if (__builtin_expect( (map == NULL), 0)
-        || (__builtin_expect( (map->ptr == NULL), 0) && register_use_incr)) {
+    if (r == NULL) {
+        if (posix_memalign(&p, 64, sizeof(struct mcdb_reader)) != 0)
+            return NULL;
+        r = (struct mcdb_reader *)memset(p, '\0', sizeof(struct mcdb_reader));
+        r->inuse = 1;
+        (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
+        r->next = mcdb_readers;
+        plasma_atomic_store_explicit(&mcdb_readers, r, memory_order_release);
         plasma_spin_lock_release(&mcdb_global_spinlock);
-        /* succeed if unregister; fail if register */ /*(NULL is failure)*/
-        return (struct mcdb_mmap *)(uintptr_t)(!register_use_incr);
-        /* If registering, possibly detected race condition in which another
-         * thread released final reference and mcdb was munmap()'d while current
-         * thread waited for lock.  It is now invalid to attempt to register use
-         * of a resource that has been released.  Caller can detect and reopen*/
     }
 
-    if (register_use_incr) {
-        if ((next = map->next) == NULL)
-            ++map->refcnt;
-        else {
-            while (next->next != NULL)
-                next = next->next;
-            ++next->refcnt;
-            *mapptr = next;
-        }
+    if (pthread_setspecific(mcdb_reader_key, r) != 0) {
+        plasma_atomic_store_explicit(&r->inuse, 0, memory_order_release);
+        return NULL;
+    }
+    return r;
+}
+
+static inline struct mcdb_reader *
+mcdb_reader_self(void)
+{
+    struct mcdb_reader *r;
+    if (pthread_once(&mcdb_reader_once, mcdb_reader_key_init) != 0
+        || !mcdb_reader_key_ok)
+        return NULL;
+    r = (struct mcdb_reader *)pthread_getspecific(mcdb_reader_key);
+    return (__builtin_expect( (r != NULL), 1)) ? r : mcdb_reader_alloc();
+}
+
+#else
+#define mcdb_reader_self() NULL
+#endif
+
+/* newest map in map->next chain starting at map */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static inline struct mcdb_mmap *
+mcdb_mmap_newest(struct mcdb_mmap *map);
+
+static inline struct mcdb_mmap *
+mcdb_mmap_newest(struct mcdb_mmap *map)
+{
+    struct mcdb_mmap *next;
+    while ((next = mcdb_mmap_ld_acquire(&map->next)) != NULL)
+        map = next;
+    return map;
+}
+
+/* advance shared map ptr to newer map; move shared reference to newer map */
+__attribute_nonnull__
+static void
+mcdb_mmap_advance(struct mcdb_mmap ** const restrict mapptr,
+                  struct mcdb_mmap * const map, struct mcdb_mmap * const next);
+
+static void
+mcdb_mmap_advance(struct mcdb_mmap ** const restrict mapptr,
+                  struct mcdb_mmap * const map, struct mcdb_mmap * const next)
+{
+    if (plasma_atomic_CAS_ptr(mapptr, map, next)) {
+        plasma_atomic_fetch_add_u32(&next->refcnt, 1, memory_order_relaxed);
+        if ((plasma_atomic_fetch_sub_u32(&map->refcnt, 1, memory_order_seq_cst)
+             & 0x3FFFFFFFu) == 1)
+            mcdb_mmap_reclaim(NULL); /*(map already in list of outdated maps)*/
+    }
+}
+
+/* register use of map (map must be protected from release by caller) */
+__attribute_nonnull_x__((2))
+static void
+mcdb_mmap_hold(struct mcdb_reader * const restrict r,
+               struct mcdb_mmap * const map);
+
+static void
+mcdb_mmap_hold(struct mcdb_reader * const restrict r,
+               struct mcdb_mmap * const map)
+{
+    uint32_t i;
+    if (r != NULL
+        && ((i = mcdb_reader_find(r, map)) < MCDB_READER_SLOTS
+            || (i = mcdb_reader_find(r, NULL)) < MCDB_READER_SLOTS)) {
+        plasma_atomic_store_explicit(&r->map[i], map, memory_order_relaxed);
+        ++r->cnt[i];
     }
+    else
+        plasma_atomic_fetch_add_u32(&map->refcnt, 1, memory_order_relaxed);
+}
+
+/* unregister use of map
+ * (map might be released by another thread once no longer registered by this
+ *  thread, so check map before releasing; an outdated map missed by sweep of
+ *  outdated maps in another thread is released by a later sweep) */
+__attribute_nonnull_x__((2))
+static void
+mcdb_mmap_release(struct mcdb_reader * const restrict r,
+                  struct mcdb_mmap * const map,
+                  struct mcdb_mmap ** const restrict mapptr);
 
-    if ((register_use_decr || next != NULL) && --map->refcnt == 0) {
-        while ((next = map->next) != NULL && (next->refcnt & ~0x40000000) == 0){
-            map->next = next->next;
-            next->next = unmap;
-            (unmap = next)->fname = NULL;   /* do not free(next->fname) yet */
+static void
+mcdb_mmap_release(struct mcdb_reader * const restrict r,
+                  struct mcdb_mmap * const map,
+                  struct mcdb_mmap ** const restrict mapptr)
+{
+    const bool outdated = (mcdb_mmap_ld_acquire(&map->next) != NULL);
+    uint32_t i;
+    if (r != NULL && (i = mcdb_reader_find(r, map)) < MCDB_READER_SLOTS) {
+        if (--r->cnt[i] == 0) {
+            const bool released = outdated
+              || (plasma_atomic_load_explicit(&map->refcnt,memory_order_acquire)
+                  & 0x3FFFFFFFu) == 0;
+            mcdb_reader_clear(r, i);
+            if (released)
+                mcdb_mmap_reclaim(NULL);
         }
-        if (next != NULL)
-            next->refcnt &= ~0x40000000;    /* unmark; now oldest map in chain*/
-        map->next = unmap;
-        (unmap = map)->fname = NULL;        /* do not free(map->fname) yet */
-        if (register_use_decr)
-            *mapptr = NULL;
-        /*(map will be free'd but map value still not NULL for return val)*/
     }
-    #undef register_use_decr
+    else if ((plasma_atomic_fetch_sub_u32(&map->refcnt, 1, memory_order_seq_cst)
+              & 0x3FFFFFFFu) == 1) {
+        if (mapptr != NULL) /* last shared reference released */
+            plasma_atomic_store_explicit(mapptr, NULL, memory_order_release);
+        mcdb_mmap_reclaim(outdated ? NULL : map);
+    }
+}
+
+/* register use of map, for threads without reader record
+ * (spinlock serializes load of shared map ptr with release of outdated maps)*/
+__attribute_noinline__
+__attribute_nonnull__
+static struct mcdb_mmap *
+mcdb_mmap_register_locked(struct mcdb_mmap ** const restrict mapptr);
+
+static struct mcdb_mmap *
+mcdb_mmap_register_locked(struct mcdb_mmap ** const restrict mapptr)
+{
+    struct mcdb_mmap *map;
+    struct mcdb_mmap *next = NULL;
 
+    (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
+    map = mcdb_mmap_ld_acquire(mapptr);
+    if (__builtin_expect( (map != NULL), 1)
+        && __builtin_expect( (map->ptr != NULL), 1)) {
+        next = mcdb_mmap_newest(map);
+        plasma_atomic_fetch_add_u32(&next->refcnt, 1, memory_order_relaxed);
+    }
     plasma_spin_lock_release(&mcdb_global_spinlock);
 
-    /* release unused maps after releasing lock to minimize time holding lock */
-    next = unmap;
-    while (next != NULL) {
-        next = (unmap = next)->next;
-        mcdb_mmap_free(unmap);
+    /* (shared reference on map held by *mapptr until *mapptr is advanced) */
+    if (next != map && next != NULL)
+        mcdb_mmap_advance(mapptr, map, next);
+    return next;
+}
+
+__attribute_noinline__
+struct mcdb_mmap *
+mcdb_mmap_thread_registration(struct mcdb_mmap ** const restrict mapptr,
+                              const int flags)
+{
+    struct mcdb_reader * const r = mcdb_reader_self();
+    struct mcdb_mmap *map;
+    struct mcdb_mmap *next;
+    uint32_t i;
+
+    if (!(flags & MCDB_REGISTER_USE_INCR)) { /* MCDB_REGISTER_USE_DECR */
+        if ((map = mcdb_mmap_ld_acquire(mapptr)) == NULL)
+            return (struct mcdb_mmap *)(uintptr_t)1; /* succeed if unregister*/
+        mcdb_mmap_release(r, map, mapptr);
+        return map; /*(for decr refcnt, non-NULL is success, even if map free'd)*/
+    }
+
+    if (flags & MCDB_REGISTER_MOVE) {
+        /* caller holds registration on *mapptr; move registration to newest
+         * (registration on map protects newer maps in chain from release) */
+        map = mcdb_mmap_ld_acquire(mapptr);
+        if ((next = mcdb_mmap_ld_acquire(&map->next)) == NULL)
+            return map;
+        next = mcdb_mmap_newest(next);
+        mcdb_mmap_hold(r, next);
+        plasma_atomic_store_explicit(mapptr, next, memory_order_release);
+        mcdb_mmap_release(r, map, NULL);
+        return next;
+    }
+
+    /* *mapptr is shared map ptr; publish map in reader record (hazard ptr),
+     * then verify *mapptr has not been advanced (and map possibly released) */
+    if (r == NULL)
+        return mcdb_mmap_register_locked(mapptr);
+    for (;;) {
+        map = mcdb_mmap_ld_acquire(mapptr);
+        if (__builtin_expect( (map == NULL), 0))
+            return NULL;
+        if ((i = mcdb_reader_find(r, map)) < MCDB_READER_SLOTS)
+            break;  /* already registered by this thread */
+        if ((i = mcdb_reader_find(r, NULL)) == MCDB_READER_SLOTS)
+            return mcdb_mmap_register_locked(mapptr);
+        /*(seq_cst store and reload: hazard ptr store ordered before reload)*/
+        plasma_atomic_store_explicit(&r->map[i], map, memory_order_seq_cst);
+        if (plasma_atomic_load_explicit(mapptr, memory_order_seq_cst) == map)
+            break;
+        mcdb_reader_clear(r, i);
+    }
+
+    if (__builtin_expect( (map->ptr == NULL), 0)) {
+        if (r->cnt[i] == 0)
+            mcdb_reader_clear(r, i);
+        return NULL;
+        /* If registering, possibly detected race condition in which another
+         * thread released final reference and mcdb was munmap()'d.  It is now
+         * invalid to attempt to register use of a resource that has been
+         * released.  Caller can detect and reopen */
     }
 
-    /* return map on which incr refcnt to avoid race after unlocking */
-    return map; /*(for decr refcnt, non-NULL is success, even if map free'd)*/
+    if ((next = mcdb_mmap_ld_acquire(&map->next)) == NULL) {
+        ++r->cnt[i];
+        return map;
+    }
+
+    next = mcdb_mmap_newest(next);
+    mcdb_mmap_hold(r, next);
+    mcdb_mmap_advance(mapptr, map, next);
+    if (r->cnt[i] == 0) {
+        mcdb_reader_clear(r, i);
+        mcdb_mmap_reclaim(NULL);
+    }
+    return next;
 }
 
 /* theaded programs (while multiple threads are using same struct mcdb_mmap)
  * must be registered with current *mapptr before calling this routine, or else
- * there is a race condition where map might be removed out from under us. */
+ * there is a race condition where map might be removed out from under us.
+ * (*mapptr may instead be shared map ptr holding shared reference, and caller
+ *  not registered with *mapptr, in which case shared map ptr is advanced) */
+__attribute_noinline__
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_mmap_reopen_advance(struct mcdb_mmap ** const restrict mapptr,
+                         struct mcdb_mmap * const map);
+
+static bool
+mcdb_mmap_reopen_advance(struct mcdb_mmap ** const restrict mapptr,
+                         struct mcdb_mmap * const map)
+{
+    struct mcdb_reader * const r = mcdb_reader_self();
+    struct mcdb_mmap *next;
+    if (r != NULL && mcdb_reader_find(r, map) < MCDB_READER_SLOTS)
+        return NULL !=
+          mcdb_mmap_thread_registration_h(mapptr, MCDB_REGISTER_USE_INCR
+                                                 |MCDB_REGISTER_MOVE);
+    next = mcdb_mmap_newest(mcdb_mmap_ld_acquire(&map->next));
+    mcdb_mmap_advance(mapptr, map, next);
+    return true;
+}
+
 __attribute_noinline__
 bool
 mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** const restrict mapptr)
 {
-    struct mcdb_mmap * const map = *mapptr;
+    struct mcdb_mmap * const map = mcdb_mmap_ld_acquire(mapptr);
     struct mcdb_mmap *next;
     bool rc;
 
-    /* use high bit of refcnt to guard that one thread attempts reopen
-     * (must lock since others modify refcnt while holding same spinlock) */
-    (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
-    if (map->next != NULL)
-        return NULL !=                      /* registration releases spinlock */
-          mcdb_mmap_thread_registration_h(mapptr, MCDB_REGISTER_USE_INCR
-                                                 |MCDB_REGISTER_ALREADY_LOCKED);
-    if ((rc = (map->refcnt < 0x80000000u))) /*(0!=(map->refcnt & 0x80000000u))*/
-        map->refcnt |= 0x80000000u;
-    plasma_spin_lock_release(&mcdb_global_spinlock);
-    if (!rc)
+    if (mcdb_mmap_ld_acquire(&map->next) != NULL)
+        return mcdb_mmap_reopen_advance(mapptr, map);
+
+    /* use high bit of refcnt to guard that one thread attempts reopen */
+    if (plasma_atomic_fetch_or_u32(&map->refcnt, 0x80000000u,
+                                   memory_order_acq_rel) & 0x80000000u)
         return true; /*other threads return, even though mcdb not reopened yet*/
 
     if (__builtin_expect( (map->fn_malloc == NULL), 0)
-        || (next = map->fn_malloc(sizeof(struct mcdb_mmap))) == NULL)
+        || (next = map->fn_malloc(sizeof(struct mcdb_mmap))) == NULL) {
+        plasma_atomic_fetch_and_u32(&map->refcnt, ~0x80000000u,
+                                    memory_order_release);
         return false; /*(misconfigured mcdb_mmap or map->fn_malloc failed)*/
+    }
 
     memcpy(next, map, sizeof(struct mcdb_mmap));
     next->ptr = NULL; /*(skip munmap() in mcdb_mmap_reopen())*/
     if (map->fname == map->fnamebuf)
         next->fname = next->fnamebuf;
+    next->allocated = 0; /*(next allocated here; free when released)*/
     rc = mcdb_mmap_reopen(next);
     if (__builtin_expect((!rc), 0)) {
+        plasma_atomic_fetch_and_u32(&map->refcnt, ~0x80000000u,
+                                    memory_order_release);
         map->fn_free(next);
         return false;
     }
-    next->hash_init = map->hash_init;
-    next->hash_fn   = map->hash_fn;
-    next->refcnt   |= 0x40000000u;    /* flag to indicate not oldest in chain */
-    plasma_membar_StoreStore();
-    map->next       = next;
+    if (next->hash_id == MCDB_HASH_CUSTOM && map->hash_id == MCDB_HASH_CUSTOM){
+        /* retain caller-provided hash func (not recorded in mcdb header) */
+        next->hash_init = map->hash_init;
+        next->hash_fn   = map->hash_fn;
+    }
+
+    /* add map to list of outdated maps before any thread can reach next */
     (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
-    map->refcnt    &= ~0x80000000u;         /* registration releases spinlock */
-    return NULL !=
-      mcdb_mmap_thread_registration_h(mapptr, MCDB_REGISTER_USE_INCR
-                                             |MCDB_REGISTER_ALREADY_LOCKED);
+    mcdb_mmap_retire_locked(map);
+    plasma_spin_lock_release(&mcdb_global_spinlock);
+
+    /* hold reference on map while advancing (once map->next is set, threads
+     * registering use of shared map ptr may advance it and release map) */
+    plasma_atomic_fetch_add_u32(&map->refcnt, 1, memory_order_relaxed);
+    plasma_atomic_store_explicit(&map->next, next, memory_order_release);
+    plasma_atomic_fetch_and_u32(&map->refcnt, ~0x80000000u,
+                                memory_order_release);
+    rc = mcdb_mmap_reopen_advance(mapptr, map);
+    if ((plasma_atomic_fetch_sub_u32(&map->refcnt, 1, memory_order_seq_cst)
+         & 0x3FFFFFFFu) == 1)
+        mcdb_mmap_reclaim(NULL);
+    return rc;
 }
 
 
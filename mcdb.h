@@ -28,6 +28,7 @@
 #include "plasma/plasma_feature.h"
 #include "plasma/plasma_attr.h"
 #include "plasma/plasma_stdtypes.h" /* bool, size_t, uint32_t, uintptr_t */
+#include "plasma/plasma_atomic.h"   /* plasma_atomic_load_explicit() */
 PLASMA_ATTR_Pragma_once
 
 #include <sys/time.h>               /* time_t */
@@ -45,10 +46,12 @@ PLASMA_ATTR_Pragma_once
 extern "C" {
 #endif
 
+struct mcdb_watch;  /* (opaque) */
+
 struct mcdb_mmap {
   unsigned char *ptr;         /* mmap pointer */
   uint32_t b;                 /* hash table stride bits: (data < 4GB) ? 3 : 4 */
-  uint32_t n;                 /* num records in mcdb */
+  uint32_t n;                 /* num records in mcdb (UINT32_MAX if more) */
   uint32_t hash_init;         /* hash init value */
   uint32_t hash_pad;          /* (padding)*/
   uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t); /* hash func */
@@ -61,12 +64,29 @@ struct mcdb_mmap {
   char fnamebuf[112];         /* buffer in which to store short fname */
   int allocated;              /* flag if struct allocated in mcdb_mmap_create */
   int dfd;                    /* fd open to dir in which mmap file resides */
-  uint32_t refcnt;            /* registered access reference count */
+  uint32_t refcnt;            /* shared reference count (see registration) */
+  /* (members below added with file format v2 (see NOTES)) */
+  uint32_t version;           /* file format version */
+  struct mcdb_mmap *retired;  /* link in list of outdated maps to release */
+  struct mcdb_watch *watch;   /* change notification (see mcdb_mmap_watch())*/
+  uint64_t watch_seq;         /* watch generation num when mmap file opened */
+  uint32_t hash_id;           /* hash func id (enum mcdb_hash_id) */
+  uint32_t slot_bits;         /* log2 of num slots in slot directory */
+  uint32_t flags;             /* file format feature flags */
+  uint32_t filter_nb;         /* num of filter blocks */
+  unsigned char *dir;         /* slot directory (lvl1 hash table) */
+  unsigned char *filter;      /* filter section (NULL if no MCDB_HDR_FILTER) */
+  uintptr_t data;             /* offset of start of data section */
+  uintptr_t eod;              /* offset of end of data section */
+  uint64_t nrecs;             /* num records in mcdb */
 };
 /* aside: char fnamebuf[] sized to separate 'next' and 'refcnt' by 128 bytes
  * (L2 cache lines on modern hardware are 64-bytes and 128-bytes)
  * (32-bit pointers are 4-byte; 64-bit pointers are 8-byte)
- * (separate cache lines for high-frequency read-only data and modified data) */
+ * (separate cache lines for high-frequency read-only data and modified data)
+ * (members added with v2 are appended, so offsets of prior members and size
+ *  of fnamebuf[] are unchanged; rarely modified members are placed between
+ *  'refcnt' and members read by lookups) */
 
 struct mcdb {
   struct mcdb_mmap *map;
@@ -80,6 +100,8 @@ struct mcdb {
   uint32_t khash;  /* initialized by call to mcdb_findtagstart() */
   uint32_t pad0;   /* padding */
   void *vp;        /* user-provided extension data */
+  uint32_t rpos;   /* data section record pos if record inlined (b == 5) */
+  uint32_t kfp;    /* key fingerprint (MCDB_HDR_WIDE) (stored bigendian) */
 };
 
 __attribute_hot__
@@ -98,12 +120,75 @@ EXPORT extern bool
 mcdb_findtagnext(struct mcdb * restrict, const char * restrict, size_t,
                  unsigned char); /* note: must be 0 or cast to (unsigned char)*/
 
+/* batched lookup of n keys, interleaving prefetch of the cache lines needed
+ * by each lookup in the batch (for use with mcdb much larger than CPU cache).
+ * m[] is array of n struct mcdb, each with map initialized by caller.
+ * Returns number of keys found.  mcdb_found(&m[i]) is true if keys[i] found,
+ * in which case mcdb_findtagnext() can be called for additional values. */
+__attribute_hot__
+__attribute_nonnull__
+__attribute_nothrow__
+EXPORT extern size_t
+mcdb_findtag_batch(struct mcdb * restrict, size_t,
+                   const char * const * restrict, const size_t * restrict,
+                   unsigned char);/* note: must be 0 or cast to (unsigned char)*/
+
+#define mcdb_find_batch(m,n,keys,klens) \
+  mcdb_findtag_batch((m),(n),(keys),(klens),0)
+#define mcdb_found(m) ((m)->loop != 0)
+
 #define mcdb_findstart(m,key,klen) mcdb_findtagstart((m),(key),(klen),0)
 #define mcdb_findnext(m,key,klen)  mcdb_findtagnext((m),(key),(klen),0)
 #define mcdb_find(m,key,klen) \
   (__builtin_expect((mcdb_findstart((m),(key),(klen))), 1) \
                   && mcdb_findnext((m),(key),(klen)))
 
+/* hash of key computed once by caller and reused to look up key in multiple
+ * mcdb (e.g. per-tenant mcdb) or to add key to mcdb (mcdb_make_add_hashed()).
+ * mcdb_khash_init() hashes key (and tagc, if not 0) with hash func of hash id
+ * (enum mcdb_hash_id) and seed (e.g. UINT32_HASH_DJB_INIT), and returns false
+ * if hash id is not known; mcdb_khash_init_map() hashes with hash func and
+ * seed of map.  mcdb_findtagstart_hashed() uses khash if hash func and seed
+ * of m->map (after refresh) are those with which khash was computed, and
+ * otherwise hashes key (so khash is an optimization, never a wrong answer).
+ * Same key and tagc must be passed to mcdb_findtagstart_hashed() and
+ * mcdb_findtagnext(). */
+struct mcdb_khash {
+  uint32_t khash;     /* hash of key */
+  uint32_t hash_init; /* seed with which khash computed */
+  uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t);
+};
+
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_khash_init(struct mcdb_khash * restrict, uint32_t, uint32_t,
+                const char * restrict, size_t,
+                unsigned char);/* note: must be 0 or cast to (unsigned char)*/
+
+__attribute_nonnull__
+__attribute_nothrow__
+EXPORT extern void
+mcdb_khash_init_map(struct mcdb_khash * restrict,
+                    const struct mcdb_mmap * restrict,
+                    const char * restrict, size_t,
+                    unsigned char);/* note: must be 0 or cast to (unsigned char)*/
+
+__attribute_hot__
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_findtagstart_hashed(struct mcdb * restrict, const char * restrict, size_t,
+                         unsigned char, const struct mcdb_khash * restrict);
+
+#define mcdb_findstart_hashed(m,key,klen,kh) \
+  mcdb_findtagstart_hashed((m),(key),(klen),0,(kh))
+#define mcdb_find_hashed(m,key,klen,kh) \
+  (__builtin_expect((mcdb_findstart_hashed((m),(key),(klen),(kh))), 1) \
+                  && mcdb_findnext((m),(key),(klen)))
+
 __attribute_nonnull__
 __attribute_nothrow__
 __attribute_warn_unused_result__
@@ -116,18 +201,33 @@ __attribute_warn_unused_result__
 EXPORT extern uint32_t
 mcdb_numrecs(struct mcdb * restrict);
 
+/* num records in mcdb (mcdb_numrecs() returns UINT32_MAX if more records,
+ * e.g. MCDB_HDR_WIDE mcdb with more than 4 billion records) */
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_warn_unused_result__
+EXPORT extern uint64_t
+mcdb_numrecs64(struct mcdb * restrict);
+
 __attribute_nonnull__
 __attribute_nothrow__
 __attribute_warn_unused_result__
 EXPORT extern bool
 mcdb_validate_slots(struct mcdb * restrict);
 
-/* (macros valid only after mcdb_find() or mcdb_find*next() returns true) */
+/* (macros valid only after mcdb_find() or mcdb_find*next() returns true)
+ * (mcdb_datapos() is offset of data in mmap, e.g. for mcdb_read().  If record
+ *  is inlined in hash table entry (MCDB_HDR_INLINE), offset is of the copy in
+ *  the hash table, not in data section; mcdb_recdatapos() is in data section)*/
 #define mcdb_datapos(m)      ((m)->dpos)
 #define mcdb_datalen(m)      ((m)->dlen)
 #define mcdb_dataptr(m)      ((m)->map->ptr+(m)->dpos)
 #define mcdb_keyptr(m)       ((m)->map->ptr+(m)->dpos-(m)->klen)
 #define mcdb_keylen(m)       ((m)->klen)
+/* (position of data in data section; differs from mcdb_datapos() if record
+ *  is inlined in hash table entry (MCDB_HDR_INLINE); compare with iter pos) */
+#define mcdb_recdatapos(m) \
+  ((m)->map->b == 5 ? (uintptr_t)(m)->rpos+8+(m)->klen : (m)->dpos)
 
 struct mcdb_iter {
   unsigned char *ptr;
@@ -155,6 +255,122 @@ __attribute_nothrow__
 EXPORT extern void
 mcdb_iter_init(struct mcdb_iter * restrict, struct mcdb * restrict);
 
+/* layered lookup: small delta mcdb (MCDB_HDR_DELTA) of upserts and tombstones
+ * consulted before large base mcdb, so that changes are visible after rebuild
+ * of the delta, without rebuild of base (until compaction; see NOTES)
+ * base.map and delta.map are initialized by caller (e.g. mcdb_mmap_create()).
+ * Lookups have same semantics as mcdb_find*() on mcdb merged from base and
+ * delta: key found in delta hides all records of key in base.  After
+ * mcdb_overlay_find*() returns true, o->cur is the struct mcdb with which to
+ * use macros mcdb_dataptr(), mcdb_datalen(), etc (op byte is not in data).
+ * mcdb_overlay_iter() returns records of base with keys not in delta, then
+ * upserts in delta (use mcdb_iter_*() macros with &iter->iter). */
+struct mcdb_overlay {
+  struct mcdb base;
+  struct mcdb delta;
+  struct mcdb *cur;  /* mcdb in which key found (base or delta) */
+  bool shadow;       /* key found in delta (base not searched) */
+};
+
+struct mcdb_overlay_iter {
+  struct mcdb_iter iter;
+  struct mcdb_overlay *o;
+  struct mcdb m;     /* lookup of keys of base in delta */
+  uint32_t phase;
+};
+
+__attribute_hot__
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_overlay_findtagstart(struct mcdb_overlay * restrict,
+                          const char * restrict, size_t, unsigned char);
+
+__attribute_hot__
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_overlay_findtagnext(struct mcdb_overlay * restrict,
+                         const char * restrict, size_t, unsigned char);
+
+#define mcdb_overlay_findstart(o,key,klen) \
+  mcdb_overlay_findtagstart((o),(key),(klen),0)
+#define mcdb_overlay_findnext(o,key,klen) \
+  mcdb_overlay_findtagnext((o),(key),(klen),0)
+#define mcdb_overlay_find(o,key,klen) \
+  (__builtin_expect((mcdb_overlay_findstart((o),(key),(klen))), 1) \
+                  && mcdb_overlay_findnext((o),(key),(klen)))
+
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_overlay_iter(struct mcdb_overlay_iter * restrict);
+
+__attribute_nonnull__
+__attribute_nothrow__
+EXPORT extern void
+mcdb_overlay_iter_init(struct mcdb_overlay_iter * restrict,
+                       struct mcdb_overlay * restrict);
+
+/* refresh delta before base: compaction replaces base before delta, so that
+ * refresh never pairs new (emptied) delta with old base (see NOTES) */
+#define mcdb_overlay_refresh(o) \
+  (mcdb_mmap_refresh((o)->delta.map) && mcdb_mmap_refresh((o)->base.map))
+#define mcdb_overlay_thread_refresh(o) \
+  (mcdb_thread_refresh(&(o)->delta) && mcdb_thread_refresh(&(o)->base))
+
+/* shard set: n mcdb (shards) with keys routed to shard by high bits of khash,
+ * listed in manifest mcdb (MCDB_HDR_SHARDSET), so that set scales past limits
+ * of a single mcdb and shards can be built in parallel (see mcdb_makefn.h).
+ * Each shard is a normal mcdb (e.g. 'mcdbctl dump' of shard).
+ * mcdb_shardset_findtagstart() sets m->map to shard of key and starts lookup;
+ * lookup continues with mcdb_findtagnext(m, ...) on shard.
+ * mcdb_shardset_refresh() checks manifest and, if replaced, opens all shards
+ * of new manifest before replacing shards of set (all or none), so lookups
+ * never mix shards of different builds.  (not thread-safe, as with
+ * mcdb_mmap_refresh(); lookups must not run concurrently with refresh) */
+struct mcdb_shardset {
+  struct mcdb_mmap *manifest;
+  struct mcdb_mmap **shards;
+  uint32_t n;                  /* num shards */
+  uint32_t dlen;               /* len of dir prefix of fname */
+  char *fname;                 /* manifest (shard fnames relative to dir) */
+  void * (*fn_malloc)(size_t); /* fn ptr to malloc() */
+  void (*fn_free)(void *);     /* fn ptr to free() */
+};
+
+__attribute_hot__
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_shardset_findtagstart(struct mcdb_shardset * restrict,
+                           struct mcdb * restrict,
+                           const char * restrict, size_t, unsigned char);
+
+#define mcdb_shardset_findstart(s,m,key,klen) \
+  mcdb_shardset_findtagstart((s),(m),(key),(klen),0)
+#define mcdb_shardset_find(s,m,key,klen) \
+  (__builtin_expect((mcdb_shardset_findstart((s),(m),(key),(klen))), 1) \
+                  && mcdb_findnext((m),(key),(klen)))
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_shardset_open(struct mcdb_shardset * restrict, const char * restrict,
+                   void * (*)(size_t), void (*)(void *));
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_shardset_refresh(struct mcdb_shardset * restrict);
+
+EXPORT extern void
+mcdb_shardset_close(struct mcdb_shardset * restrict);
+
 __attribute_malloc__
 __attribute_nonnull_x__((3,4,5))
 __attribute_warn_unused_result__
@@ -175,7 +391,10 @@ mcdb_mmap_destroy(struct mcdb_mmap * restrict);
   (__builtin_expect(!mcdb_mmap_refresh_check(map), true) \
    || __builtin_expect(mcdb_mmap_reopen(map), true))
 #define mcdb_mmap_refresh_threadsafe(mapptr) \
-  (__builtin_expect(!mcdb_mmap_refresh_check(*(mapptr)), true) \
+  (__builtin_expect(!mcdb_mmap_refresh_check( \
+                      plasma_atomic_load_explicit((mapptr), \
+                                                  memory_order_acquire)), \
+                    true) \
    || __builtin_expect(mcdb_mmap_reopen_threadsafe(mapptr), true))
 
 __attribute_nonnull__
@@ -184,11 +403,38 @@ __attribute_warn_unused_result__
 EXPORT extern bool
 mcdb_mmap_init(struct mcdb_mmap * restrict, int);
 
+/* parse and validate mcdb header of map->ptr, map->size already set by caller
+ * (called by mcdb_mmap_init(); might be called directly for mcdb in memory) */
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_mmap_init_header(struct mcdb_mmap * restrict);
+
+/* set hash_init and hash_fn for hash id; returns false if id is not known */
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_hash_lookup(uint32_t, uint32_t * restrict,
+                 uint32_t (** restrict)(uint32_t, const void * restrict,size_t));
+
 __attribute_nonnull__
 __attribute_nothrow__
 EXPORT extern void
 mcdb_mmap_prefault(const struct mcdb_mmap * restrict);
 
+/* lock filter section (MCDB_HDR_FILTER) of mcdb in memory with mlock(),
+ * so that lookups of keys not in mcdb do not page fault even if the rest of
+ * the mcdb is paged out.  Returns true if locked, or if mcdb has no filter.
+ * (applies to current map; mcdb_mmap_refresh() creates new map, so caller
+ *  should call again after refresh)  (mlock() limits apply; RLIMIT_MEMLOCK) */
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_warn_unused_result__
+EXPORT extern bool
+mcdb_mmap_filter_mlock(const struct mcdb_mmap * restrict);
+
 EXPORT extern void
 mcdb_mmap_free(struct mcdb_mmap * restrict);
 
@@ -205,10 +451,39 @@ EXPORT extern bool
 mcdb_mmap_refresh_check(const struct mcdb_mmap * restrict);
 
 
+/* change notification for mcdb_mmap_refresh_check() (optional)
+ * By default, mcdb_mmap_refresh_check() stat()s the mmap file on every call.
+ * mcdb_mmap_watch() configures map to instead stat() mmap file at most once
+ * per interval_ms milliseconds, or to detect updates with a memory load:
+ * - MCDB_WATCH_GENERATION: mmap generation number in sidecar file <fname>.gen
+ *   (see mcdb_makefn_gencreate()), incremented each time mcdb is rebuilt
+ *   (exact; detects multiple updates within the same second, unlike mtime)
+ * - MCDB_WATCH_INOTIFY (Linux, threaded programs): notification by a watcher
+ *   thread (inotify) when the mmap file is replaced
+ * MCDB_WATCH_GENERATION is used if both are set and sidecar file exists.
+ * interval_ms is used if neither is available or if notification becomes
+ * unavailable (e.g. in child after fork()).  Call after mcdb_mmap_create()
+ * and before other threads use map.  The watch is shared by newer maps from
+ * mcdb_mmap_reopen_threadsafe() and is released by mcdb_mmap_destroy().
+ * Note: inotify watches the directory containing the mmap file; changes to
+ * the target of a symlink in a different directory are not detected.
+ * Note: generation sidecar file must be modified in place, not replaced. */
+enum mcdb_watch_flags {
+  MCDB_WATCH_INTERVAL = 0,
+  MCDB_WATCH_INOTIFY = 1,
+  MCDB_WATCH_GENERATION = 2
+};
+
+__attribute_nonnull__
+EXPORT extern bool
+mcdb_mmap_watch(struct mcdb_mmap * restrict, unsigned int, int);
+
+
 enum mcdb_flags {
   MCDB_REGISTER_USE_DECR = 0,
   MCDB_REGISTER_USE_INCR = 1,
-  MCDB_REGISTER_ALREADY_LOCKED = 2
+  MCDB_REGISTER_ALREADY_LOCKED = 2, /* deprecated; accepted and ignored */
+  MCDB_REGISTER_MOVE = 4     /* move registration held by *mapptr to newest */
 };
 
 __attribute_nonnull__
@@ -228,13 +503,18 @@ mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** restrict);
 #define mcdb_thread_refresh(mcdb) \
   mcdb_mmap_refresh_threadsafe(&(mcdb)->map)
 #define mcdb_thread_refresh_self(mcdb) \
-  (__builtin_expect((mcdb)->map->next == NULL, true) \
-   || __builtin_expect(mcdb_thread_register(mcdb) != NULL, true))
+  (__builtin_expect(plasma_atomic_load_explicit(&(mcdb)->map->next, \
+                                               memory_order_acquire) == NULL, \
+                    true) \
+   || __builtin_expect(mcdb_mmap_thread_registration(&(mcdb)->map, \
+                         MCDB_REGISTER_USE_INCR|MCDB_REGISTER_MOVE) != NULL, \
+                       true))
 
 
 #define MCDB_SLOT_BITS 8                  /* 2^8 = 256 */
 #define MCDB_SLOTS (1u<<MCDB_SLOT_BITS)   /* must be power-of-2 */
 #define MCDB_SLOT_MASK (MCDB_SLOTS-1)     /* bitmask */
+#define MCDB_SLOT_BITS_MAX 20             /* 2^20 slots; 16 MB slot directory */
 #define MCDB_HEADER_SZ (MCDB_SLOTS<<4)    /* MCDB_SLOTS * 16  (256*16=4096) */
 #define MCDB_MMAP_SZ (1u<<19)             /* 512KB; must be >  MCDB_HEADER_SZ */
 #define MCDB_BLOCK_SZ (1u<<22)            /*   4MB; must be >= MCDB_MMAP_SZ */
@@ -242,6 +522,264 @@ mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** restrict);
 #define MCDB_PAD_ALIGN 16
 #define MCDB_PAD_MASK (MCDB_PAD_ALIGN-1)
 
+/* mcdb file format v2
+ *
+ * v1 (original mcdb) format begins with slot directory (MCDB_HEADER_SZ bytes),
+ * followed by key/data records, padding, and per-slot open hash tables.
+ * v2 format begins with self-describing header (MCDB_HDR_SZ bytes),
+ * followed by key/data records, padding, per-slot open hash tables,
+ * and then slot directory (same format as v1 slot directory).
+ * The first byte of v1 is 0 (high byte of 64-bit offset of first hash table)
+ * and the first byte of v2 magic is 0x89, so v1 and v2 are distinguishable.
+ * mcdb_make_finish() creates v1 unless a v2 feature is used (feature flags,
+ * slot bits other than MCDB_SLOT_BITS, or a hash func or seed other than djb
+ * default), so that readers which predate v2 can read mcdb without features.
+ * (mcdb_make_start() reserves MCDB_HEADER_SZ bytes for either, so data
+ *  section of v2 created by mcdb_make begins at offset MCDB_HEADER_SZ)
+ *
+ * v2 header (integers are big-endian):
+ *   [0]  magic[8]  MCDB_HDR_MAGIC
+ *   [8]  uint32_t  format version (2)
+ *   [12] uint32_t  feature flags (enum mcdb_hdr_flags); unknown flags rejected
+ *   [16] uint32_t  hash id (enum mcdb_hash_id)
+ *   [20] uint32_t  hash seed (hash init value)
+ *   [24] uint32_t  slot bits (log2 of num slots in slot directory) (8 - 20)
+ *   [28] uint32_t  hash table stride bits (3, 4, or 5 (MCDB_HDR_INLINE))
+ *                  (4 if MCDB_HDR_WIDE)
+ *   [32] uint64_t  offset of slot directory
+ *   [40] uint64_t  offset of start of data section
+ *   [48] uint64_t  offset of end of data section (before padding)
+ *   [56] uint64_t  num records
+ *   [64] uint64_t  offset of filter section (MCDB_HDR_FILTER; else 0)
+ *   [72] uint64_t  size of filter section   (MCDB_HDR_FILTER; else 0)
+ *   [80]           (reserved; 0-filled)
+ *
+ * Slot directory has (1 << slot bits) 16-byte entries (MCDB_SLOTS in v1).
+ * Slot of khash is mcdb_slot_index(khash, slot bits), and home entry of khash
+ * in per-slot open hash table is mcdb_slot_home(), which reduces the khash bits
+ * above slot bits to the table size by modulo, by bitmask (MCDB_HDR_POW2;
+ * tables sizes are powers of 2), or by multiply-shift (MCDB_HDR_MULSHIFT).
+ *
+ * Per-slot index is a linearly probed open hash table, unless feature flags
+ * specify an alternative layout.  (hslots and the 4 bytes following hslots in
+ * slot directory entry are interpreted per layout; 0-filled if unused)
+ *
+ * MCDB_HDR_MPH: minimal perfect hash (MPH) index (PTHash-style) per slot
+ *   slot dir entry: hpos, MPH table size (msz), num overflow entries (novf)
+ *   at hpos: nb = (msz+3)/4 16-bit big-endian pilots (padded to 16 bytes),
+ *            msz hash table entries (same format as open hash table entries;
+ *                                    entry with dpos 0 is empty),
+ *            overflow open hash table with (novf*2) entries
+ *   Key with khash is in entry mcdb_mph_pos(khash, pilot, msz) where pilot
+ *   is pilots[mcdb_mph_bucket(khash, nb)], or else is in overflow table.
+ *   Overflow table contains keys with khash duplicating khash of another key
+ *   (duplicate keys or hash collisions), so mcdb_findtagnext() on unique-key
+ *   mcdb (e.g. created by mcdbctl uniq) is (almost always) a single probe.
+ *
+ * MCDB_HDR_ROBINHOOD: open hash tables are Robin Hood ordered
+ *   Entries along a probe sequence are ordered by displacement from home
+ *   entry ((khash >> 8) % hslots), and then by record position (order added),
+ *   so a lookup can stop at first entry with displacement less than that of
+ *   the probe.  (layout is otherwise identical to linearly probed table)
+ *
+ * MCDB_HDR_BUCKET: open hash tables of 64-byte (cache line) buckets (b == 3)
+ *   hslots is num entries (8 entries per bucket); tables are 64-byte aligned
+ *   bucket: 8 32-bit big-endian khash, followed by 8 32-bit big-endian dpos
+ *   Home bucket is ((khash >> 8) % (hslots / 8)).  Entries are placed in the
+ *   first empty entry (dpos == 0) in bucket, or else in subsequent buckets,
+ *   so all khash in a bucket can be compared at once (SIMD).
+ *
+ * MCDB_HDR_INLINE: small records are copied into 32-byte hash table entries
+ *   (b == 5) (with linearly probed or Robin Hood ordered open hash tables)
+ *   entry: 32-bit big-endian khash, 32-bit big-endian dpos, followed by
+ *          copy of record (8-byte record header, key, data) if key and data
+ *          total <= MCDB_INLINE_MAX bytes, or else by 32-bit klen ~0
+ *   Data section contains all records, including those copied into entries,
+ *   so that mcdb_iter() is unchanged.  A lookup of a small record reads only
+ *   the hash table entry, saving a dependent cache miss.
+ *
+ * MCDB_HDR_FILTER: filter section follows slot directory (at offset aligned
+ *   to MCDB_FILTER_ALIGN, so that it can be mapped or mlock()ed separately)
+ *   split block Bloom filter of 32-byte blocks (filter size / 32 blocks);
+ *   key with khash sets 8 bits (one in each 32-bit word) of a single block,
+ *   (see mcdb_filter_block() and mcdb_filter_bit()), so lookup of most keys
+ *   not in mcdb is rejected after reading a single cache line.
+ *
+ * MCDB_HDR_DELTA: delta mcdb of changes to a base mcdb (see mcdb_overlay)
+ *   data of each record is followed by op byte: MCDB_DELTA_UPSERT ('+')
+ *   (record is a value of key) or MCDB_DELTA_TOMBSTONE ('-') (key deleted;
+ *   data is empty).  Records of key in delta replace all records of key in
+ *   base mcdb.  (layout of mcdb is otherwise unchanged)
+ *
+ * MCDB_HDR_WIDE: 64-bit hash of key; 16-byte hash table entries (b == 4)
+ *   entry: 32-bit big-endian khash, 32-bit big-endian key fingerprint,
+ *          64-bit big-endian dpos (klen is read from record)
+ *   khash (hash func of mcdb) places key (slot, home entry, filter) as in
+ *   other layouts, and fingerprint is uint32_hash_wy() of key with seed
+ *   ~(hash seed), so that a record is compared with key only if 64 bits of
+ *   hash match.  Num records is not limited to INT_MAX.  (not with
+ *   MCDB_HDR_BUCKET or MCDB_HDR_INLINE, which have 32-bit entries)
+ *
+ * MCDB_HDR_SHARDSET: manifest of shard set (see mcdb_shardset)
+ *   record with key "n" has num shards (decimal), and record with key i
+ *   (decimal) has file name of shard i (in directory of manifest).  Shards
+ *   are mcdb with the same hash func, and key with khash is in shard
+ *   mcdb_shard_index(khash, n).
+ */
+#define MCDB_HDR_SZ 128
+#define MCDB_HDR_MAGIC "\211mcdb\r\n\032"
+#define MCDB_HDR_MAGIC_SZ 8
+#define MCDB_HDR_VERSION 2
+
+enum mcdb_hdr_flags {
+  MCDB_HDR_MPH         = 0x1, /* minimal perfect hash index (see above) */
+  MCDB_HDR_ROBINHOOD   = 0x2, /* Robin Hood ordered open hash tables */
+  MCDB_HDR_BUCKET      = 0x4, /* cache line bucketized open hash tables */
+  MCDB_HDR_LAYOUT      = MCDB_HDR_MPH | MCDB_HDR_ROBINHOOD | MCDB_HDR_BUCKET,
+                              /* (at most one layout flag may be set) */
+  MCDB_HDR_INLINE      = 0x8, /* small records inlined in hash table entries*/
+  MCDB_HDR_FILTER      = 0x10,/* filter section for fast negative lookups */
+  MCDB_HDR_POW2        = 0x20,/* table sizes power of 2; home by bitmask */
+  MCDB_HDR_MULSHIFT    = 0x40,/* home by multiply-shift range reduction */
+  MCDB_HDR_REDUCE      = MCDB_HDR_POW2 | MCDB_HDR_MULSHIFT,
+                              /* (at most one reduce flag may be set) */
+  MCDB_HDR_DELTA       = 0x80,/* delta mcdb; op byte follows data of recs */
+  MCDB_HDR_SHARDSET    = 0x100,/* manifest of shard set (see above) */
+  MCDB_HDR_WIDE        = 0x200,/* 64-bit hash; khash and fingerprint */
+  MCDB_HDR_FLAGS_KNOWN = MCDB_HDR_LAYOUT | MCDB_HDR_INLINE | MCDB_HDR_FILTER
+                       | MCDB_HDR_REDUCE | MCDB_HDR_DELTA | MCDB_HDR_SHARDSET
+                       | MCDB_HDR_WIDE
+};
+
+#define MCDB_DELTA_UPSERT    '+'
+#define MCDB_DELTA_TOMBSTONE '-'
+
+
+/* (internal) slot directory index of khash for slot bits sb (see above)
+ * (low 8 bits of khash select group of 1 << (sb - 8) consecutive slots, so
+ *  that v1 and mcdb with 8 slot bits have slot (khash & MCDB_SLOT_MASK)) */
+__attribute_pure__
+static inline uint32_t
+mcdb_slot_index(const uint32_t khash, const uint32_t sb);
+
+static inline uint32_t
+mcdb_slot_index(const uint32_t khash, const uint32_t sb)
+{
+    return ((khash & MCDB_SLOT_MASK) << (sb - MCDB_SLOT_BITS))
+         | ((khash >> MCDB_SLOT_BITS) & ((1u << (sb - MCDB_SLOT_BITS)) - 1));
+}
+
+/* (internal) home entry (or bucket) of khash in table of n entries (buckets)
+ * (flags & MCDB_HDR_REDUCE select reduction; n is power of 2 if POW2)
+ * (multiply-shift first multiplies by odd constant (Fibonacci hashing) since
+ *  high bits of khash from some hash funcs (djb) are poorly distributed) */
+__attribute_pure__
+static inline uint32_t
+mcdb_slot_home(const uint32_t khash, const uint32_t n, const uint32_t sb,
+               const uint32_t flags);
+
+static inline uint32_t
+mcdb_slot_home(const uint32_t khash, const uint32_t n, const uint32_t sb,
+               const uint32_t flags)
+{
+    const uint32_t x = khash >> sb;
+    return (flags & MCDB_HDR_POW2)
+      ? x & (n - 1)
+      : (flags & MCDB_HDR_MULSHIFT)
+      ? (uint32_t)(((uint64_t)(uint32_t)(x * 0x9E3779B1u) * n) >> 32)
+      : x % n;
+}
+
+#define MCDB_INLINE_MAX 16  /* max key + data len of record inlined in entry */
+
+/* (internal) MPH index hash functions (shared by mcdb.c and mcdb_make.c)
+ * (multiply-shift range reduction; khash low bits (slot) are same in slot) */
+#define MCDB_MPH_PILOT_MAX 0xFFFFu
+
+__attribute_pure__
+static inline uint32_t
+mcdb_mph_bucket(const uint32_t khash, const uint32_t nb);
+
+static inline uint32_t
+mcdb_mph_bucket(const uint32_t khash, const uint32_t nb)
+{
+    return (uint32_t)(((uint64_t)(uint32_t)(khash * 0x9E3779B1u) * nb) >> 32);
+}
+
+__attribute_pure__
+static inline uint32_t
+mcdb_mph_pos(const uint32_t khash, const uint32_t pilot, const uint32_t msz);
+
+static inline uint32_t
+mcdb_mph_pos(const uint32_t khash, const uint32_t pilot, const uint32_t msz)
+{
+    uint64_t x = (((uint64_t)khash << 32) | pilot);
+    x *= UINT64_C(0x9E3779B97F4A7C15);
+    x ^= x >> 32;
+    x *= UINT64_C(0xD6E8FEB86659FD93);
+    x ^= x >> 32;
+    return (uint32_t)(((x & 0xFFFFFFFFu) * msz) >> 32);
+}
+
+/* (internal) shard of khash in shard set of n shards (shared by mcdb.c and
+ * mcdb_makefn.c) (high bits of khash mixed by murmur3 fmix32, so that shard
+ * is not correlated with multiply-shift of khash in MPH or filter in shard) */
+#define MCDB_SHARDS_MAX 4096
+
+__attribute_pure__
+static inline uint32_t
+mcdb_shard_index(uint32_t khash, const uint32_t n);
+
+static inline uint32_t
+mcdb_shard_index(uint32_t khash, const uint32_t n)
+{
+    khash ^= khash >> 16;
+    khash *= 0x85EBCA6Bu;
+    khash ^= khash >> 13;
+    khash *= 0xC2B2AE35u;
+    khash ^= khash >> 16;
+    return (uint32_t)(((uint64_t)khash * n) >> 32);
+}
+
+/* (internal) filter hash functions (shared by mcdb.c and mcdb_make.c)
+ * (split block Bloom filter; 16 keys per 256-bit block is ~16 bits per key
+ *  and false positive rate ~0.3% (or less)) */
+#define MCDB_FILTER_ALIGN 4096
+#define MCDB_FILTER_KEYS_PER_BLOCK 16
+
+__attribute_pure__
+static inline uint32_t
+mcdb_filter_block(const uint32_t khash, const uint32_t nb);
+
+static inline uint32_t
+mcdb_filter_block(const uint32_t khash, const uint32_t nb)
+{
+    const uint64_t x = (uint64_t)khash * UINT64_C(0x9E3779B97F4A7C15);
+    return (uint32_t)(((x >> 32) * nb) >> 32);
+}
+
+/* bit (0-255) of filter block for khash in 32-bit word i (0-7) of block */
+__attribute_pure__
+static inline uint32_t
+mcdb_filter_bit(const uint32_t khash, const uint32_t i);
+
+static inline uint32_t
+mcdb_filter_bit(const uint32_t khash, const uint32_t i)
+{
+    static const uint32_t salt[8] = {
+      0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+      0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u
+    };
+    return (i << 5) | ((khash * salt[i]) >> 27);
+}
+
+enum mcdb_hash_id {
+  MCDB_HASH_CUSTOM = 0,  /* caller-provided hash func (or v1 mcdb; see NOTES) */
+  MCDB_HASH_DJB    = 1,  /* uint32_hash_djb() */
+  MCDB_HASH_CRC32C = 2,  /* uint32_hash_crc32c() */
+  MCDB_HASH_WY     = 3   /* uint32_hash_wy() */
+};
+
 
 /* alias symbols with hidden visibility for use in DSO linking static mcdb.o
  * (Reference: "How to Write Shared Libraries", by Ulrich Drepper)
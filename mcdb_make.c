@@ -22,6 +22,9 @@
  * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
  */
 
+#ifndef _GNU_SOURCE /* enable sync_file_range() on GNU systems */
+#define _GNU_SOURCE 1
+#endif
 #ifndef _POSIX_C_SOURCE
 #define _POSIX_C_SOURCE 200112L
 #endif
@@ -50,14 +53,22 @@
 #include "uint32.h"
 #include "plasma/plasma_stdtypes.h"
 #include "plasma/plasma_sysconf.h"
+#ifdef _THREAD_SAFE
+#include "plasma/plasma_atomic.h"
+#include <pthread.h>
+#endif
 
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>   /* posix_fallocate() */
+#include <stdlib.h>  /* qsort() */
 #include <string.h>  /* memcpy() */
 #include <limits.h>  /* UINT_MAX, INT_MAX */
+#ifdef __linux__
+#include <sys/vfs.h> /* fstatfs() */
+#endif
 
 #ifdef _AIX
 #ifndef MAP_ANONYMOUS
@@ -82,12 +93,86 @@ extern int madvise(caddr_t, size_t, int);
 #define POSIX_MADV_DONTNEED    4
 #endif
 
+/* large mmap windows (m->sizehint != 0) (see mcdb_mmap_upsize())
+ * windows are aligned for transparent hugepages if output is memory-backed,
+ * else written-back asynchronously every MCDB_WRITEBACK_SZ (where supported)*/
+#define MCDB_HUGEPAGE_SZ    (1u<<21)  /*   2 MB */
+#define MCDB_WRITEBACK_SZ   (1u<<25)  /*  32 MB */
+#define MCDB_MMAP_WINDOW_MAX (1u<<28) /* 256 MB max window in 32-bit */
+#define MCDB_TMPFS_MAGIC    0x01021994
+#if defined(MADV_POPULATE_WRITE) || !defined(MAP_POPULATE)
+#define MCDB_MAP_POPULATE   0
+#else
+#define MCDB_MAP_POPULATE   MAP_POPULATE
+#endif
+
 #define MCDB_HPLIST 250
 
+/* hplist entries are struct mcdb_hp packed into 8 bytes:
+ * upper 24 bits of hash (lower MCDB_SLOT_BITS of hash are the hplist index)
+ * and 40-bit record position (data section limited to 1 TB).
+ * klen is not kept; klen is needed only for hash tables with 16-byte entries
+ * (data section >= 4 GB), and is then read from record in data section. */
+#define MCDB_HP_POS_BITS 40
+#define MCDB_HP_POS_MAX  ((uint64_t)1 << MCDB_HP_POS_BITS)
+
 struct mcdb_hplist {
-  uint32_t num;  /* index into struct mcdb_hp hp[MCDB_HPLIST] */
+  uint32_t num;  /* index into uint64_t hp[MCDB_HPLIST] (packed mcdb_hp) */
   struct mcdb_hplist *next;
   struct mcdb_hplist *pend;
+  uint64_t hp[MCDB_HPLIST];
+};
+
+/* sub-builder record buffer: records added from beginning of data[] and
+ * hashes (uint32_t) of keys from end of data[] */
+#define MCDB_SUB_BLOCK_SZ (1u << 20)
+
+struct mcdb_sub_block {
+  struct mcdb_sub_block *next;
+  size_t pos;    /* end of records in data[] */
+  size_t hpos;   /* start of hashes in data[] */
+  size_t sz;     /* size of data[] */
+  char data[];
+};
+
+struct mcdb_make_sub {
+  struct mcdb_make_sub *next;
+  const struct mcdb_make *m;
+  struct mcdb_sub_block *head;
+  struct mcdb_sub_block *tail;
+};
+
+/* hplists spilled to temporary file when m->membudget would be exceeded
+ * Each spill writes a run for each hplist: run header {offset+1 of prior run
+ * of hplist (0 if none), num blocks}, followed by full hp[MCDB_HPLIST] blocks
+ * (oldest first).  Runs are read back newest first, and blocks in each run
+ * read back newest first, i.e. in the same order as in-memory hplist chain. */
+#define MCDB_SPILL_BLOCKS 64  /* blocks per read/write buffer (128 KB) */
+#define MCDB_SPILL_BLKSZ  (MCDB_HPLIST * sizeof(uint64_t))
+
+struct mcdb_spill {
+  int fd;
+  int err;                    /* errno of error reading spill file */
+  uint64_t pos;               /* end of spill file */
+  uint64_t last[MCDB_SLOTS];  /* offset+1 of last run of each hplist */
+  char buf[MCDB_SPILL_BLOCKS * MCDB_SPILL_BLKSZ]; /* write buffer */
+};
+
+/* iterate over blocks of struct mcdb_hp of hplist (in-memory, then spilled)
+ * (packed entries of each block are unpacked into hp[]) */
+struct mcdb_hpiter {
+  const struct mcdb_hplist *x;/* next in-memory hplist */
+  struct mcdb_spill *spill;
+  uint64_t run;               /* offset+1 of next run header to read */
+  uint64_t base;              /* offset of first block in current run */
+  uint64_t nblk;              /* blocks in current run not yet read */
+  uint32_t nbuf;              /* blocks in buf not yet returned */
+  uint32_t i;                 /* hplist index (lower bits of hash) */
+  uint64_t *buf;              /* read buffer (MCDB_SPILL_BLOCKS blocks) */
+  const char *kmap;           /* data section from which to read klen */
+  uint32_t wide;              /* MCDB_HDR_WIDE: fingerprint instead of klen */
+  uint32_t kfpseed;           /* seed of key fingerprint (MCDB_HDR_WIDE) */
+  void (*fn_free)(void *);
   struct mcdb_hp hp[MCDB_HPLIST];
 };
 
@@ -103,6 +188,110 @@ mcdb_make_err(struct mcdb_make * const restrict m, int errnum)
     return -1;
 }
 
+__attribute_noinline__
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static int
+mcdb_spill_open(struct mcdb_make * const restrict m);
+
+static int
+mcdb_spill_open(struct mcdb_make * const restrict m)
+{
+    /* create (and unlink) temporary file in $TMPDIR (default /tmp) */
+    static const char tmpl[] = "/mcdb.spill.XXXXXX";
+    const char *dir = getenv("TMPDIR");
+    size_t len;
+    char *fn;
+    int fd;
+    if (dir == NULL || *dir == '\0')
+        dir = "/tmp";
+    len = strlen(dir);
+    if ((fn = m->fn_malloc(len + sizeof(tmpl))) == NULL)
+        return -1;
+    memcpy(fn, dir, len);
+    memcpy(fn+len, tmpl, sizeof(tmpl));
+    if ((fd = mkstemp(fn)) != -1)
+        unlink(fn);
+    m->fn_free(fn);
+    return fd;
+}
+
+/* write full blocks of each hplist to spill file and reuse hplists in memory
+ * (partially filled hplist at head of each chain remains in memory) */
+__attribute_noinline__
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_hplist_spill(struct mcdb_make * const restrict m);
+
+static bool
+mcdb_hplist_spill(struct mcdb_make * const restrict m)
+{
+    struct mcdb_spill * restrict spill = m->spill;
+    struct mcdb_hplist *x;
+    struct mcdb_hplist *n;
+    struct mcdb_hplist *r;
+    struct mcdb_hplist *head;
+    uint64_t k;
+    size_t wpos;
+    if (spill == NULL) {
+        spill = (struct mcdb_spill *)m->fn_malloc(sizeof(struct mcdb_spill));
+        if (spill == NULL)
+            return false;
+        if ((spill->fd = mcdb_spill_open(m)) == -1) {
+            m->fn_free(spill);
+            return false;
+        }
+        spill->err = 0;
+        spill->pos = 0;
+        memset(spill->last, 0, sizeof(spill->last));
+        m->spill = spill;
+    }
+
+    for (uint32_t i = 0; i < MCDB_SLOTS; ++i) {
+        head = m->head[i];
+        x = (head->num != MCDB_HPLIST) ? head->next : head;
+        if (x == NULL)
+            continue;
+        /* reverse chain of full hplists (write oldest first) */
+        for (r = NULL, k = 0; x != NULL; x = n, ++k) {
+            n = x->next;
+            x->next = r;
+            r = x;
+        }
+        /* run header and blocks */
+        memcpy(spill->buf, spill->last+i, sizeof(uint64_t));
+        memcpy(spill->buf+sizeof(uint64_t), &k, sizeof(uint64_t));
+        spill->last[i] = spill->pos + 1;
+        spill->pos += 2*sizeof(uint64_t) + k*MCDB_SPILL_BLKSZ;
+        wpos = 2*sizeof(uint64_t);
+        for (x = r; x != NULL; x = x->next) {
+            if (wpos + MCDB_SPILL_BLKSZ > sizeof(spill->buf)) {
+                if (nointr_write(spill->fd, spill->buf, wpos) == -1)
+                    return false;
+                wpos = 0;
+            }
+            memcpy(spill->buf+wpos, x->hp, MCDB_SPILL_BLKSZ);
+            wpos += MCDB_SPILL_BLKSZ;
+        }
+        if (nointr_write(spill->fd, spill->buf, wpos) == -1)
+            return false;
+        /* move spilled hplists to list of pending (empty) hplists */
+        for (x = r; x != NULL; x = n) {
+            n = x->next;
+            x->num  = 0;
+            x->next = NULL;
+            if (x != head) {
+                x->pend = head->pend;
+                head->pend = x;
+            }
+        }
+        head->next = NULL;
+    }
+    return true;
+}
+
+/* (mcdb_hplist_alloc() might spill; see mcdb_hplist_spill()) */
 __attribute_noinline__
 __attribute_nonnull__
 __attribute_warn_unused_result__
@@ -120,13 +309,19 @@ mcdb_hplist_alloc(struct mcdb_make * const restrict m)
         m->head[i] = pend;
         return true;
     }
+    else if (m->membudget != 0
+             && m->membudget < m->hpmem+sizeof(struct mcdb_hplist)*MCDB_SLOTS){
+        return mcdb_hplist_spill(m);
+    }
     else {
-        uint32_t cnt;
+        uint64_t cnt;
+        uint32_t max;
         const uint32_t * const count = m->count;
         struct mcdb_hplist * const restrict hplist = (struct mcdb_hplist *)
           m->fn_malloc(sizeof(struct mcdb_hplist) * MCDB_SLOTS);
         if (!hplist) return false;
-        for (cnt = 0, i = 0; i < MCDB_SLOTS; ++i) {
+        m->hpmem += sizeof(struct mcdb_hplist) * MCDB_SLOTS;
+        for (cnt = 0, max = 0, i = 0; i < MCDB_SLOTS; ++i) {
             hplist[i].num  = 0;
             hplist[i].pend = NULL;
             if (m->head[i]->num != MCDB_HPLIST) {
@@ -139,13 +334,162 @@ mcdb_hplist_alloc(struct mcdb_make * const restrict m)
                 m->head[i] = hplist+i;
             }
             cnt += count[i];
+            if (max < count[i])
+                max = count[i];
         }
         /* detect if we have already passed 2 gibibyte records
-         * (not exact, but ok; will abort in mcdb_make_finish() if > INT_MAX) */
-        return (cnt < INT_MAX) ? true : (errno = ENOMEM, false);
+         * (not exact, but ok; will abort in mcdb_make_finish() if > INT_MAX)
+         * (MCDB_HDR_WIDE: limit instead records per hplist, so that num hash
+         *  table entries of each slot (2 per record) fits in 32-bit hslots) */
+        return ((m->flags & MCDB_HDR_WIDE) ? max < (1u << 30) : cnt < INT_MAX)
+          ? true
+          : (errno = ENOMEM, false);
+    }
+}
+
+__attribute_nonnull_x__((1,2))
+static void
+mcdb_hpiter_init(struct mcdb_hpiter * const restrict it,
+                 const struct mcdb_make * const restrict m, const uint32_t i,
+                 const char * const kmap);
+
+static void
+mcdb_hpiter_init(struct mcdb_hpiter * const restrict it,
+                 const struct mcdb_make * const restrict m, const uint32_t i,
+                 const char * const kmap)
+{
+    it->x     = m->head[i];
+    it->i     = i;
+    it->kmap  = kmap;
+    it->wide  = (m->flags & MCDB_HDR_WIDE);
+    it->kfpseed = ~m->hash_init;
+    it->spill = m->spill;
+    it->run   = (m->spill != NULL) ? m->spill->last[i] : 0;
+    it->nblk  = 0;
+    it->nbuf  = 0;
+    it->buf   = NULL;
+    it->fn_free = m->fn_free;
+    if (it->run != 0) {
+        it->buf = (uint64_t *)
+          m->fn_malloc(MCDB_SPILL_BLOCKS * MCDB_SPILL_BLKSZ);
+        if (it->buf == NULL) {
+            it->run = 0;
+            it->spill->err = ENOMEM;
+        }
     }
 }
 
+__attribute_nonnull__
+static void
+mcdb_hpiter_fini(struct mcdb_hpiter * const restrict it);
+
+static void
+mcdb_hpiter_fini(struct mcdb_hpiter * const restrict it)
+{
+    if (it->buf != NULL)
+        it->fn_free(it->buf);
+}
+
+/* read from spill file (sets spill->err upon error) */
+__attribute_noinline__
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_spill_read(struct mcdb_spill * const restrict spill,
+                void * const restrict buf, const size_t sz, const uint64_t pos);
+
+static bool
+mcdb_spill_read(struct mcdb_spill * const restrict spill,
+                void * const restrict buf, const size_t sz, const uint64_t pos)
+{
+    ssize_t r;
+    size_t n = 0;
+    while (n < sz) {
+        retry_eintr_do_while(
+          (r = pread(spill->fd, (char *)buf+n, sz-n, (off_t)(pos+n))),
+          (r == -1));
+        if (r <= 0) {
+            spill->err = (r == 0) ? EIO : errno;
+            return false;
+        }
+        n += (size_t)r;
+    }
+    return true;
+}
+
+/* next block of packed entries spilled to file */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static const uint64_t *
+mcdb_hpiter_spilled(struct mcdb_hpiter * const restrict it);
+
+static const uint64_t *
+mcdb_hpiter_spilled(struct mcdb_hpiter * const restrict it)
+{
+    uint64_t hdr[2];
+    uint32_t k;
+    if (it->nbuf == 0) {
+        while (it->nblk == 0) {
+            if (it->run == 0
+                || !mcdb_spill_read(it->spill, hdr, sizeof(hdr), it->run-1))
+                return NULL;
+            it->base = it->run - 1 + sizeof(hdr);
+            it->run  = hdr[0];
+            it->nblk = hdr[1];
+        }
+        k = (it->nblk < MCDB_SPILL_BLOCKS)
+          ? (uint32_t)it->nblk
+          : MCDB_SPILL_BLOCKS;
+        it->nblk -= k;
+        if (!mcdb_spill_read(it->spill, it->buf, k * MCDB_SPILL_BLKSZ,
+                             it->base + it->nblk * MCDB_SPILL_BLKSZ))
+            return NULL;
+        it->nbuf = k;
+    }
+    return it->buf + (size_t)(--it->nbuf) * MCDB_HPLIST;
+}
+
+/* next block of struct mcdb_hp of hplist (*n set to num in block)
+ * (returns NULL at end, or upon error reading spill file) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static const struct mcdb_hp *
+mcdb_hpiter_next(struct mcdb_hpiter * const restrict it,
+                 uint32_t * const restrict n);
+
+static const struct mcdb_hp *
+mcdb_hpiter_next(struct mcdb_hpiter * const restrict it,
+                 uint32_t * const restrict n)
+{
+    uint32_t k;
+    const uint64_t * restrict x;
+    if (it->x != NULL) {
+        x = it->x->hp;
+        *n = k = it->x->num;
+        it->x = it->x->next;
+    }
+    else {
+        if ((x = mcdb_hpiter_spilled(it)) == NULL)
+            return NULL;
+        *n = k = MCDB_HPLIST;
+    }
+    /* unpack entries */
+    for (uint32_t u = 0; u < k; ++u) {
+        it->hp[u].p = (uintptr_t)(x[u] & (MCDB_HP_POS_MAX-1));
+        it->hp[u].h = (uint32_t)(x[u] >> MCDB_HP_POS_BITS) << MCDB_SLOT_BITS
+                    | it->i;
+        it->hp[u].l = (it->kmap != NULL)
+          ? uint32_strunpack_bigendian_macro(it->kmap + it->hp[u].p)
+          : 0;
+        if (it->wide && it->kmap != NULL) /* key fingerprint (see mcdb.h) */
+            it->hp[u].l = uint32_hash_wy(it->kfpseed,
+                                         it->kmap + it->hp[u].p + 8,
+                                         it->hp[u].l);
+    }
+    return it->hp;
+}
+
+
 #if !defined(__GLIBC__)
 /* emulate posix_fallocate() with statvfs() and pwrite(); all POSIX.1-2001 std*/
 /* (_XOPEN_SOURCE 600 (posix_fallocate), _XOPEN_SOURCE 500 (pwrite)) */
@@ -223,15 +567,15 @@ __attribute_nonnull__
 __attribute_warn_unused_result__
 static bool  inline
 mcdb_mmap_commit(struct mcdb_make * const restrict m,
-                 char header[MCDB_HEADER_SZ]);
+                 const char * const restrict header, const size_t hsz);
 
 static bool  inline
 mcdb_mmap_commit(struct mcdb_make * const restrict m,
-                 char header[MCDB_HEADER_SZ])
+                 const char * const restrict header, const size_t hsz)
 {
     if (m->fd == -1) { /*(m->fd == -1 during large mcdb size tests)*/
         if (m->offset == 0)
-            memcpy(m->map, header, MCDB_HEADER_SZ);
+            memcpy(m->map, header, hsz);
         return true;
     }
 
@@ -243,7 +587,7 @@ mcdb_mmap_commit(struct mcdb_make * const restrict m,
                 (0== m->pos - m->offset ||/*(avoid 0-sized msync; portability)*/
                  0== msync(m->map, m->pos - m->offset, MS_ASYNC))
             && -1 != lseek(m->fd, 0, SEEK_SET)
-            && -1 != nointr_write(m->fd, header, MCDB_HEADER_SZ));
+            && -1 != nointr_write(m->fd, header, hsz));
     /* Most (all?) modern UNIX use a unified VM page cache, so the difference
      * between writing to mmap and then write() to fd should have identical
      * (and coherent) results.  Calling msync with MS_SYNC can be as expensive
@@ -255,6 +599,46 @@ mcdb_mmap_commit(struct mcdb_make * const restrict m,
      * OS crashes, then the updated mcdb can be corrupted. */
 }
 
+/* output is memory-backed (on tmpfs, or anonymous mmap if m->fd == -1) */
+__attribute_nonnull__
+static bool
+mcdb_mmap_memfs(const struct mcdb_make * const restrict m);
+
+static bool
+mcdb_mmap_memfs(const struct mcdb_make * const restrict m)
+{
+  #ifdef __linux__
+    struct statfs stfs;
+    return (m->fd == -1
+            || (fstatfs(m->fd, &stfs) == 0
+                && (unsigned long)stfs.f_type == MCDB_TMPFS_MAGIC));
+  #else
+    return (m->fd == -1);
+  #endif
+}
+
+/* start async write-back of records written to mmap since last write-back
+ * (bounds dirty pages accumulated in large mmap windows of output on disk) */
+__attribute_noinline__
+__attribute_nonnull__
+static void
+mcdb_make_writeback(struct mcdb_make * const restrict m);
+
+__attribute_noinline__
+static void
+mcdb_make_writeback(struct mcdb_make * const restrict m)
+{
+  #ifdef SYNC_FILE_RANGE_WRITE
+    const size_t pos = m->wbnext - MCDB_WRITEBACK_SZ;
+    if (0 != sync_file_range(m->fd, (off_t)pos, (off_t)(m->pos - pos),
+                             SYNC_FILE_RANGE_WRITE)) {
+        m->wbnext = SIZE_MAX; /* (not supported; do not retry) */
+        return;
+    }
+  #endif
+    m->wbnext = m->pos + MCDB_WRITEBACK_SZ;
+}
+
 __attribute_noinline__
 __attribute_nonnull__
 __attribute_warn_unused_result__
@@ -267,7 +651,10 @@ static bool
 mcdb_mmap_upsize(struct mcdb_make * const restrict m, const size_t sz,
                  const bool sequential)
 {
-    const size_t offset = m->pos & m->pgalign; /* mmap offset must be aligned */
+    /* mmap offset must be aligned (large windows aligned for hugepages) */
+    const size_t offset = m->pos & m->pgalign
+      & (m->sizehint != 0 ? ~(size_t)(MCDB_HUGEPAGE_SZ-1) : ~(size_t)0);
+    const bool memfs = (m->sizehint != 0 && mcdb_mmap_memfs(m));
     size_t msz;
 
     /*(caller should check size and not call upsize unless resize needed)*/
@@ -281,6 +668,18 @@ mcdb_mmap_upsize(struct mcdb_make * const restrict m, const size_t sz,
     msz = (MCDB_MMAP_SZ > sz - offset)
       ? MCDB_MMAP_SZ
       : (sz - offset + ~m->pgalign) & m->pgalign;
+    if (m->sizehint != 0) {
+        /* large window to projected size of mcdb (file is fallocated below),
+         * and grow geometrically if mcdb exceeds projected size */
+        size_t w = (m->sizehint > sz) ? m->sizehint - offset : offset >> 1;
+        w = (w + (MCDB_BLOCK_SZ-1)) & ~(size_t)(MCDB_BLOCK_SZ-1);
+      #if !defined(_LP64) && !defined(__LP64__)  /* (limited address space) */
+        if (w > MCDB_MMAP_WINDOW_MAX)
+            w = MCDB_MMAP_WINDOW_MAX;
+      #endif
+        if (msz < w)
+            msz = w;
+    }
   #if !defined(_LP64) && !defined(__LP64__)  /* (no 4 GB limit in 64-bit) */
     if (offset > (UINT_MAX & m->pgalign) - msz)
         msz = (UINT_MAX & m->pgalign) - offset;
@@ -332,11 +731,29 @@ mcdb_mmap_upsize(struct mcdb_make * const restrict m, const size_t sz,
 
     /* (compilation with large file support enables off_t max > 2 GB in cast) */
     m->map = (m->fd != -1) /* (m->fd == -1 during some large mcdb size tests) */
-      ? (char *)mmap(0, msz, PROT_WRITE, MAP_SHARED, m->fd, (off_t)offset)
-      : (char *)mmap(0, msz, PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+      ? (char *)mmap(0, msz, PROT_WRITE,
+                     MAP_SHARED | (memfs ? MCDB_MAP_POPULATE : 0),
+                     m->fd, (off_t)offset)
+      : (char *)mmap(0, msz, PROT_WRITE,
+                     MAP_PRIVATE|MAP_ANONYMOUS|(memfs ? MCDB_MAP_POPULATE : 0),
+                     -1, 0);
     if (m->map == MAP_FAILED) return false;
     m->offset = offset;
     m->msz = msz;
+    if (memfs) {
+        /* prefault entire window (in hugepages, if enabled for tmpfs mount)
+         * instead of page faults on each 4 KB page written */
+      #ifdef MADV_HUGEPAGE
+        (void)madvise(m->map, msz, MADV_HUGEPAGE);
+      #endif
+      #ifdef MADV_POPULATE_WRITE
+        (void)madvise(m->map, msz, MADV_POPULATE_WRITE);
+      #endif
+    }
+  #ifdef SYNC_FILE_RANGE_WRITE
+    else if (m->sizehint != 0 && m->fd != -1 && m->wbnext == SIZE_MAX)
+        m->wbnext = m->pos + MCDB_WRITEBACK_SZ; /* async write-back to disk */
+  #endif
     if (sequential)
         posix_madvise(m->map, msz, POSIX_MADV_SEQUENTIAL);
     return true;
@@ -352,12 +769,15 @@ mcdb_make_addbegin(struct mcdb_make * const restrict m,
     const size_t len = 8 + keylen + datalen;/* arbitrary ~2 GB limit for lens */
     if (m->map == MAP_FAILED && m->fd != -1)  return mcdb_make_err(NULL,EPERM);
     if (m->hp.l== ~0 && !mcdb_hplist_alloc(m))return mcdb_make_err(NULL,errno);
+    if (pos >= m->wbnext) mcdb_make_writeback(m);
     m->hp.p = pos;
     m->hp.h = m->hash_init;
     if (keylen>INT_MAX-8 || datalen>INT_MAX-8)return mcdb_make_err(NULL,EINVAL);
     m->hp.l = (uint32_t)keylen;
   #if !defined(_LP64) && !defined(__LP64__)  /* (no 4 GB limit in 64-bit) */
     if (pos > UINT_MAX-len)                   return mcdb_make_err(NULL,ENOMEM);
+  #else  /* (1 TB limit on data section; see MCDB_HP_POS_BITS) */
+    if (pos+len > MCDB_HP_POS_MAX)            return mcdb_make_err(NULL,EFBIG);
   #endif
     if (m->offset+m->msz < pos+len && !mcdb_mmap_upsize(m, pos+len, true))
                                               return mcdb_make_err(NULL,errno);
@@ -384,24 +804,502 @@ mcdb_make_addbuf_key(struct mcdb_make * const restrict m,
 {
     /* len validated in mcdb_make_addbegin(); passing any other len is wrong,
      * unless the len is shorter from partial contents of buf. */
-    m->hp.h = (m->hash_fn == uint32_hash_djb)
-      ? uint32_hash_djb(m->hp.h, buf, len)
-      : m->hash_fn(m->hp.h, buf, len);
+    if (m->hash_fn == uint32_hash_djb)
+        m->hp.h = uint32_hash_djb(m->hp.h, buf, len);
+    else if (m->hash_fn != uint32_hash_wy) /*(wy not chainable; see addend)*/
+        m->hp.h = m->hash_fn(m->hp.h, buf, len);
     mcdb_make_addbuf_data(m, buf, len);
 }
 
-void  inline
-mcdb_make_addend(struct mcdb_make * const restrict m)
+__attribute_nonnull__
+static inline void
+mcdb_make_addhp(struct mcdb_make * const restrict m);
+
+static inline void
+mcdb_make_addhp(struct mcdb_make * const restrict m)
 {
-    /* copy hp data structure into list for hp slot mask */
+    /* copy hp data structure (packed) into list for hp slot mask */
     const uint32_t slot_idx = m->hp.h & MCDB_SLOT_MASK;
     const uint32_t i = m->head[slot_idx]->num++;
-    m->head[slot_idx]->hp[i] = m->hp;
+    m->head[slot_idx]->hp[i] =
+      ((uint64_t)(m->hp.h >> MCDB_SLOT_BITS) << MCDB_HP_POS_BITS)
+      | (uint64_t)m->hp.p;
     ++m->count[slot_idx];
     if (i == MCDB_HPLIST-1)
         m->hp.l = ~0; /* set flag for mcdb_make_start() to allocate lists */
 }
 
+void  inline
+mcdb_make_addend(struct mcdb_make * const restrict m)
+{
+    if (m->hash_fn == uint32_hash_wy)/*hash entire key (key added in pieces)*/
+        m->hp.h = uint32_hash_wy(m->hash_init,   /*(record is within mmap)*/
+                                 m->map + m->hp.p + 8 - m->offset, m->hp.l);
+    mcdb_make_addhp(m);
+}
+
+char *
+mcdb_make_addreserve(struct mcdb_make * const restrict m, const size_t sz)
+{
+    /* reserve space for sz bytes of records to be written directly to mmap
+     * (e.g. by multiple threads), and add hash of each with mcdb_make_addhash()
+     * (records must be written in mcdb format: klen, dlen (4-byte big-endian),
+     *  key, data; pointer returned is valid until next mcdb_make_*() call
+     *  other than mcdb_make_addhash()) */
+    const size_t pos = m->pos;
+    if (m->map == MAP_FAILED && m->fd != -1)
+        return (mcdb_make_err(NULL,EPERM), NULL);
+    if (pos >= m->wbnext) mcdb_make_writeback(m);
+  #if !defined(_LP64) && !defined(__LP64__)  /* (no 4 GB limit in 64-bit) */
+    if (pos > UINT_MAX-sz)
+        return (mcdb_make_err(NULL,ENOMEM), NULL);
+  #else  /* (1 TB limit on data section; see MCDB_HP_POS_BITS) */
+    if (sz > MCDB_HP_POS_MAX - pos)
+        return (mcdb_make_err(NULL,EFBIG), NULL);
+  #endif
+    if (m->offset+m->msz < pos+sz && !mcdb_mmap_upsize(m, pos+sz, true))
+        return (mcdb_make_err(NULL,errno), NULL);
+    m->pos += sz;
+    return m->map + pos - m->offset;
+}
+
+int
+mcdb_make_addhash(struct mcdb_make * const restrict m, const size_t pos,
+                  const size_t keylen, const uint32_t h)
+{
+    /* add hash h of key of record at pos (written into mcdb_make_addreserve())
+     * (h is hash of entire key: m->hash_fn(m->hash_init, key, keylen)) */
+    if (m->hp.l== ~0 && !mcdb_hplist_alloc(m))return mcdb_make_err(NULL,errno);
+    if (keylen > INT_MAX-8 || pos >= MCDB_HP_POS_MAX)
+                                              return mcdb_make_err(NULL,EINVAL);
+    m->hp.p = pos;
+    m->hp.h = h;
+    m->hp.l = (uint32_t)keylen;
+    mcdb_make_addhp(m);
+    return 0;
+}
+
+/* Records of an existing mcdb are copied into mcdb being made (e.g. to merge
+ * an existing mcdb with a set of changes) in contiguous runs of the data
+ * section, rather than record by record.  Hashes of keys are taken from the
+ * index of the existing mcdb if it uses the same hash function (else keys are
+ * hashed).  Hash table entries of the existing mcdb are gathered per hplist
+ * (entries of each hplist are in 1 << (slot bits - 8) consecutive slots) and
+ * sorted by record position, so that records with the same hash are added to
+ * each hplist in the same order as records in the data section. */
+
+#define MCDB_COPY_SZ (1u<<26)  /* 64 MB max copied per mcdb_make_addreserve() */
+
+/* gather (non-empty) hash table entries of slots [s, s+nslots) of mcdb
+ * (returns num entries gathered into hp[]) */
+__attribute_nonnull__
+static size_t
+mcdb_make_copy_gather(const struct mcdb_mmap * const restrict map,
+                      const uint32_t s, const uint32_t nslots,
+                      struct mcdb_hp * const restrict hp);
+
+static size_t
+mcdb_make_copy_gather(const struct mcdb_mmap * const restrict map,
+                      const uint32_t s, const uint32_t nslots,
+                      struct mcdb_hp * const restrict hp)
+{
+    const unsigned char * const restrict ptr = map->ptr;
+    const uint32_t b = map->b;
+    size_t n = 0;
+    for (uint32_t u = s; u < s + nslots; ++u) {
+        const unsigned char * const restrict dirent =
+          map->dir + ((uintptr_t)u << 4);
+        const unsigned char *p =
+          ptr + uint64_strunpack_bigendian_aligned_macro(dirent);
+        uint32_t len = uint32_strunpack_bigendian_aligned_macro(dirent+8);
+        uint32_t j;
+        if (map->flags & MCDB_HDR_BUCKET) { /* 8 khash, then 8 dpos per bucket*/
+            for (j = 0; j < len; ++j) {
+                const unsigned char * const q = p + ((j >> 3) << 6)
+                                                  + ((j & 7) << 2);
+                hp[n].p = uint32_strunpack_bigendian_aligned_macro(q+32);
+                hp[n].h = uint32_strunpack_bigendian_aligned_macro(q);
+                n += (hp[n].p != 0);
+            }
+            continue;
+        }
+        if (map->flags & MCDB_HDR_MPH) { /* skip pilots; table, then overflow*/
+            p += ((((uintptr_t)(len+3) >> 2) << 1) + MCDB_PAD_MASK)
+               & ~(uintptr_t)MCDB_PAD_MASK;
+            len += uint32_strunpack_bigendian_aligned_macro(dirent+12) << 1;
+        }
+        for (j = 0; j < len; ++j, p += (1u << b)) {
+            hp[n].p = (b == 4)
+              ? (uintptr_t)uint64_strunpack_bigendian_aligned_macro(p+8)
+              : uint32_strunpack_bigendian_aligned_macro(p+4);
+            hp[n].h = uint32_strunpack_bigendian_aligned_macro(p);
+            n += (hp[n].p != 0);
+        }
+    }
+    return n;
+}
+
+/* sort hp[] by record position (LSD radix sort of bits positions, 11 bits
+ * each pass) using tmp[] (same size); returns hp or tmp, whichever is sorted */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static struct mcdb_hp *
+mcdb_make_copy_sort(struct mcdb_hp * restrict hp, struct mcdb_hp * restrict tmp,
+                    const size_t n, const uint32_t bits);
+
+static struct mcdb_hp *
+mcdb_make_copy_sort(struct mcdb_hp * restrict hp, struct mcdb_hp * restrict tmp,
+                    const size_t n, const uint32_t bits)
+{
+    size_t cnt[2048];
+    size_t i, t, c;
+    for (uint32_t sh = 0; sh < bits; sh += 11) {
+        struct mcdb_hp * const restrict x = tmp;
+        memset(cnt, 0, sizeof(cnt));
+        for (i = 0; i < n; ++i)
+            ++cnt[(hp[i].p >> sh) & 2047];
+        for (i = 0, t = 0; i < 2048; ++i) {
+            c = cnt[i];
+            cnt[i] = t;
+            t += c;
+        }
+        for (i = 0; i < n; ++i)
+            x[cnt[(hp[i].p >> sh) & 2047]++] = hp[i];
+        tmp = hp;
+        hp = x;
+    }
+    return hp;
+}
+
+/* add hashes of keys of copied records from index of existing mcdb
+ * (skipped records are not in new mcdb; drop[] has sizes of skipped before) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_make_copy_index(struct mcdb_make * const restrict m,
+                     const struct mcdb_mmap * const restrict map,
+                     const uintptr_t * const restrict skip, const size_t nskip,
+                     const uintptr_t * const restrict drop,
+                     const uintptr_t base, const uintptr_t eod);
+
+static bool
+mcdb_make_copy_index(struct mcdb_make * const restrict m,
+                     const struct mcdb_mmap * const restrict map,
+                     const uintptr_t * const restrict skip, const size_t nskip,
+                     const uintptr_t * const restrict drop,
+                     const uintptr_t base, const uintptr_t eod)
+{
+    const uint32_t k = map->slot_bits - MCDB_SLOT_BITS;
+    const uint32_t bits = 64 - (uint32_t)__builtin_clzll(eod);
+    struct mcdb_hp *hp;
+    const struct mcdb_hp *sorted;
+    uintptr_t x;
+    size_t n = 0;
+    size_t t;
+    size_t u;
+    size_t v;
+    uint32_t i;
+    uint32_t s;
+
+    /* max num of entries in tables of slots of any hplist */
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        for (s = i << k, t = 0; s < ((i+1) << k); ++s) {
+            const unsigned char * const dirent = map->dir + ((uintptr_t)s << 4);
+            t += uint32_strunpack_bigendian_aligned_macro(dirent+8);
+            if (map->flags & MCDB_HDR_MPH)
+                t += (size_t)
+                  uint32_strunpack_bigendian_aligned_macro(dirent+12) << 1;
+        }
+        if (n < t)
+            n = t;
+    }
+    hp = (struct mcdb_hp *)m->fn_malloc((n << 1) * sizeof(struct mcdb_hp));
+    if (hp == NULL)
+        return false;
+
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        t = mcdb_make_copy_gather(map, i << k, 1u << k, hp);
+        sorted = mcdb_make_copy_sort(hp, hp + n, t, bits);
+        for (u = 0, v = 0; u < t; ++u) {
+            x = sorted[u].p;
+            while (v < nskip && skip[v] < x)
+                ++v;
+            if (v < nskip && skip[v] == x)
+                continue;
+            if (x < map->data || x >= eod || eod - x < 8) {
+                errno = EINVAL;
+                break;
+            }
+            if (mcdb_make_addhash(m, base + (x - map->data) - drop[v],
+                                  uint32_strunpack_bigendian_macro(map->ptr+x),
+                                  sorted[u].h) != 0)
+                break;
+        }
+        if (u != t)
+            break;
+    }
+
+    m->fn_free(hp);
+    return (i == MCDB_SLOTS);
+}
+
+/* add hashes of keys of copied records, hashing keys (different hash func) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_make_copy_rehash(struct mcdb_make * const restrict m,
+                      const struct mcdb_mmap * const restrict map,
+                      const uintptr_t * const restrict skip, const size_t nskip,
+                      const uintptr_t * const restrict drop,
+                      const uintptr_t base, const uintptr_t eod);
+
+static bool
+mcdb_make_copy_rehash(struct mcdb_make * const restrict m,
+                      const struct mcdb_mmap * const restrict map,
+                      const uintptr_t * const restrict skip, const size_t nskip,
+                      const uintptr_t * const restrict drop,
+                      const uintptr_t base, const uintptr_t eod)
+{
+    const unsigned char * const restrict ptr = map->ptr;
+    uintptr_t x;
+    uint32_t klen;
+    size_t v = 0;
+    for (x = map->data; x < eod; x += 8 + (uintptr_t)klen
+                                       + uint32_strunpack_bigendian_macro(ptr+x+4)) {
+        klen = uint32_strunpack_bigendian_macro(ptr+x);
+        if (v < nskip && skip[v] == x)
+            ++v;
+        else if (mcdb_make_addhash(m, base + (x - map->data) - drop[v], klen,
+                                   m->hash_fn(m->hash_init,
+                                              (const char *)ptr+x+8, klen)) != 0)
+            return false;
+    }
+    return true;
+}
+
+int
+mcdb_make_addmcdb(struct mcdb_make * const restrict m,
+                  const struct mcdb_mmap * const restrict map,
+                  const uintptr_t * const restrict skip, const size_t nskip)
+{
+    /* add records of existing mcdb (slots validated by caller), except records
+     * at positions skip[] (start of record; sorted ascending, unique) */
+    const unsigned char * const restrict ptr = map->ptr;
+    const uintptr_t base = m->pos;
+    uintptr_t *drop;   /* bytes of skipped records before skip[u] */
+    uintptr_t eod = map->eod;
+    uintptr_t x;
+    uintptr_t e;
+    size_t sz;
+    size_t u;
+    uint32_t klen;
+    char *q = NULL;
+    bool rc;
+
+    if (map->version == 1) { /* (v1 eod is start of hash tables, incl padding)*/
+        for (x = map->data; eod - x >= 8; x += 8 + (uintptr_t)klen
+               + uint32_strunpack_bigendian_macro(ptr+x+4)) {
+            if ((klen = uint32_strunpack_bigendian_macro(ptr+x)) == ~0u)
+                break;
+        }
+        eod = x;
+    }
+
+    drop = (uintptr_t *)m->fn_malloc((nskip + 1) * sizeof(uintptr_t));
+    if (drop == NULL)
+        return mcdb_make_err(NULL,errno);
+
+    /* copy runs of records between skipped records */
+    drop[0] = 0;
+    for (u = 0, x = map->data; ; ++u) {
+        e = (u < nskip) ? skip[u] : eod;
+        if (e < x || e > eod || (u < nskip && eod - e < 8)) {
+            errno = EINVAL;
+            break;
+        }
+        for (; x < e; x += sz) {
+            sz = (e - x < MCDB_COPY_SZ) ? e - x : MCDB_COPY_SZ;
+            if ((q = mcdb_make_addreserve(m, sz)) == NULL)
+                break;
+            memcpy(q, ptr+x, sz);
+        }
+        if (x != e || u == nskip)
+            break;
+        x = e + 8 + (uintptr_t)uint32_strunpack_bigendian_macro(ptr+e)
+                  + (uintptr_t)uint32_strunpack_bigendian_macro(ptr+e+4);
+        drop[u+1] = drop[u] + (x - e);
+    }
+
+    rc = (u == nskip && x == eod)
+      && ((m->hash_fn == map->hash_fn
+           || (m->hash_id == map->hash_id && m->hash_id != MCDB_HASH_CUSTOM))
+          && m->hash_init == map->hash_init
+            ? mcdb_make_copy_index(m, map, skip, nskip, drop, base, eod)
+            : mcdb_make_copy_rehash(m, map, skip, nskip, drop, base, eod));
+
+    m->fn_free(drop);
+    return rc ? 0 : mcdb_make_err(NULL,errno);
+}
+
+/* Sub-builders (one per producer thread) each buffer records and hashes of
+ * keys in memory, and are merged into mcdb (in order created) by
+ * mcdb_make_finish().  Only creation of sub-builders modifies struct mcdb_make
+ * (atomic push onto list of sub-builders) so producers do not contend. */
+
+struct mcdb_make_sub *
+mcdb_make_sub_start(struct mcdb_make * const restrict m)
+{
+    struct mcdb_make_sub * const restrict sub = (struct mcdb_make_sub *)
+      m->fn_malloc(sizeof(struct mcdb_make_sub));
+    if (sub == NULL)
+        return (mcdb_make_err(NULL,ENOMEM), NULL);
+    sub->m    = m;
+    sub->head = NULL;
+    sub->tail = NULL;
+  #ifdef _THREAD_SAFE
+    do {
+        sub->next = plasma_atomic_ld_nopt(&m->sub);
+    } while (!plasma_atomic_CAS_ptr(&m->sub, sub->next, sub));
+  #else
+    sub->next = m->sub;
+    m->sub = sub;
+  #endif
+    return sub;
+}
+
+__attribute_noinline__
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_make_sub_alloc(struct mcdb_make_sub * const restrict sub, size_t sz);
+
+static bool
+mcdb_make_sub_alloc(struct mcdb_make_sub * const restrict sub, size_t sz)
+{
+    struct mcdb_sub_block * restrict b;
+    sz = (sz < MCDB_SUB_BLOCK_SZ) ? MCDB_SUB_BLOCK_SZ : (sz + 7) & ~(size_t)7;
+    b = (struct mcdb_sub_block *)
+      sub->m->fn_malloc(sizeof(struct mcdb_sub_block) + sz);
+    if (b == NULL)
+        return false;
+    b->next = NULL;
+    b->pos  = 0;
+    b->hpos = sz;
+    b->sz   = sz;
+    if (sub->tail != NULL)
+        sub->tail->next = b;
+    else
+        sub->head = b;
+    sub->tail = b;
+    return true;
+}
+
+int
+mcdb_make_sub_add(struct mcdb_make_sub * const restrict sub,
+                  const char * const restrict key, const size_t keylen,
+                  const char * const restrict data, const size_t datalen)
+{
+    struct mcdb_sub_block * restrict b = sub->tail;
+    const struct mcdb_make * const restrict m = sub->m;
+    const size_t len = 8 + keylen + datalen;/* arbitrary ~2 GB limit for lens */
+    char * restrict p;
+    if (keylen>INT_MAX-8 || datalen>INT_MAX-8)return mcdb_make_err(NULL,EINVAL);
+    if (b == NULL || b->hpos - b->pos < len + 4) {
+        if (!mcdb_make_sub_alloc(sub, len + 4))
+                                              return mcdb_make_err(NULL,ENOMEM);
+        b = sub->tail;
+    }
+    p = b->data + b->pos;
+    uint32_strpack_bigendian_macro(p,keylen);
+    uint32_strpack_bigendian_macro(p+4,datalen);
+    memcpy(p+8, key, keylen);
+    memcpy(p+8+keylen, data, datalen);
+    b->pos  += len;
+    b->hpos -= 4;
+    *(uint32_t *)(b->data + b->hpos) = (m->hash_fn == uint32_hash_djb)
+      ? uint32_hash_djb(m->hash_init, key, keylen)
+      : m->hash_fn(m->hash_init, key, keylen);
+    return 0;
+}
+
+/* free sub-builders (in list at m->sub) */
+__attribute_nonnull__
+static void
+mcdb_make_sub_free(struct mcdb_make * const restrict m);
+
+static void
+mcdb_make_sub_free(struct mcdb_make * const restrict m)
+{
+    struct mcdb_make_sub *sub;
+    struct mcdb_sub_block *b;
+    while ((sub = m->sub) != NULL) {
+        m->sub = sub->next;
+        while ((b = sub->head) != NULL) {
+            sub->head = b->next;
+            m->fn_free(b);
+        }
+        m->fn_free(sub);
+    }
+}
+
+/* copy records from sub-builders into mcdb and add hashes; free sub-builders*/
+__attribute_noinline__
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_make_sub_merge(struct mcdb_make * const restrict m);
+
+static bool
+mcdb_make_sub_merge(struct mcdb_make * const restrict m)
+{
+    struct mcdb_make_sub *sub = m->sub;
+    struct mcdb_make_sub *n;
+    struct mcdb_sub_block *b;
+    size_t pos = m->pos;
+    size_t sz = 0;
+    char *out;
+
+    /* reverse list of sub-builders to merge in order created */
+    for (m->sub = NULL; sub != NULL; sub = n) {
+        n = sub->next;
+        sub->next = m->sub;
+        m->sub = sub;
+        for (b = sub->head; b != NULL; b = b->next)
+            sz += b->pos;
+    }
+
+    if ((out = mcdb_make_addreserve(m, sz)) == NULL) {
+        mcdb_make_sub_free(m);
+        return false;
+    }
+
+    /* (free each block after copying; mcdb_make_sub_free() frees the rest) */
+    for (sub = m->sub; sub != NULL; sub = sub->next) {
+        while ((b = sub->head) != NULL) {
+            const uint32_t * restrict h = (uint32_t *)(b->data + b->sz);
+            const char * restrict p = b->data;
+            const char * const e = b->data + b->pos;
+            memcpy(out, p, b->pos);
+            out += b->pos;
+            while (p != e) {
+                const uint32_t klen = uint32_strunpack_bigendian_macro(p);
+                const uint32_t dlen = uint32_strunpack_bigendian_macro(p+4);
+                if (mcdb_make_addhash(m, pos, klen, *--h) != 0) {
+                    mcdb_make_sub_free(m);
+                    return false;
+                }
+                pos += 8 + klen + dlen;
+                p   += 8 + klen + dlen;
+            }
+            sub->head = b->next;
+            m->fn_free(b);
+        }
+    }
+
+    mcdb_make_sub_free(m);
+    return true;
+}
+
 void  inline
 mcdb_make_addrevert(struct mcdb_make * const restrict m)
 {   /* e.g. discard in-progress incremental addbuf, or immediately prior add */
@@ -422,6 +1320,103 @@ mcdb_make_add(struct mcdb_make * const restrict m,
     return -1;
 }
 
+/* add record with h hash of key (m->hash_fn(m->hash_init, key, keylen)) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static int
+mcdb_make_add_khash(struct mcdb_make * const restrict m,
+                    const char * const restrict key, const size_t keylen,
+                    const char * const restrict data, const size_t datalen,
+                    const uint32_t h);
+
+static int
+mcdb_make_add_khash(struct mcdb_make * const restrict m,
+                    const char * const restrict key, const size_t keylen,
+                    const char * const restrict data, const size_t datalen,
+                    const uint32_t h)
+{
+    if (mcdb_make_addbegin(m, keylen, datalen) == 0) {
+        mcdb_make_addbuf_data(m, key, keylen);  /* (key not hashed) */
+        mcdb_make_addbuf_data(m, data, datalen);
+        m->hp.h = h;
+        mcdb_make_addhp(m);
+        return 0;
+    }
+    return -1;
+}
+
+int
+mcdb_make_add_hashed(struct mcdb_make * const restrict m,
+                     const char * const restrict key, const size_t keylen,
+                     const char * const restrict data, const size_t datalen,
+                     const struct mcdb_khash * const restrict kh)
+{
+    return (kh->hash_fn == m->hash_fn && kh->hash_init == m->hash_init)
+      ? mcdb_make_add_khash(m, key, keylen, data, datalen, kh->khash)
+      : mcdb_make_add(m, key, keylen, data, datalen);
+}
+
+/* (num of keys hashed at once (multi-buffer) by mcdb_make_add_batch()) */
+#define MCDB_MAKE_BATCH 16
+
+int
+mcdb_make_add_batch(struct mcdb_make * const restrict m, const size_t n,
+                    const char * const * const restrict keys,
+                    const size_t * const restrict keylens,
+                    const char * const * const restrict data,
+                    const size_t * const restrict datalens)
+{
+    /* djb: hash keys of MCDB_MAKE_BATCH records at once in SIMD lanes
+     * (see uint32_hash_djb_multi()); other hash funcs: mcdb_make_add() */
+    uint32_t h[MCDB_MAKE_BATCH];
+    size_t i;
+    size_t j;
+    size_t w;
+    if (m->hash_fn != uint32_hash_djb) {
+        for (i = 0; i < n; ++i) {
+            if (mcdb_make_add(m, keys[i], keylens[i], data[i], datalens[i]))
+                return -1;
+        }
+        return 0;
+    }
+    for (i = 0; i < n; i += w) {
+        w = (n - i < MCDB_MAKE_BATCH) ? n - i : MCDB_MAKE_BATCH;
+        uint32_hash_djb_multi(m->hash_init, keys+i, keylens+i, w, h);
+        for (j = 0; j < w; ++j) {
+            if (mcdb_make_add_khash(m, keys[i+j], keylens[i+j],
+                                    data[i+j], datalens[i+j], h[j]))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int
+mcdb_make_delta_add(struct mcdb_make * const restrict m,
+                    const char * const restrict key, const size_t keylen,
+                    const char * const restrict data, const size_t datalen)
+{
+    static const char op = MCDB_DELTA_UPSERT;
+    if (datalen >= INT_MAX-8)  /* (op byte follows data) */
+        return mcdb_make_err(NULL, EINVAL);
+    if (mcdb_make_addbegin(m, keylen, datalen+1) == 0) {
+        mcdb_make_addbuf_key(m, key, keylen);
+        mcdb_make_addbuf_data(m, data, datalen);
+        mcdb_make_addbuf_data(m, &op, 1);
+        mcdb_make_addend(m);
+        return 0;
+    }
+    return -1;
+}
+
+int
+mcdb_make_delta_del(struct mcdb_make * const restrict m,
+                    const char * const restrict key, const size_t keylen)
+{
+    static const char op = MCDB_DELTA_TOMBSTONE;
+    return mcdb_make_add(m, key, keylen, &op, 1);
+}
+
 /* Note: it is recommended that fd be the fd returned from a call to mkstemp()
  * and that the temporary file be renamed (by the caller) upon success */
 int
@@ -429,10 +1424,20 @@ mcdb_make_start(struct mcdb_make * const restrict m, const int fd,
                 void * (*fn_malloc)(size_t), void (*fn_free)(void *))
 {
     m->map       = MAP_FAILED;
-    m->pos       = MCDB_HEADER_SZ;
+    m->pos       = MCDB_HEADER_SZ;  /*(v1 slot directory or v2 header)*/
     m->offset    = 0;
     m->hash_init = UINT32_HASH_DJB_INIT;
+    m->hash_id   = MCDB_HASH_DJB;
     m->hash_fn   = uint32_hash_djb;
+    m->flags     = 0;
+    m->slot_bits = MCDB_SLOT_BITS;
+    m->nthreads  = 1;
+    m->sub       = NULL;
+    m->membudget = 0;
+    m->hpmem     = sizeof(struct mcdb_hplist) * MCDB_SLOTS;
+    m->spill     = NULL;
+    m->sizehint  = 0;
+    m->wbnext    = SIZE_MAX;
     m->fsz       = 0;
     m->osz       = 0;
     m->msz       = 0;
@@ -447,6 +1452,8 @@ mcdb_make_start(struct mcdb_make * const restrict m, const int fd,
                    fn_malloc(sizeof(struct mcdb_hplist) * MCDB_SLOTS);
     memset(m->count, 0, MCDB_SLOTS * sizeof(uint32_t));
     /* do not modify m->fname, m->fntmp, m->st_mode; may already have been set*/
+    /* (caller may set m->flags, m->slot_bits, m->nthreads, m->membudget,
+     *  m->sizehint, custom hash after mcdb_make_start()) */
     /* (defer mcdb_mmap_upsize() if fd==-1 to allow caller to set custom map) */
     if (m->head[0] != NULL
         && (fd == -1 || mcdb_mmap_upsize(m, MCDB_MMAP_SZ, true))) {
@@ -464,6 +1471,650 @@ mcdb_make_start(struct mcdb_make * const restrict m, const int fd,
     }
 }
 
+/* smallest power of 2 >= n (0 < n <= 2^31) */
+__attribute_pure__
+static inline uint32_t
+mcdb_make_pow2(const uint32_t n);
+
+static inline uint32_t
+mcdb_make_pow2(const uint32_t n)
+{
+    return (n > 1) ? 1u << (32 - __builtin_clz(n - 1)) : 1u;
+}
+
+/* write hash table entry for hp (see layout of entries in mcdb_make_finish())*/
+__attribute_nonnull__
+static inline void
+mcdb_make_entry(char * const restrict q,
+                const struct mcdb_hp * const restrict hp, const uint32_t b);
+
+static inline void
+mcdb_make_entry(char * const restrict q,
+                const struct mcdb_hp * const restrict hp, const uint32_t b)
+{
+    uint32_strpack_bigendian_aligned_macro(q, hp->h);                /*khash*/
+    if (b != 4)  /*(b == 5 inline record copied in mcdb_make_inline())*/
+        uint32_strpack_bigendian_aligned_macro(q+4, (uint32_t)hp->p); /*dpos*/
+    else {
+        uint32_strpack_bigendian_aligned_macro(q+4, hp->l);            /*klen*/
+        uint64_strpack_bigendian_aligned_macro(q+8, (uint64_t)hp->p); /*dpos*/
+    }
+}
+
+/* insert hp into linearly probed open hash table p with len entries */
+__attribute_nonnull__
+static void
+mcdb_make_probe(const struct mcdb_make * const restrict m,
+                char * const restrict p, const uint32_t len,
+                const struct mcdb_hp * const restrict hp, const uint32_t b);
+
+static void
+mcdb_make_probe(const struct mcdb_make * const restrict m,
+                char * const restrict p, const uint32_t len,
+                const struct mcdb_hp * const restrict hp, const uint32_t b)
+{
+    uint32_t u = mcdb_slot_home(hp->h, len, m->slot_bits, m->flags);
+    /* find empty entry in open hash table (dpos == 0) */
+    while (b != 4 ? *(uint32_t *)(p+((uintptr_t)u<<b)+4) != 0
+                  : *(uint64_t *)(p+((uintptr_t)u<<4)+8) != 0)
+        if (++u == len)
+            u = 0;
+    mcdb_make_entry(p+((uintptr_t)u<<b), hp, b);
+}
+
+/* insert hp into Robin Hood ordered open hash table p with len entries
+ * (entries with smaller displacement from home entry are displaced; entries
+ *  with equal displacement (same home) are ordered by record position) */
+__attribute_nonnull__
+static void
+mcdb_make_probe_rh(const struct mcdb_make * const restrict m,
+                   char * const restrict p, const uint32_t len,
+                   const struct mcdb_hp * const restrict hpin,const uint32_t b);
+
+static void
+mcdb_make_probe_rh(const struct mcdb_make * const restrict m,
+                   char * const restrict p, const uint32_t len,
+                   const struct mcdb_hp * const restrict hpin,const uint32_t b)
+{
+    struct mcdb_hp hp = *hpin;
+    struct mcdb_hp rh;
+    const uint32_t sb = m->slot_bits;
+    uint32_t u = mcdb_slot_home(hp.h, len, sb, m->flags);
+    uint32_t d = 0;  /* displacement of hp */
+    uint32_t rd;     /* displacement of resident entry */
+    char *q;
+    for (;;) {
+        q = p+((uintptr_t)u<<b);
+        rh.p = (b != 4)
+          ? uint32_strunpack_bigendian_aligned_macro(q+4)
+          : uint64_strunpack_bigendian_aligned_macro(q+8);
+        if (rh.p == 0)  /* empty entry (dpos == 0) */
+            break;
+        rh.h = uint32_strunpack_bigendian_aligned_macro(q);
+        rh.l = uint32_strunpack_bigendian_aligned_macro(q+4);/*(klen if b==4)*/
+        rd = mcdb_slot_home(rh.h, len, sb, m->flags);
+        rd = (u >= rd) ? u - rd : u + len - rd;
+        if (rd < d || (rd == d && rh.p > hp.p)) {
+            mcdb_make_entry(q, &hp, b);
+            hp = rh;
+            d  = rd;
+        }
+        ++d;
+        if (++u == len)
+            u = 0;
+    }
+    mcdb_make_entry(q, &hp, b);
+}
+
+/* insert hp into first empty entry in home bucket (or subsequent buckets)
+ * of bucketized open hash table p with nbk 64-byte buckets (see mcdb.h) */
+__attribute_nonnull__
+static void
+mcdb_make_probe_bucket(const struct mcdb_make * const restrict m,
+                       char * const restrict p, const uint32_t nbk,
+                       const struct mcdb_hp * const restrict hp);
+
+static void
+mcdb_make_probe_bucket(const struct mcdb_make * const restrict m,
+                       char * const restrict p, const uint32_t nbk,
+                       const struct mcdb_hp * const restrict hp)
+{
+    uint32_t u = mcdb_slot_home(hp->h, nbk, m->slot_bits, m->flags);
+    uint32_t w;
+    char *q;
+    for (;;) {
+        q = p+((uintptr_t)u<<6);
+        for (w = 0; w < 32; w += 4) {
+            if (*(uint32_t *)(q+32+w) == 0) {  /* empty entry (dpos == 0) */
+                uint32_strpack_bigendian_aligned_macro(q+w, hp->h);   /*khash*/
+                uint32_strpack_bigendian_aligned_macro(q+32+w, (uint32_t)hp->p);
+                return;                                               /*dpos*/
+            }
+        }
+        if (++u == nbk)
+            u = 0;
+    }
+}
+
+/* order by khash, then by record position (order in which records added) */
+__attribute_nonnull__
+__attribute_pure__
+static int
+mcdb_make_hp_cmp(const void * const a, const void * const b);
+
+static int
+mcdb_make_hp_cmp(const void * const a, const void * const b)
+{
+    const struct mcdb_hp * const x = (const struct mcdb_hp *)a;
+    const struct mcdb_hp * const y = (const struct mcdb_hp *)b;
+    return (x->h != y->h)
+      ? (x->h < y->h ? -1 : 1)
+      : (x->p != y->p) ? (x->p < y->p ? -1 : 1) : 0;
+}
+
+/* order buckets by size (descending), then by bucket number */
+__attribute_nonnull__
+__attribute_pure__
+static int
+mcdb_make_u64_cmp(const void * const a, const void * const b);
+
+static int
+mcdb_make_u64_cmp(const void * const a, const void * const b)
+{
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return (x != y) ? (x < y ? -1 : 1) : 0;
+}
+
+/* generate minimal perfect hash (MPH) index for slot (see mcdb.h)
+ * PTHash (Pibiri and Trani, 2021) style construction:  keys are distributed
+ * into buckets (avg 4 keys per bucket) and buckets are processed largest first,
+ * searching for the first pilot value which places all keys in the bucket into
+ * free entries in the table (table size slightly larger than num keys).
+ * Keys with khash duplicating khash of a prior key, and keys in a bucket for
+ * which no pilot is found (unlikely), are placed into an overflow table. */
+__attribute_noinline__
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_make_slot_mph(struct mcdb_make * const restrict m,
+                   const struct mcdb_hp * const restrict hp, const uint32_t n,
+                   const uint32_t b, char * const restrict dirent);
+
+static bool
+mcdb_make_slot_mph(struct mcdb_make * const restrict m,
+                   const struct mcdb_hp * const restrict hp, const uint32_t n,
+                   const uint32_t b, char * const restrict dirent)
+{
+    uint32_t nu, novf, novt, msz, nb, k, j, s, pilot;
+    uintptr_t psz, sz;
+    char *p;
+    struct mcdb_hp * restrict keys;
+    struct mcdb_hp * restrict ovf;
+    uint32_t * restrict tbl;
+    uint32_t * restrict order;
+    uint32_t * restrict bstart;
+    uint32_t * restrict bpos;
+    uint64_t * restrict border;
+    uint16_t * restrict pilots;
+    void * const buf =
+      m->fn_malloc((size_t)n * (2*sizeof(struct mcdb_hp) + 5*sizeof(uint32_t)
+                                + sizeof(uint64_t) + sizeof(uint16_t))
+                   + 3*sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint16_t));
+    if (buf == NULL)
+        return false;
+
+    /* (nb <= n+1; msz <= n + n/16 + 2 <= 2*n+1) */
+    keys   = (struct mcdb_hp *)buf;
+    ovf    = keys + n;
+    border = (uint64_t *)(ovf + n);                       /* nb + 1 */
+    tbl    = (uint32_t *)(border + n + 1);                /* msz (2*n+1) */
+    order  = tbl + 2*n + 1;                               /* n */
+    bstart = order + n;                                   /* nb + 1 */
+    bpos   = bstart + n + 2;                              /* n */
+    pilots = (uint16_t *)(bpos + n);                      /* nb */
+
+    /* sort keys; keys with duplicated khash to overflow */
+    memcpy(keys, hp, n * sizeof(struct mcdb_hp));
+    qsort(keys, n, sizeof(struct mcdb_hp), mcdb_make_hp_cmp);
+    for (nu = 0, novf = 0, k = 0; k < n; ++k) {
+        if (nu != 0 && keys[nu-1].h == keys[k].h)
+            ovf[novf++] = keys[k];
+        else
+            keys[nu++] = keys[k];
+    }
+
+    /* (msz even to keep 16-byte alignment of tables with 8-byte entries) */
+    msz = (nu != 0) ? (nu + (nu >> 4) + 2) & ~1u : 0;
+    nb  = (msz + 3) >> 2;
+
+    /* (counting) sort keys by bucket */
+    memset(bstart, 0, (nb + 1) * sizeof(uint32_t));
+    for (k = 0; k < nu; ++k)
+        ++bstart[mcdb_mph_bucket(keys[k].h, nb)+1];
+    for (j = 0; j < nb; ++j) {
+        bstart[j+1] += bstart[j];
+        border[j] = ((uint64_t)~(bstart[j+1] - bstart[j]) << 32) | j;
+    }
+    for (k = 0; k < nu; ++k)
+        order[bstart[mcdb_mph_bucket(keys[k].h, nb)]++] = k;
+    for (j = nb; j; --j)  /*(restore bstart[] after counting sort)*/
+        bstart[j] = bstart[j-1];
+    bstart[0] = 0;
+    qsort(border, nb, sizeof(uint64_t), mcdb_make_u64_cmp);
+
+    /* search for pilot for each bucket, largest buckets first
+     * (tbl[] entry is 1 + index of key in keys[], or 0 if empty) */
+    memset(tbl, 0, msz * sizeof(uint32_t));
+    for (j = 0; j < nb; ++j) {
+        const uint32_t bk = (uint32_t)border[j];
+        const uint32_t * const restrict bkeys = order + bstart[bk];
+        s = bstart[bk+1] - bstart[bk];
+        for (pilot = 0; s != 0 && pilot <= MCDB_MPH_PILOT_MAX; ++pilot) {
+            for (k = 0; k < s; ++k) {
+                const uint32_t q = mcdb_mph_pos(keys[bkeys[k]].h, pilot, msz);
+                if (tbl[q])
+                    break;
+                tbl[q] = bkeys[k] + 1;
+                bpos[k] = q;
+            }
+            if (k == s)
+                break;
+            while (k)  /* release entries claimed with this pilot */
+                tbl[bpos[--k]] = 0;
+        }
+        if (pilot > MCDB_MPH_PILOT_MAX) {
+            for (k = 0; k < s; ++k)
+                ovf[novf++] = keys[bkeys[k]];
+            pilot = 0;
+        }
+        pilots[bk] = (uint16_t)pilot;
+    }
+    if (novf > 1)
+        qsort(ovf, novf, sizeof(struct mcdb_hp), mcdb_make_hp_cmp);
+    /* (overflow table has novt*2 entries; power of 2 if MCDB_HDR_POW2) */
+    novt = (novf > 1 && (m->flags & MCDB_HDR_POW2))
+      ? mcdb_make_pow2(novf)
+      : novf;
+
+    /* mmap sufficient space into which to write index for this slot */
+    psz = (((uintptr_t)nb << 1) + MCDB_PAD_MASK) & ~(uintptr_t)MCDB_PAD_MASK;
+    sz  = psz + ((uintptr_t)msz << b) + ((uintptr_t)novt << (b+1));
+    if (m->offset+m->msz < m->pos+sz && !mcdb_mmap_upsize(m, m->pos+sz, false)){
+        m->fn_free(buf);
+        return false;
+    }
+
+    /* slot directory entry */
+    uint64_strpack_bigendian_aligned_macro(dirent, (uint64_t)m->pos);  /*hpos*/
+    uint32_strpack_bigendian_aligned_macro(dirent+8, msz);
+    uint32_strpack_bigendian_aligned_macro(dirent+12, novt);
+
+    /* pilots, MPH table, overflow table; writing directly to mmap */
+    p = m->map + m->pos - m->offset;
+    m->pos += sz;
+    memset(p, 0, sz);
+    for (j = 0; j < nb; ++j) {
+        p[(j<<1)]   = (char)(pilots[j] >> 8);
+        p[(j<<1)+1] = (char)(pilots[j]);
+    }
+    p += psz;
+    for (k = 0; k < msz; ++k) {
+        if (tbl[k])
+            mcdb_make_entry(p+((uintptr_t)k << b), keys+tbl[k]-1, b);
+    }
+    p += ((uintptr_t)msz << b);
+    for (k = 0; k < novf; ++k)
+        mcdb_make_probe(m, p, novt << 1, ovf+k, b);
+
+    m->fn_free(buf);
+    return true;
+}
+
+/* copy small records from data section (dmap) into hash table entries of
+ * open hash table p with len 32-byte entries (b == 5) (see mcdb.h) */
+__attribute_nonnull__
+static void
+mcdb_make_inline(char * restrict p, const uint32_t len,
+                 const char * const restrict dmap);
+
+static void
+mcdb_make_inline(char * restrict p, const uint32_t len,
+                 const char * const restrict dmap)
+{
+    const char *r;
+    uint32_t sz;
+    for (uint32_t u = 0; u < len; ++u, p += 32) {
+        if (*(uint32_t *)(p+4) == 0)  /* empty entry (dpos == 0) */
+            continue;
+        r  = dmap + uint32_strunpack_bigendian_aligned_macro(p+4);
+        sz = uint32_strunpack_bigendian_macro(r)     /* klen */
+           + uint32_strunpack_bigendian_macro(r+4);  /* dlen */
+        if (sz <= MCDB_INLINE_MAX)
+            memcpy(p+8, r, 8+sz);    /* copy of record (header, key, data) */
+        else
+            *(uint32_t *)(p+8) = ~0u;/* klen ~0: record not inlined */
+    }
+}
+
+/* set bits in filter p with nb 32-byte blocks for khash of each record
+ * (split block Bloom filter; see mcdb.h) */
+__attribute_nonnull__
+static void
+mcdb_make_filter(const struct mcdb_make * const restrict m,
+                 char * const restrict p, const uint32_t nb);
+
+static void
+mcdb_make_filter(const struct mcdb_make * const restrict m,
+                 char * const restrict p, const uint32_t nb)
+{
+    char *blk;
+    uint32_t bit;
+    uint32_t n;
+    struct mcdb_hpiter it;
+    const struct mcdb_hp *hp;
+    for (uint32_t i = 0; i < MCDB_SLOTS; ++i) {
+        mcdb_hpiter_init(&it, m, i, NULL);
+        while ((hp = mcdb_hpiter_next(&it, &n)) != NULL) {
+            for (uint32_t u = 0; u < n; ++u) {
+                blk = p + ((uintptr_t)mcdb_filter_block(hp[u].h, nb) << 5);
+                for (uint32_t w = 0; w < 8; ++w) {
+                    bit = mcdb_filter_bit(hp[u].h, w);
+                    blk[bit >> 3] |= (char)(1u << (bit & 7));
+                }
+            }
+        }
+        mcdb_hpiter_fini(&it);
+    }
+}
+
+/* num of entries in open hash table for slot with n records
+ * (hash table with 2x entries as records (power of 2 if MCDB_HDR_POW2))
+ * (bucketized tables have 8 entries per 64-byte bucket) */
+__attribute_nonnull__
+__attribute_pure__
+static uint32_t
+mcdb_make_slot_len(const struct mcdb_make * const restrict m, const uint32_t n);
+
+static uint32_t
+mcdb_make_slot_len(const struct mcdb_make * const restrict m, const uint32_t n)
+{
+    if (n == 0)
+        return 0;
+    else if (m->flags & MCDB_HDR_BUCKET)
+        return (m->flags & MCDB_HDR_POW2)
+          ? mcdb_make_pow2((n + 3) >> 2) << 3
+          : ((n << 1) + 7) & ~7u;
+    else
+        return (m->flags & MCDB_HDR_POW2)
+          ? mcdb_make_pow2(n << 1)
+          : n << 1;
+}
+
+/* insert hp into open hash table p with len entries (len already zeroed) */
+__attribute_nonnull__
+static inline void
+mcdb_make_insert(const struct mcdb_make * const restrict m,
+                 char * const restrict p, const uint32_t len,
+                 const struct mcdb_hp * const restrict hp, const uint32_t b);
+
+static inline void
+mcdb_make_insert(const struct mcdb_make * const restrict m,
+                 char * const restrict p, const uint32_t len,
+                 const struct mcdb_hp * const restrict hp, const uint32_t b)
+{
+    if (m->flags & MCDB_HDR_BUCKET)
+        mcdb_make_probe_bucket(m, p, len >> 3, hp);
+    else if (m->flags & MCDB_HDR_ROBINHOOD)
+        mcdb_make_probe_rh(m, p, len, hp, b);
+    else
+        mcdb_make_probe(m, p, len, hp, b);
+}
+
+/* generate index for the n records hp[] of a slot, writing directly to mmap,
+ * and fill in slot directory entry (see mcdb.h)
+ * layout in memory of open hash table entries:
+ *   b == 3: 4-byte khash, 4-byte dpos (data section ends < 4 GB)
+ *   b == 4: 4-byte khash, 4-byte klen, 8-byte dpos (data section crosses 4 GB)
+ *           (4-byte key fingerprint instead of klen if MCDB_HDR_WIDE)
+ *   b == 5: 4-byte khash, 4-byte dpos, copy of small record (MCDB_HDR_INLINE)
+ * (dmap is data section mapped read-only if b == 5 or 4) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static bool
+mcdb_make_slot(struct mcdb_make * const restrict m,
+               const struct mcdb_hp * const restrict hp, const uint32_t n,
+               const uint32_t b, char * const restrict dirent,
+               const char * const restrict dmap);
+
+static bool
+mcdb_make_slot(struct mcdb_make * const restrict m,
+               const struct mcdb_hp * const restrict hp, const uint32_t n,
+               const uint32_t b, char * const restrict dirent,
+               const char * const restrict dmap)
+{
+    const uintptr_t d = m->pos;
+    uint32_t len;
+    uint32_t u;
+    char *p;
+
+    if (m->flags & MCDB_HDR_MPH)
+        return mcdb_make_slot_mph(m, hp, n, b, dirent);
+
+    len = mcdb_make_slot_len(m, n);
+
+    /* mmap sufficient space into which to write hash table for this slot */
+    if (m->offset+m->msz < d+((uintptr_t)len << b)
+        && !mcdb_mmap_upsize(m, d+((uintptr_t)len << b), false))
+        return false;
+
+    /* slot directory entry */
+    uint64_strpack_bigendian_aligned_macro(dirent,(uint64_t)d); /* hpos */
+    uint32_strpack_bigendian_aligned_macro(dirent+8,len);       /* hslots */
+    *(uint32_t *)(dirent+12) = 0;/*(fill hole with 0 only for consistency)*/
+
+    /* generate hash table for slot, writing directly to mmap */
+    p = m->map + m->pos - m->offset;
+    m->pos += ((uintptr_t)len << b);
+    memset(p, 0, (size_t)len << b);
+    for (u = 0; u < n; ++u)
+        mcdb_make_insert(m, p, len, hp+u, b);
+    if (b == 5)  /* small records copied into 32-byte entries */
+        mcdb_make_inline(p, len, dmap);
+    return true;
+}
+
+/* Multi-threaded generation of hash tables (opt-in: m->nthreads > 1)
+ * Slot hash table sizes are determined by the num of records in each slot,
+ * so the layout of the index is computed up front, the entire index region is
+ * mmap'd, and then the hash tables for each of the MCDB_SLOTS hplists (each
+ * spanning 1 << (slot bits - 8) slots) are generated concurrently by a pool of
+ * threads.  Records are inserted into each slot hash table in the same order
+ * as in mcdb_make_slot(), so output is identical to serial mcdb_make_finish().
+ * (not used for MCDB_HDR_MPH, in which table sizes are known only after
+ *  each slot index is generated)
+ * (also used (with one or more threads) if hplists were spilled to disk, since
+ *  records are streamed from hplists without gathering records of hplist) */
+
+struct mcdb_make_par {
+  const struct mcdb_make *m;
+  char **tbl;                 /* hash table (in mmap) for each slot */
+  uint32_t *len;              /* num of records, then num entries, each slot */
+  const char *dmap;           /* data section (read-only) if b == 5 or 4 */
+  uint32_t b;                 /* hash table entry size bits */
+  uint32_t next;              /* next hplist to process (atomic counter) */
+  void (*fn)(struct mcdb_make_par * restrict, uint32_t);
+};
+
+/* count num of records in each slot of hplist i (if slot bits > 8) */
+__attribute_nonnull__
+static void
+mcdb_make_par_count(struct mcdb_make_par * const restrict par,
+                    const uint32_t i);
+
+static void
+mcdb_make_par_count(struct mcdb_make_par * const restrict par,
+                    const uint32_t i)
+{
+    const uint32_t k = par->m->slot_bits - MCDB_SLOT_BITS;
+    const uint32_t nsub = 1u << k;
+    uint32_t * const restrict len = par->len + (i << k);
+    uint32_t n;
+    struct mcdb_hpiter it;
+    const struct mcdb_hp *hp;
+    mcdb_hpiter_init(&it, par->m, i, NULL);
+    while ((hp = mcdb_hpiter_next(&it, &n)) != NULL) {
+        for (uint32_t u = 0; u < n; ++u)
+            ++len[(hp[u].h >> MCDB_SLOT_BITS) & (nsub-1)];
+    }
+    mcdb_hpiter_fini(&it);
+}
+
+/* generate hash tables for slots of hplist i
+ * (hash tables of the slots of hplist i are contiguous in mmap) */
+__attribute_nonnull__
+static void
+mcdb_make_par_fill(struct mcdb_make_par * const restrict par,
+                   const uint32_t i);
+
+static void
+mcdb_make_par_fill(struct mcdb_make_par * const restrict par,
+                   const uint32_t i)
+{
+    const struct mcdb_make * const restrict m = par->m;
+    const uint32_t b = par->b;
+    const uint32_t k = m->slot_bits - MCDB_SLOT_BITS;
+    const uint32_t nsub = 1u << k;
+    char ** const restrict tbl = par->tbl + (i << k);
+    const uint32_t * const restrict len = par->len + (i << k);
+    uint32_t u;
+    uint32_t n;
+    struct mcdb_hpiter it;
+    const struct mcdb_hp *hp;
+    memset(tbl[0], 0, (size_t)(tbl[nsub-1] - tbl[0]) + ((size_t)len[nsub-1]<<b));
+    mcdb_hpiter_init(&it, m, i, b == 4 ? par->dmap : NULL);
+    while ((hp = mcdb_hpiter_next(&it, &n)) != NULL) {
+        for (u = 0; u < n; ++u) {
+            const uint32_t s = (hp[u].h >> MCDB_SLOT_BITS) & (nsub-1);
+            mcdb_make_insert(m, tbl[s], len[s], hp+u, b);
+        }
+    }
+    mcdb_hpiter_fini(&it);
+    if (b == 5) { /* small records copied into 32-byte entries */
+        for (u = 0; u < nsub; ++u)
+            mcdb_make_inline(tbl[u], len[u], par->dmap);
+    }
+}
+
+#ifdef _THREAD_SAFE
+static void *
+mcdb_make_par_thread(void * const arg)
+{
+    struct mcdb_make_par * const restrict par = (struct mcdb_make_par *)arg;
+    uint32_t i;
+    while ((i = plasma_atomic_fetch_add_u32(&par->next, 1,
+                                            memory_order_relaxed)) < MCDB_SLOTS)
+        par->fn(par, i);
+    return NULL;
+}
+#endif
+
+/* run fn on each hplist with pool of m->nthreads threads (incl. this thread)
+ * (fewer threads are used if thread creation fails) */
+__attribute_nonnull__
+static void
+mcdb_make_par_run(struct mcdb_make_par * const restrict par,
+                  void (*fn)(struct mcdb_make_par * restrict, uint32_t));
+
+static void
+mcdb_make_par_run(struct mcdb_make_par * const restrict par,
+                  void (*fn)(struct mcdb_make_par * restrict, uint32_t))
+{
+  #ifndef _THREAD_SAFE
+    for (uint32_t i = 0; i < MCDB_SLOTS; ++i)
+        fn(par, i);
+  #else
+    pthread_t tid[MCDB_SLOTS];
+    const uint32_t nthreads =
+      par->m->nthreads < MCDB_SLOTS ? par->m->nthreads : MCDB_SLOTS;
+    uint32_t n;
+    par->fn   = fn;
+    par->next = 0;
+    for (n = 0; n+1 < nthreads; ++n) {
+        if (pthread_create(tid+n, NULL, mcdb_make_par_thread, par) != 0)
+            break;
+    }
+    (void) mcdb_make_par_thread(par);
+    while (n)
+        pthread_join(tid[--n], NULL);
+  #endif
+}
+
+/* generate index for all slots, writing directly to mmap, and fill in slot
+ * directory dir (multi-threaded equivalent of mcdb_make_slot() for each slot)*/
+__attribute_noinline__
+__attribute_nonnull_x__((1,3))
+__attribute_warn_unused_result__
+static bool
+mcdb_make_slots_par(struct mcdb_make * const restrict m, const uint32_t b,
+                    char * const restrict dir, const char * const dmap);
+
+static bool
+mcdb_make_slots_par(struct mcdb_make * const restrict m, const uint32_t b,
+                    char * const restrict dir, const char * const dmap)
+{
+    struct mcdb_make_par par;
+    const uint32_t sb = m->slot_bits;
+    const uint32_t nslots = 1u << sb;
+    uintptr_t d = m->pos;
+    uint32_t s;
+    char *p;
+    void * const buf =
+      m->fn_malloc((size_t)nslots * (sizeof(char *) + sizeof(uint32_t)));
+    if (buf == NULL)
+        return false;
+
+    par.m    = m;
+    par.tbl  = (char **)buf;
+    par.len  = (uint32_t *)(par.tbl + nslots);
+    par.dmap = dmap;
+    par.b    = b;
+
+    /* num of records in each slot */
+    if (sb == MCDB_SLOT_BITS)
+        memcpy(par.len, m->count, MCDB_SLOTS * sizeof(uint32_t));
+    else {
+        memset(par.len, 0, (size_t)nslots * sizeof(uint32_t));
+        mcdb_make_par_run(&par, mcdb_make_par_count);
+    }
+
+    /* layout of hash tables and slot directory entries */
+    for (s = 0; s < nslots; ++s) {
+        char * const restrict dirent = dir + ((uintptr_t)s << 4);
+        par.len[s] = mcdb_make_slot_len(m, par.len[s]);
+        uint64_strpack_bigendian_aligned_macro(dirent,(uint64_t)d);  /* hpos */
+        uint32_strpack_bigendian_aligned_macro(dirent+8,par.len[s]);/*hslots*/
+        *(uint32_t *)(dirent+12) = 0;/*(fill hole with 0 only for consistency)*/
+        par.tbl[s] = (char *)(uintptr_t)(d - m->pos);
+        d += ((uintptr_t)par.len[s] << b);
+    }
+
+    /* mmap entire index region */
+    if (m->offset+m->msz < d && !mcdb_mmap_upsize(m, d, false)) {
+        m->fn_free(buf);
+        return false;
+    }
+    p = m->map + m->pos - m->offset;
+    for (s = 0; s < nslots; ++s)
+        par.tbl[s] = p + (uintptr_t)par.tbl[s];
+
+    mcdb_make_par_run(&par, mcdb_make_par_fill);
+
+    m->pos = d;
+    m->fn_free(buf);
+    return true;
+}
+
 int
 mcdb_make_finish(struct mcdb_make * const restrict m)
 {
@@ -472,31 +2123,78 @@ mcdb_make_finish(struct mcdb_make * const restrict m)
      *  and in practice, size of data fitting in 4 GB will impose lower limit)
      * Use of 32-bit hash is the basis for continuing to use 32-bit structures.
      * Even a mostly uniform distribution of hash keys will likely show
-     * increasing number of collisions as number of keys approaches 2 billion.*/
+     * increasing number of collisions as number of keys approaches 2 billion.
+     * MCDB_HDR_WIDE lifts the limit: 64-bit hash (khash and key fingerprint
+     * in 16-byte entries) and num records limited per hplist, not in total.*/
     uint32_t u;
     uint32_t i;
     uintptr_t d;
-    uint32_t len;
     uint32_t b;
+    uint64_t nrecs;
+    uint32_t hash_id;
+    uint32_t hash_init;
+    uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t);
+    uintptr_t eod;
+    uintptr_t fpos;
+    uintptr_t fsz;
     char *p;
+    char *dmap;
+    const char *kmap;
     const uint32_t * const restrict count = m->count;
-    char header[MCDB_HEADER_SZ];
+    char header[MCDB_HDR_SZ];
+    char *dir;
+    uint32_t sb;
+    uint32_t nsub;
+    bool par;
+    bool v1;
     if (m->map == MAP_FAILED)                  return mcdb_make_err(m,EPERM);
+    if (m->sub != NULL && !mcdb_make_sub_merge(m))
+                                               return mcdb_make_err(m,errno);
+    u = m->flags & MCDB_HDR_LAYOUT;  /* (at most one layout flag) */
+    if ((m->flags & ~(uint32_t)MCDB_HDR_FLAGS_KNOWN) || (u & (u-1))
+        || ((m->flags & MCDB_HDR_INLINE)
+            && (m->flags & (MCDB_HDR_MPH | MCDB_HDR_BUCKET)))
+        || ((m->flags & MCDB_HDR_WIDE)
+            && (m->flags & (MCDB_HDR_INLINE | MCDB_HDR_BUCKET)))
+        || (m->flags & MCDB_HDR_REDUCE) == MCDB_HDR_REDUCE
+        || m->slot_bits < MCDB_SLOT_BITS || m->slot_bits > MCDB_SLOT_BITS_MAX)
+                                               return mcdb_make_err(m,EINVAL);
 
-    for (u = 0, i = 0; i < MCDB_SLOTS; ++i)
-        u += count[i];  /* no overflow; limited in mcdb_hplist_alloc */
+    for (nrecs = 0, i = 0; i < MCDB_SLOTS; ++i)
+        nrecs += count[i];  /* no overflow; limited in mcdb_hplist_alloc */
 
     /* check for integer overflow and that sufficient space allocated in file */
-    if (u > INT_MAX)                           return mcdb_make_err(m,ENOMEM);
+    if (nrecs > INT_MAX && !(m->flags & MCDB_HDR_WIDE))
+                                               return mcdb_make_err(m,ENOMEM);
   #if !defined(_LP64) && !defined(__LP64__)
-    if (u > (UINT_MAX>>4))                     return mcdb_make_err(m,ENOMEM);
-    u <<= 4;  /* 8 byte hash entries in 32-bit; x 2 for space in table */
+    b = (m->flags & MCDB_HDR_INLINE) ? 6u : (m->flags & MCDB_HDR_WIDE) ? 5u : 4u;
+    if (m->flags & MCDB_HDR_POW2) ++b;  /* tables rounded up to power of 2 */
+    if (nrecs > (UINT_MAX>>b))                 return mcdb_make_err(m,ENOMEM);
+    u = (uint32_t)nrecs << b; /* 8 (16 wide, 32 inline) byte hash entries in
+                               * 32-bit; x 2 for space */
+    if (u > UINT_MAX-(80u<<m->slot_bits))     return mcdb_make_err(m,ENOMEM);
+    u += 16u << m->slot_bits; /* slot directory follows hash tables */
+    u += 64u << m->slot_bits; /* bucketized tables round up to 64-byte buckets*/
+    if (m->flags & MCDB_HDR_FILTER) { /* filter section (<= 2 bytes per rec)*/
+        if (u > UINT_MAX-MCDB_FILTER_ALIGN-32-(nrecs<<1))
+                                               return mcdb_make_err(m,ENOMEM);
+        u += MCDB_FILTER_ALIGN + 32 + (nrecs<<1);
+    }
     if (m->pos > ((size_t)UINT_MAX-u))         return mcdb_make_err(m,ENOMEM);
   #endif
 
+    eod = m->pos;  /* end of data section */
+
+    /* bucketized tables have 32-bit dpos; use default tables if data >= 4 GB*/
+    if ((m->flags & MCDB_HDR_BUCKET) && m->pos >= (size_t)UINT_MAX - 64)
+        m->flags &= ~(uint32_t)MCDB_HDR_BUCKET;
+
     /* add "hole" for alignment; incompatible with djb cdbdump */
-    /* padding to align hash tables to MCDB_PAD_ALIGN bytes (16) */
-    d = (MCDB_PAD_ALIGN - (m->pos & MCDB_PAD_MASK)) & MCDB_PAD_MASK;
+    /* padding to align hash tables to MCDB_PAD_ALIGN bytes (16)
+     * (or to 64 bytes (cache line) for bucketized tables) */
+    d = (m->flags & MCDB_HDR_BUCKET)
+      ? (64 - (m->pos & 63)) & 63
+      : (MCDB_PAD_ALIGN - (m->pos & MCDB_PAD_MASK)) & MCDB_PAD_MASK;
   #if !defined(_LP64) && !defined(__LP64__)
     if (d > (UINT_MAX-(m->pos+u)))             return mcdb_make_err(m,ENOMEM);
   #endif
@@ -509,68 +2207,158 @@ mcdb_make_finish(struct mcdb_make * const restrict m)
      * (madvise is supposed to be advice, not promise; Solaris crash is bug) */
     posix_madvise(m->map, m->msz, POSIX_MADV_NORMAL);
 
-    b = (m->pos < UINT_MAX) ? 3u : 4u;
-    for (i = 0; i < MCDB_SLOTS; ++i) {
-        len = count[i] << 1;
-        d   = m->pos;
+    /* map data section (read-only) from which to copy small records into
+     * hash table entries (records might not be in current mmap window)
+     * (inline entries have 32-bit dpos; use default tables if data >= 4 GB) */
+    dmap = ((m->flags & MCDB_HDR_INLINE) && m->pos < UINT_MAX && m->fd != -1)
+      ? (char *)mmap(0, eod, PROT_READ, MAP_SHARED, m->fd, 0)
+      : MAP_FAILED;
+    if (dmap == MAP_FAILED)
+        m->flags &= ~(uint32_t)MCDB_HDR_INLINE;
 
-        /* mmap sufficient space into which to write hash table for this slot */
-        if (m->offset+m->msz < d+((uintptr_t)len << b)
-            && !mcdb_mmap_upsize(m, d+((uintptr_t)len << b), false))
-            break;
+    b = (m->flags & MCDB_HDR_INLINE) ? 5u
+      : (m->pos < UINT_MAX && !(m->flags & MCDB_HDR_WIDE)) ? 3u : 4u;
+
+    /* map data section (read-only) from which to read klen of records for
+     * hash tables with 16-byte entries (klen not kept in packed hplists)
+     * (or from which to hash key fingerprint if MCDB_HDR_WIDE) */
+    if (b == 4 && m->fd != -1) { /*(m->fd == -1 during large mcdb size tests)*/
+        dmap = (char *)mmap(0, eod, PROT_READ, MAP_SHARED, m->fd, 0);
+        if (dmap == MAP_FAILED)                return mcdb_make_err(m,errno);
+    }
+    kmap = (dmap != MAP_FAILED) ? dmap : NULL;
 
-        /* constant header (16 bytes per header slot, so multiply by 16) */
-        p = header + (i << 4);  /* (i << 4) == (i * 16) */
-        uint64_strpack_bigendian_aligned_macro(p,(uint64_t)d); /* hpos */
-        uint32_strpack_bigendian_aligned_macro(p+8,len);       /* hslots */
-        *(uint32_t *)(p+12) = 0;     /*(fill hole with 0 only for consistency)*/
-
-        /* generate hash table for slot, writing directly to mmap */
-        p = m->map + m->pos - m->offset;
-        m->pos += ((uintptr_t)len << b);
-        memset(p, 0, (size_t)len << b);
-        if (b == 3) { /* data section ends < 4 GB; use 32-bit dpos offset */
-            /* (could be made into a subroutine taking (len, p, m->head[i]) */
-            /* layout in memory: 4-byte khash, 4-byte dpos */
-            for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
-                const struct mcdb_hp * restrict hp = x->hp;
-                char * restrict q;
-                for (uint32_t w = x->num; w; --w, ++hp) {
-                    q = p+4;  /*(4 is offset of dpos)*/
-                    u = (hp->h >> MCDB_SLOT_BITS) % len;
-                    /* find empty entry in open hash table (dpos == 0) */
-                    while (*(uint32_t *)(q+((uintptr_t)u<<3)))
-                        if (++u == len)
-                            u = 0;
-                    q += (u<<3);
-                    uint32_strpack_bigendian_aligned_macro(q-4,hp->h); /*khash*/
-                    uint32_strpack_bigendian_aligned_macro(q,(uint32_t)hp->p);
-                }                                                      /*dpos*/
+    /* slot directory (16 bytes per slot) and buffer into which records of
+     * each of MCDB_SLOTS hplists are gathered and grouped by slot
+     * (slot bits > 8: each hplist spans 1 << (slot bits - 8) slots) */
+    sb   = m->slot_bits;
+    nsub = 1u << (sb - MCDB_SLOT_BITS);
+    par  = ((m->nthreads > 1 || m->spill != NULL)
+            && !(m->flags & MCDB_HDR_MPH));
+    for (u = 0, i = 0; i < MCDB_SLOTS && !par; ++i) {
+        if (u < count[i])
+            u = count[i];
+    }
+    dir = (char *)m->fn_malloc(((size_t)16 << sb)
+                               + (size_t)u * sizeof(struct mcdb_hp)
+                               + (size_t)(nsub + 1) * sizeof(uint32_t));
+    i = 0;
+    if (dir != NULL && par)
+        i = mcdb_make_slots_par(m, b, dir, kmap)
+          ? MCDB_SLOTS
+          : 0;
+    else if (dir != NULL) {
+        struct mcdb_hp * const restrict keys =
+          (struct mcdb_hp *)(dir + ((size_t)16 << sb));
+        uint32_t * const restrict off = (uint32_t *)(keys + u);
+        struct mcdb_hpiter it;
+        const struct mcdb_hp *hp;
+        uint32_t n;
+        for (i = 0; i < MCDB_SLOTS; ++i) {
+            /* (counting sort by slot; preserves order of records in slot) */
+            memset(off, 0, (nsub + 1) * sizeof(uint32_t));
+            mcdb_hpiter_init(&it, m, i, NULL);
+            while ((hp = mcdb_hpiter_next(&it, &n)) != NULL) {
+                for (u = 0; u < n; ++u)
+                    ++off[((hp[u].h >> MCDB_SLOT_BITS) & (nsub-1)) + 1];
             }
-        }
-        else {/*b==4*//* data section crosses 4 GB; need 64-bit dpos offset */
-            /* (could be made into a subroutine taking (len, p, m->head[i]) */
-            /* layout in memory: 4-byte khash, 4-byte klen, 8-byte dpos */
-            for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
-                const struct mcdb_hp * restrict hp = x->hp;
-                char * restrict q;
-                for (uint32_t w = x->num; w; --w, ++hp) {
-                    q = p+8;  /*(8 is offset of dpos)*/
-                    u = (hp->h >> MCDB_SLOT_BITS) % len;
-                    /* find empty entry in open hash table (dpos == 0) */
-                    while (*(uintptr_t *)(q+((uintptr_t)u<<4)))
-                        if (++u == len)
-                            u = 0;
-                    q += (u<<4);
-                    uint32_strpack_bigendian_aligned_macro(q-8,hp->h); /*khash*/
-                    uint32_strpack_bigendian_aligned_macro(q-4,hp->l); /*klen*/
-                    uint64_strpack_bigendian_aligned_macro(q,(uint64_t)hp->p);
-                }                                                      /*dpos*/
+            mcdb_hpiter_fini(&it);
+            for (u = 0; u < nsub; ++u)
+                off[u+1] += off[u];
+            mcdb_hpiter_init(&it, m, i, b == 4 ? kmap : NULL);
+            while ((hp = mcdb_hpiter_next(&it, &n)) != NULL) {
+                for (u = 0; u < n; ++u)
+                    keys[off[(hp[u].h >> MCDB_SLOT_BITS) & (nsub-1)]++] =
+                      hp[u];
             }
+            mcdb_hpiter_fini(&it);
+            for (u = nsub; u; --u)  /*(restore off[] after counting sort)*/
+                off[u] = off[u-1];
+            off[0] = 0;
+            for (u = 0; u < nsub; ++u) {
+                if (!mcdb_make_slot(m, keys+off[u], off[u+1]-off[u], b,
+                                    dir + ((uintptr_t)((i << (sb-MCDB_SLOT_BITS))
+                                                       | u) << 4),
+                                    dmap))
+                    break;
+            }
+            if (u != nsub)
+                break;
         }
     }
 
-    u = (uint32_t)(i == MCDB_SLOTS && mcdb_mmap_commit(m, header));
+    if (dmap != MAP_FAILED)
+        munmap(dmap, eod);
+    if (m->spill != NULL && m->spill->err != 0) {
+        errno = m->spill->err;
+        i = 0;
+    }
+
+    /* record hash id only if hash_fn is the function for that id
+     * (custom hash_fn might have been set by caller after mcdb_make_start()) */
+    hash_id = m->hash_id;
+    if (!mcdb_hash_lookup(hash_id, &hash_init, &hash_fn)
+        || hash_fn != m->hash_fn)
+        hash_id = MCDB_HASH_CUSTOM;
+
+    /* create v1 mcdb (readable by earlier mcdb readers) unless v2 is needed:
+     * feature flags, slot bits, or hash func or seed other than djb default
+     * (v1 does not record hash func, so custom hash func with default seed
+     *  is v1, as before v2; consumer sets custom hash func (see NOTES)) */
+    v1 = (m->flags == 0 && sb == MCDB_SLOT_BITS
+          && m->hash_init == UINT32_HASH_DJB_INIT
+          && (hash_id == MCDB_HASH_DJB || hash_id == MCDB_HASH_CUSTOM));
+
+    /* v2: slot directory follows hash tables (16-byte aligned)
+     * v1: slot directory is written at beginning of mcdb (MCDB_HEADER_SZ) */
+    d = m->pos;
+    if (i == MCDB_SLOTS && !v1
+        && (m->offset+m->msz >= d+((uintptr_t)16 << sb)
+            || mcdb_mmap_upsize(m, d+((uintptr_t)16 << sb), false))) {
+        memcpy(m->map + d - m->offset, dir, (size_t)16 << sb);
+        m->pos += ((uintptr_t)16 << sb);
+    }
+    else if (!v1)
+        i = 0;
+
+    /* filter section follows slot directory (MCDB_FILTER_ALIGN-aligned) */
+    fpos = fsz = 0;
+    if (i == MCDB_SLOTS && (m->flags & MCDB_HDR_FILTER)) {
+        fsz  = ((uintptr_t)(nrecs / MCDB_FILTER_KEYS_PER_BLOCK) + 1) << 5;
+        fpos = (m->pos + (MCDB_FILTER_ALIGN-1))
+             & ~(uintptr_t)(MCDB_FILTER_ALIGN-1);
+        if (m->offset+m->msz >= fpos+fsz || mcdb_mmap_upsize(m,fpos+fsz,false)){
+            p = m->map + m->pos - m->offset;
+            memset(p, 0, fpos + fsz - m->pos);
+            mcdb_make_filter(m, p + fpos - m->pos, (uint32_t)(fsz >> 5));
+            m->pos = fpos + fsz;
+        }
+        else
+            i = 0;
+    }
+
+    /* v2 header (see mcdb.h) */
+    memset(header, 0, MCDB_HDR_SZ);
+    memcpy(header, MCDB_HDR_MAGIC, MCDB_HDR_MAGIC_SZ);
+    uint32_strpack_bigendian_aligned_macro(header+8,  MCDB_HDR_VERSION);
+    uint32_strpack_bigendian_aligned_macro(header+12, m->flags);
+    uint32_strpack_bigendian_aligned_macro(header+16, hash_id);
+    uint32_strpack_bigendian_aligned_macro(header+20, m->hash_init);
+    uint32_strpack_bigendian_aligned_macro(header+24, sb);
+    uint32_strpack_bigendian_aligned_macro(header+28, b);
+    uint64_strpack_bigendian_aligned_macro(header+32, (uint64_t)d);
+    uint64_strpack_bigendian_aligned_macro(header+40,(uint64_t)MCDB_HEADER_SZ);
+    uint64_strpack_bigendian_aligned_macro(header+48, (uint64_t)eod);
+    uint64_strpack_bigendian_aligned_macro(header+56, (uint64_t)nrecs);
+    uint64_strpack_bigendian_aligned_macro(header+64, (uint64_t)fpos);
+    uint64_strpack_bigendian_aligned_macro(header+72, (uint64_t)fsz);
+
+    u = (uint32_t)(i == MCDB_SLOTS
+                   && (v1
+                       ? mcdb_mmap_commit(m, dir, MCDB_HEADER_SZ)
+                       : mcdb_mmap_commit(m, header, MCDB_HDR_SZ)));
+    if (dir != NULL)
+        m->fn_free(dir);
     return (u ? 0 : -1) | mcdb_make_destroy(m);
 }
 
@@ -612,6 +2400,12 @@ mcdb_make_destroy(struct mcdb_make * const restrict m)
         }
         m->head[0] = NULL;
     }
+    if (m->spill != NULL) {
+        (void) nointr_close(m->spill->fd);
+        m->fn_free(m->spill);
+        m->spill = NULL;
+    }
+    mcdb_make_sub_free(m);
     return rc;
 }
 
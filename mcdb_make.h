@@ -37,6 +37,8 @@ extern "C" {
 
 struct mcdb_hp { uintptr_t p; uint32_t h; uint32_t l; }; /*(private structure)*/
 struct mcdb_hplist;                                      /*(private structure)*/
+struct mcdb_make_sub;                                    /*(private structure)*/
+struct mcdb_spill;                                       /*(private structure)*/
 
 struct mcdb_make {
   size_t pos;
@@ -58,12 +60,33 @@ struct mcdb_make {
   mode_t st_mode;
   uint32_t count[MCDB_SLOTS];
   struct mcdb_hplist *head[MCDB_SLOTS];
+  /* (members below added with file format v2; appended (see NOTES)) */
+  uint32_t hash_id;           /* hash func id (enum mcdb_hash_id) */
+  uint32_t flags;             /* build options (enum mcdb_hdr_flags) */
+  uint32_t slot_bits;         /* log2 of num slots in slot directory (8 - 20) */
+  uint32_t nthreads;          /* threads parsing input, generating index */
+  struct mcdb_make_sub *sub;  /* sub-builders (merged in make_finish()) */
+  size_t membudget;           /* max mem for hplists (0 unlimited; else spill)*/
+  size_t hpmem;
+  struct mcdb_spill *spill;
+  size_t sizehint;            /* projected mcdb size (0 unknown; else mmap
+                               * output in large windows (see NOTES)) */
+  size_t wbnext;              /* pos at which to start next async write-back */
+  int gen_errno;              /* errno if mcdb_makefn_finish() failed to incr
+                               * generation sidecar (else 0) */
 };
 
 
 /*
  * Note: mcdb *_make_* routines are not thread-safe
  * (no need for thread-safety; mcdb is typically created from a single stream)
+ * except mcdb_make_sub_start(), which may be called concurrently by multiple
+ * threads to obtain a sub-builder for each thread.  Each thread may then call
+ * mcdb_make_sub_add() with its own sub-builder concurrently with other threads.
+ * All threads must finish adding records before mcdb_make_finish() is called,
+ * which merges records from sub-builders (in order sub-builders were created)
+ * into mcdb after records added with mcdb_make_add().  Sub-builders are freed
+ * by mcdb_make_finish() or mcdb_make_destroy().
  */
 
 
@@ -80,6 +103,42 @@ mcdb_make_add(struct mcdb_make * restrict,
               const char * restrict, size_t,
               const char * restrict, size_t);
 
+/* add record with hash of key computed by caller (see struct mcdb_khash in
+ * mcdb.h; khash of entire key, with tagc 0, including tag char, if any)
+ * (key is hashed if khash was not computed with hash func and seed of m) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_make_add_hashed(struct mcdb_make * restrict,
+                     const char * restrict, size_t,
+                     const char * restrict, size_t,
+                     const struct mcdb_khash * restrict);
+
+/* add n records (keys[i], keylens[i], data[i], datalens[i]); same mcdb as
+ * mcdb_make_add() of each, in order (djb: keys hashed at once, multi-buffer)
+ * (returns -1 upon error, and records before record in error were added) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_make_add_batch(struct mcdb_make * restrict, size_t,
+                    const char * const * restrict, const size_t * restrict,
+                    const char * const * restrict, const size_t * restrict);
+
+/* add upsert or tombstone record to delta mcdb (see MCDB_HDR_DELTA in mcdb.h)
+ * (caller sets m->flags |= MCDB_HDR_DELTA after mcdb_make_start()) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_make_delta_add(struct mcdb_make * restrict,
+                    const char * restrict, size_t,
+                    const char * restrict, size_t);
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_make_delta_del(struct mcdb_make * restrict,
+                    const char * restrict, size_t);
+
 __attribute_nonnull__
 __attribute_warn_unused_result__
 EXPORT extern int
@@ -115,6 +174,39 @@ __attribute_nothrow__
 EXPORT extern void
 mcdb_make_addrevert(struct mcdb_make * restrict);
 
+/* support for concurrent producers (one sub-builder per thread) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern struct mcdb_make_sub *
+mcdb_make_sub_start(struct mcdb_make * restrict);
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_make_sub_add(struct mcdb_make_sub * restrict,
+                  const char * restrict, size_t,
+                  const char * restrict, size_t);
+
+/* support for adding records written directly into mmap (e.g. by threads) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern char *
+mcdb_make_addreserve(struct mcdb_make * restrict, size_t);
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_make_addhash(struct mcdb_make * restrict, size_t, size_t, uint32_t);
+
+/* support for adding records of existing mcdb (e.g. merge with changes)
+ * (records at positions in sorted array are skipped; see mcdb_make.c) */
+__attribute_nonnull_x__((1,2))
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_make_addmcdb(struct mcdb_make * restrict,
+                  const struct mcdb_mmap * restrict,
+                  const uintptr_t * restrict, size_t);
+
 
 /* alias symbols with hidden visibility for use in DSO linking static mcdb.o
  * (Reference: "How to Write Shared Libraries", by Ulrich Drepper)
@@ -36,7 +36,12 @@
 #include "mcdb_make.h"
 #include "mcdb_error.h"
 #include "nointr.h"
+#include "uint32.h"
 #include "plasma/plasma_stdtypes.h"  /* SIZE_MAX */
+#ifdef _THREAD_SAFE
+#include "plasma/plasma_atomic.h"
+#include <pthread.h>
+#endif
 
 #include <errno.h>
 #include <sys/mman.h>  /* mmap(), munmap() */
@@ -45,6 +50,7 @@
 #include <stdlib.h>    /* EXIT_SUCCESS */
 #include <string.h>    /* memcpy(), memmove(), memchr() */
 #include <unistd.h>    /* read() */
+#include <limits.h>    /* INT_MAX */
 
 /*(posix_madvise, defines not provided in Solaris 10, even w/ __EXTENSIONS__)*/
 #if (defined(__sun) || defined(__hpux)) && !defined(POSIX_MADV_NORMAL)
@@ -153,6 +159,11 @@ mcdb_bufread_number (struct mcdb_input * const restrict b,
     return false; /*error: no digits or too large; not bothering to set ERANGE*/
 }
 
+/* result of parse of input is MCDB_INPUT_MORE (> 0) if more records follow,
+ * EXIT_SUCCESS (0) at blank line ending input, or MCDB_ERROR_* (< 0) if error
+ * (distinct from MCDB_ERROR_* and EXIT_SUCCESS; not bool true) */
+enum { MCDB_INPUT_MORE = 1 };
+
 __attribute_nonnull__
 __attribute_warn_unused_result__
 static int
@@ -178,7 +189,7 @@ mcdb_bufread_preamble (struct mcdb_input * const restrict b,
             && b->datasz - b->pos != 0 && b->buf[b->pos++] == ','
             && mcdb_bufread_number(b,dlen)
             && b->datasz - b->pos != 0 && b->buf[b->pos++] == ':')
-            ? true                             /*  1  valid preamble     */
+            ? MCDB_INPUT_MORE                  /*  1  valid preamble     */
             : MCDB_ERROR_READFORMAT;           /* -1  error read format  */
 }
 
@@ -249,29 +260,373 @@ mcdb_bufread_rec (struct mcdb_make * const restrict m,
  */ 
 
 
+/* binary input format: "kkkkddddxxxxyyyy" (no separators)
+ *   kkkk = key len  (4-byte unsigned; native byte order or big-endian)
+ *   dddd = data len (4-byte unsigned; native byte order or big-endian)
+ *   xxxx = key string
+ *   yyyy = data string
+ * (big-endian records are in same format as records in mcdb data section)
+ *
+ * end of input ends input (end of input within a record is an error)
+ */
+
+__attribute_nonnull__
+__attribute_pure__
+static inline uint32_t
+mcdb_bufread_binlen (const char * const restrict p,
+                     const enum mcdb_makefmt_bin fmt);
+
+static inline uint32_t
+mcdb_bufread_binlen (const char * const restrict p,
+                     const enum mcdb_makefmt_bin fmt)
+{
+    uint32_t n;
+    if (fmt == MCDB_MAKEFMT_BIN_BE)
+        return uint32_strunpack_bigendian_macro(p);
+    memcpy(&n, p, sizeof(uint32_t));
+    return n;
+}
+
+
+#ifdef _THREAD_SAFE
+
+/* Multi-threaded parsing of input in memory (mmap) (opt-in: m->nthreads > 1)
+ * Input is split into chunks at probable record boundaries ("\n+" followed by
+ * a well-formed record), and each chunk is parsed by a pool of threads in two
+ * passes.  Pass 1 validates records and sums their sizes.  Since a chunk might
+ * have begun inside key or data of a record, chunks are then checked in order
+ * that each begins where the prior chunk ended, and any chunk which does not
+ * is parsed again (in this thread) from the end of the prior chunk.  Space for
+ * all records is then reserved in mcdb, and pass 2 copies records of each
+ * chunk to its offset in mcdb and hashes keys.  Hashes are then added in input
+ * order, so the mcdb created is identical to that created by a single thread.
+ */
+
+struct mcdb_input_chunk {
+  const char *s;              /* start of chunk (start of first record) */
+  const char *e;              /* end of chunk (end of last record parsed) */
+  const char *end;            /* start of next chunk (probable) */
+  size_t sz;                  /* size of records in mcdb */
+  size_t n;                   /* num of records */
+  int rv;                     /* MCDB_INPUT_MORE, EXIT_SUCCESS, or <0 error */
+  char *out;                  /* records output (mmap) */
+  uint32_t *h;                /* hashes of keys */
+};
+
+struct mcdb_input_par {
+  const struct mcdb_make *m;
+  struct mcdb_input_chunk *chunk;
+  const char *e;              /* end of input */
+  uint32_t nchunks;
+  uint32_t nthreads;
+  uint32_t next;              /* next chunk to process (atomic counter) */
+  void (*fn)(const struct mcdb_input_par * restrict,
+             struct mcdb_input_chunk * restrict);
+};
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static const char *
+mcdb_input_number (const char * restrict p, const char * const restrict e,
+                   size_t * const restrict rv);
+
+static const char *
+mcdb_input_number (const char * restrict p, const char * const restrict e,
+                   size_t * const restrict rv)
+{
+    /* (see mcdb_bufread_number(); same limits) */
+    const char * const s = p;
+    size_t num = 0;
+    while (p != e && ((uint32_t)(*p-'0')) <= 9u && num <= 214748363uL)
+        num = num * 10 + (*p++ - '0');
+    *rv = num;
+    return (p != s && (p == e || ((uint32_t)(*p-'0')) > 9u)) ? p : NULL;
+}
+
+/* parse record "+nnnn,mmmm:xxxx->yyyy\n" at p, entirely within [p,e)
+ * return pointer to key if record is well-formed, else NULL */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static const char *
+mcdb_input_rec (const char * restrict p, const char * const restrict e,
+                size_t * const restrict klen, size_t * const restrict dlen);
+
+static const char *
+mcdb_input_rec (const char * restrict p, const char * const restrict e,
+                size_t * const restrict klen, size_t * const restrict dlen)
+{
+    /* (klen and dlen checked < INT_MAX-8; no integer overflow possible) */
+    return (   p != e && *p++ == '+'
+            && (p = mcdb_input_number(p, e, klen)) != NULL
+            && p != e && *p++ == ','
+            && (p = mcdb_input_number(p, e, dlen)) != NULL
+            && p != e && *p++ == ':'
+            && *klen + *dlen + 3 <= (size_t)(e - p)
+            && p[*klen] == '-' && p[*klen+1] == '>' && p[*klen+2+*dlen] == '\n')
+      ? p
+      : NULL;
+}
+
+/* find probable start of record at or after p (p > start of input) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static const char *
+mcdb_input_resync (const char * restrict p, const char * const restrict e);
+
+static const char *
+mcdb_input_resync (const char * restrict p, const char * const restrict e)
+{
+    size_t klen;
+    size_t dlen;
+    for (--p; (p = memchr(p, '\n', (size_t)(e - p))) != NULL; ) {
+        if (++p == e || mcdb_input_rec(p, e, &klen, &dlen) != NULL)
+            return p;
+    }
+    return e;
+}
+
+/* pass 1: validate records beginning in chunk and sum sizes of records */
+__attribute_nonnull__
+static void
+mcdb_input_scan (const struct mcdb_input_par * const restrict par,
+                 struct mcdb_input_chunk * const restrict c);
+
+static void
+mcdb_input_scan (const struct mcdb_input_par * const restrict par,
+                 struct mcdb_input_chunk * const restrict c)
+{
+    const char * restrict p = c->s;
+    const char * const end = c->end;
+    const char * const e = par->e;
+    const char * restrict k;
+    size_t klen;
+    size_t dlen;
+    size_t sz = 0;
+    size_t n = 0;
+    c->rv = MCDB_INPUT_MORE;
+    while (p < end) {
+        if ((k = mcdb_input_rec(p, e, &klen, &dlen)) != NULL) {
+            sz += 8 + klen + dlen;
+            ++n;
+            p = k + klen + 2 + dlen + 1;
+        }
+        else {
+            c->rv = (*p == '\n') ? EXIT_SUCCESS : MCDB_ERROR_READFORMAT;
+            break;
+        }
+    }
+    c->e  = p;
+    c->sz = sz;
+    c->n  = n;
+}
+
+/* pass 2: copy records in chunk to mcdb and hash keys */
+__attribute_nonnull__
+static void
+mcdb_input_fill (const struct mcdb_input_par * const restrict par,
+                 struct mcdb_input_chunk * const restrict c);
+
+static void
+mcdb_input_fill (const struct mcdb_input_par * const restrict par,
+                 struct mcdb_input_chunk * const restrict c)
+{
+    const char * restrict p = c->s;
+    const char * const e = par->e;
+    const char * restrict k;
+    char * restrict out = c->out;
+    uint32_t * const restrict h = c->h;
+    uint32_t (* const hash_fn)(uint32_t, const void * restrict, size_t) =
+      par->m->hash_fn;
+    const uint32_t hash_init = par->m->hash_init;
+    size_t klen;
+    size_t dlen;
+    for (size_t u = 0, n = c->n; u < n; ++u) {
+        k = mcdb_input_rec(p, e, &klen, &dlen); /*(validated in pass 1)*/
+        uint32_strpack_bigendian_macro(out, klen);
+        uint32_strpack_bigendian_macro(out+4, dlen);
+        memcpy(out+8, k, klen);
+        memcpy(out+8+klen, k+klen+2, dlen);
+        h[u] = (hash_fn == uint32_hash_djb)
+          ? uint32_hash_djb(hash_init, k, klen)
+          : hash_fn(hash_init, k, klen);
+        out += 8 + klen + dlen;
+        p = k + klen + 2 + dlen + 1;
+    }
+}
+
+static void *
+mcdb_input_thread (void * const arg)
+{
+    struct mcdb_input_par * const restrict par = (struct mcdb_input_par *)arg;
+    uint32_t i;
+    while ((i = plasma_atomic_fetch_add_u32(&par->next, 1,
+                                            memory_order_relaxed))
+           < par->nchunks)
+        par->fn(par, par->chunk+i);
+    return NULL;
+}
+
+/* run fn on each chunk with pool of threads (incl. this thread)
+ * (fewer threads are used if thread creation fails) */
+__attribute_nonnull__
+static void
+mcdb_input_run (struct mcdb_input_par * const restrict par,
+                void (*fn)(const struct mcdb_input_par * restrict,
+                           struct mcdb_input_chunk * restrict));
+
+static void
+mcdb_input_run (struct mcdb_input_par * const restrict par,
+                void (*fn)(const struct mcdb_input_par * restrict,
+                           struct mcdb_input_chunk * restrict))
+{
+    pthread_t tid[MCDB_SLOTS];
+    uint32_t n;
+    par->fn   = fn;
+    par->next = 0;
+    for (n = 0; n+1 < par->nthreads; ++n) {
+        if (pthread_create(tid+n, NULL, mcdb_input_thread, par) != 0)
+            break;
+    }
+    (void) mcdb_input_thread(par);
+    while (n)
+        pthread_join(tid[--n], NULL);
+}
+
+__attribute_noinline__
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static int
+mcdb_makefmt_par (struct mcdb_make * const restrict m,
+                  const char * const restrict buf, const size_t bufsz,
+                  const uint32_t nchunks);
+
+static int
+mcdb_makefmt_par (struct mcdb_make * const restrict m,
+                  const char * const restrict buf, const size_t bufsz,
+                  const uint32_t nchunks)
+{
+    struct mcdb_input_par par;
+    struct mcdb_input_chunk * restrict c;
+    const char *p = buf;
+    size_t sz = 0;
+    size_t n = 0;
+    size_t pos;
+    char *out;
+    uint32_t *h;
+    uint32_t i;
+    int rv = MCDB_ERROR_READFORMAT;
+
+    c = m->fn_malloc(nchunks * sizeof(struct mcdb_input_chunk));
+    if (c == NULL)
+        return MCDB_ERROR_MALLOC;
+    par.m        = m;
+    par.chunk    = c;
+    par.e        = buf + bufsz;
+    par.nchunks  = nchunks;
+    par.nthreads = m->nthreads < MCDB_SLOTS ? m->nthreads : MCDB_SLOTS;
+
+    /* split input into chunks at probable record boundaries */
+    c[0].s = buf;
+    for (i = 1; i < nchunks; ++i) {
+        const char * const x = buf + (bufsz / nchunks) * i;
+        c[i].s = c[i-1].end = mcdb_input_resync(x > c[i-1].s ? x : c[i-1].s,
+                                                par.e);
+    }
+    c[nchunks-1].end = par.e;
+
+    /* pass 1: validate records in each chunk and sum sizes */
+    mcdb_input_run(&par, mcdb_input_scan);
+
+    /* check that each chunk begins where prior chunk ends; else parse again */
+    for (i = 0; i < nchunks; ++i) {
+        if (c[i].s != p) {
+            c[i].s = p;
+            mcdb_input_scan(&par, c+i);
+        }
+        sz += c[i].sz;
+        n  += c[i].n;
+        p   = c[i].e;
+        if ((rv = c[i].rv) != MCDB_INPUT_MORE)
+            break;
+    }
+    if (rv == MCDB_INPUT_MORE)  /* no blank line ending input */
+        rv = MCDB_ERROR_READFORMAT;
+    if (rv != EXIT_SUCCESS) {
+        m->fn_free(c);
+        return rv;
+    }
+    par.nchunks = i+1;
+
+    /* pass 2: copy records to mcdb and hash keys */
+    pos = m->pos;
+    if ((h = m->fn_malloc((n ? n : 1) * sizeof(uint32_t))) == NULL) {
+        m->fn_free(c);
+        return MCDB_ERROR_MALLOC;
+    }
+    if ((out = mcdb_make_addreserve(m, sz)) == NULL) {
+        m->fn_free(h);
+        m->fn_free(c);
+        return MCDB_ERROR_WRITE;
+    }
+    for (i = 0; i < par.nchunks; ++i) {
+        c[i].out = out;
+        c[i].h   = h;
+        out += c[i].sz;
+        h   += c[i].n;
+    }
+    mcdb_input_run(&par, mcdb_input_fill);
+
+    /* add hashes in order of records in mcdb */
+    h = c[0].h;
+    out = c[0].out;
+    for (size_t u = 0; u < n; ++u) {
+        const uint32_t klen = uint32_strunpack_bigendian_macro(out);
+        const uint32_t dlen = uint32_strunpack_bigendian_macro(out+4);
+        if (mcdb_make_addhash(m, pos, klen, h[u]) != 0) {
+            rv = MCDB_ERROR_WRITE;
+            break;
+        }
+        pos += 8 + klen + dlen;
+        out += 8 + klen + dlen;
+    }
+
+    m->fn_free(h);
+    m->fn_free(c);
+    return rv;
+}
+
+#endif /* _THREAD_SAFE */
+
+
 __attribute_noinline__
 int
-mcdb_makefmt_fdintofd (const int inputfd,
+mcdb_makefmt_fdintomk (struct mcdb_make * const restrict m,
+                       const int inputfd,
                        char * const restrict buf,
-                       const size_t bufsz,
-                       const int outputfd,
-                       void * (* const fn_malloc)(size_t),
-                       void (* const fn_free)(void *))
+                       const size_t bufsz)
 {
     struct mcdb_input b = { buf, 0, 0, bufsz, inputfd };
-    struct mcdb_make m;
     size_t klen;
     size_t dlen;
     int rv;
 
     errno = 0;
 
-    if (mcdb_make_start(&m, outputfd, fn_malloc, fn_free) == -1)
-        return MCDB_ERROR_WRITE;
-
     if (b.fd == -1)  /* we use fd == -1 as flag for mmap */
         b.datasz = b.bufsz;
 
+  #ifdef _THREAD_SAFE
+    /* parse input in mmap with multiple threads (chunks at least 4 KB) */
+    if (b.fd == -1 && m->nthreads > 1 && (b.bufsz >> 13) != 0) {
+        const uint32_t nchunks =
+          (m->nthreads < MCDB_SLOTS ? m->nthreads : MCDB_SLOTS) << 2;
+        rv = mcdb_makefmt_par(m, b.buf, b.bufsz,
+                              (b.bufsz >> 12) < nchunks
+                                ? (uint32_t)(b.bufsz >> 12)
+                                : nchunks);
+    }
+    else
+  #endif
     while ((rv = mcdb_bufread_preamble(&b,&klen,&dlen)) > 0) {
 
         /* optimized frequent path: entire data line buffered and available */
@@ -279,15 +634,15 @@ mcdb_makefmt_fdintofd (const int inputfd,
         if (klen + dlen + 3 <= b.datasz - b.pos) {
             const char * const p = b.buf + b.pos;
             if (p[klen] == '-' && p[klen+1] == '>' && p[klen+2+dlen] == '\n') {
-                if (mcdb_make_add_h(&m, p, klen, p+klen+2, dlen) == 0)
+                if (mcdb_make_add_h(m, p, klen, p+klen+2, dlen) == 0)
                     b.pos += klen + dlen + 3;
                 else { rv = MCDB_ERROR_WRITE;      break; }
             } else {   rv = MCDB_ERROR_READFORMAT; break; }
         }
         else { /* entire data line is not buffered; handle in parts */
-            if (mcdb_make_addbegin_h(&m, klen, dlen) == 0) {
-                if (mcdb_bufread_rec(&m, klen, dlen, &b))
-                    mcdb_make_addend_h(&m);
+            if (mcdb_make_addbegin_h(m, klen, dlen) == 0) {
+                if (mcdb_bufread_rec(m, klen, dlen, &b))
+                    mcdb_make_addend_h(m);
                 else { rv = MCDB_ERROR_READFORMAT; break; }
             } else {   rv = MCDB_ERROR_WRITE;      break; }
         }
@@ -295,13 +650,153 @@ mcdb_makefmt_fdintofd (const int inputfd,
     }
 
     if (rv == EXIT_SUCCESS)
-        return (mcdb_make_finish(&m) == 0) ? EXIT_SUCCESS : MCDB_ERROR_WRITE;
+        return (mcdb_make_finish(m) == 0) ? EXIT_SUCCESS : MCDB_ERROR_WRITE;
+    else {
+        mcdb_make_destroy(m);
+        return rv;
+    }
+}
+
+__attribute_noinline__
+int
+mcdb_makefmt_fdintoshards (struct mcdb_shardset_make * const restrict s,
+                           const int inputfd,
+                           char * const restrict buf,
+                           const size_t bufsz)
+{
+    struct mcdb_input b = { buf, 0, 0, bufsz, inputfd };
+    struct mcdb_make * restrict m;
+    size_t klen;
+    size_t dlen;
+    int rv;
+
+    errno = 0;
+
+    if (b.fd == -1)  /* we use fd == -1 as flag for mmap */
+        b.datasz = b.bufsz;
+
+    while ((rv = mcdb_bufread_preamble(&b,&klen,&dlen)) > 0) {
+
+        /* optimized frequent path: entire data line buffered and available */
+        /* (klen and dlen checked < INT_MAX-8; no integer overflow possible) */
+        if (klen + dlen + 3 <= b.datasz - b.pos) {
+            const char * const p = b.buf + b.pos;
+            if (p[klen] == '-' && p[klen+1] == '>' && p[klen+2+dlen] == '\n') {
+                if (mcdb_shardset_make_add(s, p, klen, p+klen+2, dlen) == 0)
+                    b.pos += klen + dlen + 3;
+                else { rv = MCDB_ERROR_WRITE;      break; }
+            } else {   rv = MCDB_ERROR_READFORMAT; break; }
+            continue;
+        }
+
+        /* entire data line is not buffered; handle in parts
+         * (entire key must be buffered to route record to shard) */
+        if (b.datasz - b.pos < klen) {
+            if (klen > b.bufsz || b.fd == -1) {
+                rv = MCDB_ERROR_READFORMAT;
+                break;
+            }
+            if (b.pos != 0) {
+                if ((b.datasz -= b.pos))
+                    memmove(b.buf, b.buf + b.pos, b.datasz);
+                b.pos = 0;
+            }
+            if (!mcdb_bufread_xchars(&b, klen)) {
+                rv = (errno == 0) ? MCDB_ERROR_READFORMAT : MCDB_ERROR_READ;
+                break;
+            }
+        }
+        m = s->mk + mcdb_shardset_make_shard(s, b.buf + b.pos, klen);
+        if (mcdb_make_addbegin_h(m, klen, dlen) == 0) {
+            if (mcdb_bufread_rec(m, klen, dlen, &b))
+                mcdb_make_addend_h(m);
+            else { rv = MCDB_ERROR_READFORMAT; break; }
+        } else {   rv = MCDB_ERROR_WRITE;      break; }
+
+    }
+
+    if (rv == EXIT_SUCCESS)
+        return (mcdb_shardset_make_finish(s, true) == 0)
+          ? EXIT_SUCCESS
+          : MCDB_ERROR_WRITE;
+    return rv;
+}
+
+__attribute_noinline__
+int
+mcdb_makefmt_binintomk (struct mcdb_make * const restrict m,
+                        const int inputfd,
+                        char * const restrict buf,
+                        const size_t bufsz,
+                        const enum mcdb_makefmt_bin fmt)
+{
+    struct mcdb_input b = { buf, 0, 0, bufsz, inputfd };
+    size_t klen;
+    size_t dlen;
+    int rv = EXIT_SUCCESS;
+
+    if (b.fd == -1)  /* we use fd == -1 as flag for mmap */
+        b.datasz = b.bufsz;
+
+    for (;;) {
+        if (b.datasz - b.pos < 8) {
+            errno = 0;
+            if (!mcdb_bufread_xchars(&b, 8)) {
+                if (b.datasz != b.pos || errno != 0)  /* partial record */
+                    rv = (errno == 0) ? MCDB_ERROR_READFORMAT : MCDB_ERROR_READ;
+                break;
+            }
+        }
+        klen = mcdb_bufread_binlen(b.buf + b.pos,     fmt);
+        dlen = mcdb_bufread_binlen(b.buf + b.pos + 4, fmt);
+        if (klen > INT_MAX-8 || dlen > INT_MAX-8) {
+            rv = MCDB_ERROR_READFORMAT;
+            break;
+        }
+        b.pos += 8;
+
+        /* optimized frequent path: entire record buffered and available
+         * (always, if input is mmap); add directly from buffer (no copy) */
+        /* (klen and dlen checked < INT_MAX-8; no integer overflow possible) */
+        if (klen + dlen <= b.datasz - b.pos) {
+            const char * const p = b.buf + b.pos;
+            if (mcdb_make_add_h(m, p, klen, p+klen, dlen) == 0)
+                b.pos += klen + dlen;
+            else { rv = MCDB_ERROR_WRITE;      break; }
+        }
+        else { /* entire record is not buffered; handle in parts */
+            if (mcdb_make_addbegin_h(m, klen, dlen) == 0) {
+                if (   mcdb_bufread_str(&b, klen, m, mcdb_make_addbuf_key_h)
+                    && mcdb_bufread_str(&b, dlen, m, mcdb_make_addbuf_data_h))
+                    mcdb_make_addend_h(m);
+                else { rv = MCDB_ERROR_READFORMAT; break; }
+            } else {   rv = MCDB_ERROR_WRITE;      break; }
+        }
+    }
+
+    if (rv == EXIT_SUCCESS)
+        return (mcdb_make_finish(m) == 0) ? EXIT_SUCCESS : MCDB_ERROR_WRITE;
     else {
-        mcdb_make_destroy(&m);
+        mcdb_make_destroy(m);
         return rv;
     }
 }
 
+__attribute_noinline__
+int
+mcdb_makefmt_fdintofd (const int inputfd,
+                       char * const restrict buf,
+                       const size_t bufsz,
+                       const int outputfd,
+                       void * (* const fn_malloc)(size_t),
+                       void (* const fn_free)(void *))
+{
+    struct mcdb_make m;
+    return (mcdb_make_start(&m, outputfd, fn_malloc, fn_free) == 0)
+      ? mcdb_makefmt_fdintomk(&m, inputfd, buf, bufsz)
+      : MCDB_ERROR_WRITE;
+}
+
 /* Examples:
  * - read from stdin:
  *     mcdb_makefmt_fdintofile(STDIN_FILENO,buf,BUFSZ,"fname.cdb",malloc,free);
@@ -316,6 +811,8 @@ mcdb_makefmt_fdintofd (const int inputfd,
  * Note: mcdb_makefmt_fdintofd() takes args list like mcdb_makefmt_fdintofile()
  * so we do not pass struct mcdb_make to mcdb_makefmt_fdintofd().  No big deal
  * and keeps interface simple for direct callers of mcdb_makefmt_fdintofd().
+ * Callers needing to configure struct mcdb_make (e.g. hash function) after
+ * mcdb_make_start() may call mcdb_makefmt_fdintomk() instead.
  */
 __attribute_noinline__
 int
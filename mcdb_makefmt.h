@@ -34,6 +34,9 @@ PLASMA_ATTR_Pragma_once
 extern "C" {
 #endif
 
+struct mcdb_make;
+struct mcdb_shardset_make;
+
 /* Note: ensure output file is open() O_RDWR if calling mcdb_makefmt_fdintofd()
  * or else mmap() may fail.
  * Note: caller of mcdb_makefmt_fdintofd() should choose whether or not to then
@@ -45,6 +48,42 @@ EXPORT extern int
 mcdb_makefmt_fdintofd (int, char * restrict, size_t,
                        int, void * (*)(size_t), void (*)(void *));
 
+/* parse input into struct mcdb_make (already initialized with mcdb_make_start)
+ * and then mcdb_make_finish() (or mcdb_make_destroy() upon error)
+ * (input in memory (fd -1) is parsed by m->nthreads threads if m->nthreads > 1)
+ */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_makefmt_fdintomk (struct mcdb_make * restrict, int, char * restrict,size_t);
+
+/* parse input into shard set (already initialized with
+ * mcdb_shardset_make_start(); see mcdb_makefn.h), routing each record to its
+ * shard, and then mcdb_shardset_make_finish()
+ * (caller calls mcdb_shardset_make_cleanup() whether successful or not)
+ * (key of record split across reads from fd must fit in buf to be routed) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_makefmt_fdintoshards (struct mcdb_shardset_make * restrict, int,
+                           char * restrict, size_t);
+
+/* binary input format (alternative to cdb text format; see mcdb_makefmt.c):
+ * each record is 4-byte key len, 4-byte data len, key, data (no separators)
+ * Parse binary input into struct mcdb_make (already initialized with
+ * mcdb_make_start) and then mcdb_make_finish() (or mcdb_make_destroy() upon
+ * error).  Input in memory (fd -1) is added directly from memory (no copy). */
+enum mcdb_makefmt_bin {
+  MCDB_MAKEFMT_BIN_NATIVE = 0,  /* lens in native byte order */
+  MCDB_MAKEFMT_BIN_BE     = 1   /* lens big-endian (records as in mcdb) */
+};
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_makefmt_binintomk (struct mcdb_make * restrict, int, char * restrict,
+                        size_t, enum mcdb_makefmt_bin);
+
 __attribute_nonnull__
 __attribute_warn_unused_result__
 EXPORT extern int
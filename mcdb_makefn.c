@@ -37,10 +37,18 @@
 #include "mcdb_makefn.h"
 #include "mcdb_make.h"
 #include "mcdb_error.h"
+#include "mcdb.h"
 #include "nointr.h"
+#include "uint32.h"
+#include "plasma/plasma_atomic.h"
 #include "plasma/plasma_stdtypes.h"
+#ifdef _THREAD_SAFE
+#include <pthread.h>
+#endif
 
 #include <errno.h>
+#include <fcntl.h>     /* open() */
+#include <sys/mman.h>  /* mmap() munmap() */
 #include <sys/stat.h>  /* fchmod() umask() */
 #include <stdlib.h>    /* mkstemp() EXIT_SUCCESS */
 #include <string.h>    /* memcpy() strlen() */
@@ -64,8 +72,11 @@ mcdb_makefn_start (struct mcdb_make * const restrict m,
     char * restrict fntmp;
 
     m->head[0] = NULL;
+    m->sub     = NULL;
+    m->spill   = NULL;
     m->fntmp   = NULL;
     m->fd      = -1;
+    m->gen_errno = 0;
 
     /* preserve permission modes if previous mcdb exists; else make read-only
      * (since mcdb is *constant* -- not modified -- after creation) */
@@ -113,15 +124,83 @@ mcdb_makefn_start (struct mcdb_make * const restrict m,
     }
 }
 
+/* open (or create) generation sidecar file <fname>.gen and mmap 64-bit
+ * generation number (stored in native byte order in first 8 bytes of file).
+ * Sidecar is modified in place (never replaced) since readers keep it mmap'd*/
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static uint64_t *
+mcdb_makefn_genmap (struct mcdb_make * const restrict m, const int oflags);
+
+static uint64_t *
+mcdb_makefn_genmap (struct mcdb_make * const restrict m, const int oflags)
+{
+    struct stat st;
+    void *p = MAP_FAILED;
+    const size_t len = strlen(m->fname);
+    char * const restrict fngen = m->fn_malloc(len+5);
+    int fd;
+    if (fngen == NULL)
+        return NULL;
+    memcpy(fngen, m->fname, len);
+    memcpy(fngen+len, ".gen", 5);
+    /* sidecar writable by owner and readable by those who can read mcdb */
+    fd = nointr_open(fngen, oflags | O_RDWR | O_CLOEXEC,
+                     (m->st_mode & (S_IRUSR|S_IRGRP|S_IROTH)) | S_IWUSR);
+    m->fn_free(fngen);
+    if (fd == -1)
+        return NULL;
+    if (fstat(fd, &st) == 0
+        && (st.st_size >= (off_t)sizeof(uint64_t)
+            || nointr_ftruncate(fd, (off_t)sizeof(uint64_t)) == 0))
+        p = mmap(0, sizeof(uint64_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    (void) nointr_close(fd);
+    return (p != MAP_FAILED) ? (uint64_t *)p : NULL;
+}
+
+int
+mcdb_makefn_gencreate (struct mcdb_make * const restrict m)
+{
+    uint64_t * const gen = mcdb_makefn_genmap(m, O_CREAT);
+    if (gen == NULL)
+        return -1;
+    munmap(gen, sizeof(uint64_t));
+    return EXIT_SUCCESS;
+}
+
+/* increment generation number in sidecar file, if sidecar exists
+ * (after rename() of new mcdb so that readers observing new generation number
+ *  open new mcdb) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static int
+mcdb_makefn_genincr (struct mcdb_make * const restrict m);
+
+static int
+mcdb_makefn_genincr (struct mcdb_make * const restrict m)
+{
+    uint64_t * const gen = mcdb_makefn_genmap(m, 0);
+    if (gen == NULL)
+        return (errno == ENOENT) ? EXIT_SUCCESS : -1;
+    plasma_atomic_fetch_add_u64(gen, 1, memory_order_release);
+    munmap(gen, sizeof(uint64_t));
+    return EXIT_SUCCESS;
+}
+
 int
 mcdb_makefn_finish (struct mcdb_make * const restrict m, const bool datasync)
 {
-    return fchmod(m->fd, m->st_mode) == 0
+    if (fchmod(m->fd, m->st_mode) == 0
         && (!datasync || fdatasync(m->fd) == 0)
         && nointr_close(m->fd) == 0     /* NFS might report write errors here */
-        && (m->fd = -2, rename(m->fntmp, m->fname) == 0) /*(fd=-2 flag closed)*/
-      ? (m->fd = -1, EXIT_SUCCESS)
-      : -1;
+        && (m->fd = -2, rename(m->fntmp, m->fname) == 0)) {/*(fd=-2 closed)*/
+        /* new mcdb is in place once renamed; failure to increment generation
+         * sidecar is not failure to make mcdb (see mcdb_makefn_gen_failed()) */
+        m->fd = -1;
+        m->gen_errno = (mcdb_makefn_genincr(m) == 0) ? 0 : errno;
+        return EXIT_SUCCESS;
+    }
+    return -1;
     /* mcdb_makefn_cleanup() is not called unconditionally here since fsync
      * may take a long time and contrib/python-mcdb/ releases a global lock
      * around call to mcdb_makefn_finish().  However, Python global lock must
@@ -147,3 +226,311 @@ mcdb_makefn_cleanup (struct mcdb_make * const restrict m)
         errno = errsave;
     return -1;
 }
+
+
+/* shard set (see mcdb_makefn.h and struct mcdb_shardset in mcdb.h)
+ * Each shard is built in its own mkstemp() file <fname>.<i>.XXXXXX, which is
+ * not renamed; the (unique) temp name is the name of the shard recorded in the
+ * new manifest, and rename() of manifest atomically replaces entire set. */
+
+int
+mcdb_shardset_make_start (struct mcdb_shardset_make * const restrict s,
+                          const char * const restrict fname, const uint32_t n,
+                          void * (* const fn_malloc)(size_t),
+                          void (* const fn_free)(void *))
+{
+    struct stat st;
+    const size_t len = strlen(fname);
+    char * restrict fnshard;
+
+    s->mk        = NULL;
+    s->n         = 0;
+    s->nthreads  = 1;
+    s->fname     = fname;
+    s->fn_malloc = fn_malloc;
+    s->fn_free   = fn_free;
+
+    if (n == 0 || n > MCDB_SHARDS_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* shards have same permission modes as manifest */
+    if (stat(fname, &st) != 0) {
+        st.st_mode = S_IRUSR;
+        if (errno != ENOENT)
+            return -1;
+    }
+
+    fnshard = fn_malloc(len + 12);
+    if (fnshard == NULL)
+        return -1;
+    s->mk = fn_malloc(n * sizeof(struct mcdb_make));
+    if (s->mk == NULL) {
+        fn_free(fnshard);
+        return -1;
+    }
+    memcpy(fnshard, fname, len);
+    fnshard[len] = '.';
+
+    /* (s->n counts shards started; mcdb_shardset_make_cleanup() cleans up) */
+    for (; s->n < n; ++s->n) {
+        struct mcdb_make * const restrict m = s->mk + s->n;
+        fnshard[len+1+uint32_to_ascii_base10(s->n, fnshard+len+1)] = '\0';
+        if (mcdb_makefn_start(m, fnshard, fn_malloc, fn_free) != 0)
+            break;
+        m->st_mode = st.st_mode;
+        if (mcdb_make_start(m, m->fd, fn_malloc, fn_free) != 0) {
+            mcdb_makefn_cleanup(m);
+            break;
+        }
+    }
+    fn_free(fnshard);
+    return (s->n == n) ? EXIT_SUCCESS : -1;
+}
+
+uint32_t
+mcdb_shardset_make_shard (const struct mcdb_shardset_make * const restrict s,
+                          const char * const restrict key, const size_t klen)
+{
+    /* (all shards have same hash func; see mcdb_shardset_findtagstart()) */
+    const struct mcdb_make * const restrict m = s->mk;
+    return mcdb_shard_index(m->hash_fn(m->hash_init, key, klen), s->n);
+}
+
+int
+mcdb_shardset_make_add (struct mcdb_shardset_make * const restrict s,
+                        const char * const restrict key, const size_t klen,
+                        const char * const restrict data, const size_t dlen)
+{
+    /* hash key once to route record to shard and to add hash to shard index*/
+    struct mcdb_khash kh;
+    kh.hash_fn   = s->mk->hash_fn;
+    kh.hash_init = s->mk->hash_init;
+    kh.khash     = kh.hash_fn(kh.hash_init, key, klen);
+    return mcdb_make_add_hashed(s->mk + mcdb_shard_index(kh.khash, s->n),
+                                key, klen, data, dlen, &kh);
+}
+
+/* finish shard; shard is not renamed (see above) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static int
+mcdb_shardset_make_finish_shard (struct mcdb_make * const restrict m,
+                                 const bool datasync);
+
+static int
+mcdb_shardset_make_finish_shard (struct mcdb_make * const restrict m,
+                                 const bool datasync)
+{
+    return mcdb_make_finish(m) == 0
+        && fchmod(m->fd, m->st_mode) == 0
+        && (!datasync || fdatasync(m->fd) == 0)
+        && nointr_close(m->fd) == 0     /* NFS might report write errors here */
+        && (m->fd = -2, true)           /*(fd=-2 flag closed)*/
+      ? EXIT_SUCCESS
+      : -1;
+}
+
+struct mcdb_shardset_make_par {
+  struct mcdb_shardset_make *s;
+  int *err;                    /* errno from each shard (0 if success) */
+  uint32_t next;               /* next shard (atomic counter) */
+  bool datasync;
+};
+
+__attribute_nonnull__
+static void *
+mcdb_shardset_make_par_thread (void * const arg);
+
+static void *
+mcdb_shardset_make_par_thread (void * const arg)
+{
+    struct mcdb_shardset_make_par * const restrict par =
+      (struct mcdb_shardset_make_par *)arg;
+    uint32_t i;
+  #ifdef _THREAD_SAFE
+    while ((i = plasma_atomic_fetch_add_u32(&par->next, 1,
+                                            memory_order_relaxed)) < par->s->n)
+  #else
+    while ((i = par->next++) < par->s->n)
+  #endif
+    {
+        errno = 0;
+        par->err[i] =
+          mcdb_shardset_make_finish_shard(par->s->mk+i, par->datasync) == 0
+            ? 0
+            : (errno != 0 ? errno : EIO);
+    }
+    return NULL;
+}
+
+/* finish shards with pool of s->nthreads threads (incl. this thread)
+ * (fewer threads are used if thread creation fails) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static int
+mcdb_shardset_make_par_run (struct mcdb_shardset_make * const restrict s,
+                            const bool datasync);
+
+static int
+mcdb_shardset_make_par_run (struct mcdb_shardset_make * const restrict s,
+                            const bool datasync)
+{
+    struct mcdb_shardset_make_par par;
+    int rc = EXIT_SUCCESS;
+    par.s        = s;
+    par.next     = 0;
+    par.datasync = datasync;
+    par.err      = s->fn_malloc(s->n * sizeof(int));
+    if (par.err == NULL)
+        return -1;
+  #ifdef _THREAD_SAFE
+    {
+        pthread_t tid[MCDB_SLOTS];
+        uint32_t nthreads = s->nthreads < s->n ? s->nthreads : s->n;
+        uint32_t n;
+        if (nthreads > MCDB_SLOTS)
+            nthreads = MCDB_SLOTS;
+        for (n = 0; n+1 < nthreads; ++n) {
+            if (pthread_create(tid+n, NULL,
+                               mcdb_shardset_make_par_thread, &par) != 0)
+                break;
+        }
+        (void) mcdb_shardset_make_par_thread(&par);
+        while (n)
+            pthread_join(tid[--n], NULL);
+    }
+  #else
+    (void) mcdb_shardset_make_par_thread(&par);
+  #endif
+    for (uint32_t i = 0; i < s->n; ++i) {
+        if (par.err[i] != 0) {
+            errno = par.err[i];
+            rc = -1;
+            break;
+        }
+    }
+    s->fn_free(par.err);
+    return rc;
+}
+
+/* remove shards named in previous manifest (replaced by new manifest) */
+__attribute_nonnull__
+static void
+mcdb_shardset_make_unlink (struct mcdb_shardset_make * const restrict s,
+                           struct mcdb_mmap * const restrict map);
+
+static void
+mcdb_shardset_make_unlink (struct mcdb_shardset_make * const restrict s,
+                           struct mcdb_mmap * const restrict map)
+{
+    struct mcdb_iter iter;
+    const char * const slash = strrchr(s->fname, '/');
+    const size_t dlen = (slash != NULL) ? (size_t)(slash - s->fname + 1) : 0;
+    mcdb_iter_init(&iter, &(struct mcdb){ .map = map });
+    while (mcdb_iter(&iter)) {
+        const char * const name = (char *)mcdb_iter_dataptr(&iter);
+        const size_t len = mcdb_iter_datalen(&iter);
+        char * restrict fname;
+        if (mcdb_iter_keylen(&iter) == 1 && *mcdb_iter_keyptr(&iter) == 'n')
+            continue; /* (shard count; not a shard) */
+        if (len == 0 || memchr(name, '/', len) || memchr(name, '\0', len))
+            continue;
+        if ((fname = s->fn_malloc(dlen + len + 1)) == NULL)
+            continue;
+        memcpy(fname, s->fname, dlen);
+        memcpy(fname+dlen, name, len);
+        fname[dlen+len] = '\0';
+        (void) unlink(fname);
+        s->fn_free(fname);
+    }
+}
+
+int
+mcdb_shardset_make_finish (struct mcdb_shardset_make * const restrict s,
+                           const bool datasync)
+{
+    struct mcdb_make mk;
+    struct mcdb_mmap *prev;
+    const struct mcdb_make * const restrict mk0 = s->mk;
+    char num[10];
+    int rc;
+
+    for (uint32_t i = 1; i < s->n; ++i) {
+        if (s->mk[i].hash_id   != mk0->hash_id
+         || s->mk[i].hash_init != mk0->hash_init
+         || s->mk[i].hash_fn   != mk0->hash_fn) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < s->n; ++i) {
+        if (s->mk[i].flags & (MCDB_HDR_DELTA|MCDB_HDR_SHARDSET)) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    if (mcdb_shardset_make_par_run(s, datasync) != 0)
+        return -1;
+
+    /* manifest: key "n" is num shards; key decimal i is name of shard i */
+    if (mcdb_makefn_start(&mk, s->fname, s->fn_malloc, s->fn_free) != 0)
+        return mcdb_makefn_cleanup(&mk);
+    if (mcdb_make_start(&mk, mk.fd, s->fn_malloc, s->fn_free) != 0)
+        return mcdb_makefn_cleanup(&mk);
+    mk.flags = MCDB_HDR_SHARDSET;
+    rc = mcdb_make_add(&mk, "n", 1, num, uint32_to_ascii_base10(s->n, num));
+    for (uint32_t i = 0; rc == 0 && i < s->n; ++i) {
+        const char * const fntmp = s->mk[i].fntmp;
+        const char * const slash = strrchr(fntmp, '/');
+        const char * const name  = (slash != NULL) ? slash+1 : fntmp;
+        rc = mcdb_make_add(&mk, num, uint32_to_ascii_base10(i, num),
+                           name, strlen(name));
+    }
+    if (rc != 0) {
+        mcdb_make_destroy(&mk);
+        return mcdb_makefn_cleanup(&mk);
+    }
+
+    /* (previous manifest, if any, is mapped to remove its shards after
+     *  new manifest replaces it) */
+    prev = mcdb_mmap_create(NULL, NULL, s->fname, s->fn_malloc, s->fn_free);
+    if (prev != NULL && !(prev->flags & MCDB_HDR_SHARDSET)) {
+        mcdb_mmap_destroy(prev);
+        prev = NULL;
+    }
+
+    rc = (mcdb_make_finish(&mk) == 0 && mcdb_makefn_finish(&mk, datasync) == 0)
+      ? EXIT_SUCCESS
+      : -1;
+    mcdb_makefn_cleanup(&mk);
+    if (rc == EXIT_SUCCESS) {
+        for (uint32_t i = 0; i < s->n; ++i)
+            s->mk[i].fd = -1;  /* keep shards (named in new manifest) */
+        if (prev != NULL)
+            mcdb_shardset_make_unlink(s, prev);
+    }
+    if (prev != NULL)
+        mcdb_mmap_destroy(prev);
+    return rc;
+}
+
+int
+mcdb_shardset_make_cleanup (struct mcdb_shardset_make * const restrict s)
+{
+    const int errsave = errno;
+    if (s->mk != NULL) {
+        for (uint32_t i = 0; i < s->n; ++i) {
+            mcdb_make_destroy(s->mk+i);
+            mcdb_makefn_cleanup(s->mk+i);
+        }
+        s->fn_free(s->mk);
+        s->mk = NULL;
+    }
+    s->n = 0;
+    if (errsave != 0)
+        errno = errsave;
+    return -1;
+}
@@ -51,6 +51,73 @@ __attribute_nonnull__
 EXPORT extern int
 mcdb_makefn_cleanup (struct mcdb_make * restrict);
 
+/* create generation sidecar file <fname>.gen next to mcdb, if not present
+ * (call after mcdb_makefn_start()).  If sidecar exists, mcdb_makefn_finish()
+ * increments the 64-bit generation number in sidecar after mcdb is renamed
+ * into place, and readers may detect update with a memory load (see
+ * mcdb_mmap_watch() MCDB_WATCH_GENERATION in mcdb.h) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_makefn_gencreate (struct mcdb_make * restrict);
+
+/* true if mcdb_makefn_finish() succeeded but failed to increment generation
+ * sidecar (errno of failure in m->gen_errno).  Generation is incremented after rename() (not before,
+ * which would let readers reopen the old mcdb and miss the new one), so new
+ * mcdb is already in place and mcdb_makefn_finish() returns EXIT_SUCCESS;
+ * readers watching sidecar detect update at next increment or by stat() */
+#define mcdb_makefn_gen_failed(m) ((m)->gen_errno != 0)
+
+/* build shard set (see struct mcdb_shardset in mcdb.h): n shards, each built
+ * by its own struct mcdb_make s->mk[i], and manifest <fname> naming shards.
+ * After mcdb_shardset_make_start(), caller may set build options of each
+ * s->mk[i] (the same hash func for all shards, set before adding records),
+ * and s->nthreads (num shards finished concurrently).
+ * mcdb_shardset_make_add() routes record to shard.  Alternatively, threads
+ * may each add records of a different shard i (mcdb_shardset_make_shard())
+ * directly to s->mk[i] with mcdb_make_add(), since builders are independent.
+ * mcdb_shardset_make_finish() finishes shards (new, uniquely named files),
+ * then atomically replaces manifest, and then removes shards of previous
+ * manifest.  mcdb_shardset_make_cleanup() releases resources (and removes
+ * shards if not finished). */
+struct mcdb_shardset_make {
+  struct mcdb_make *mk;        /* builder of each shard */
+  uint32_t n;                  /* num shards */
+  uint32_t nthreads;           /* num shards finished concurrently */
+  const char *fname;           /* manifest */
+  void * (*fn_malloc)(size_t); /* fn ptr to malloc() */
+  void (*fn_free)(void *);     /* fn ptr to free() */
+};
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_shardset_make_start (struct mcdb_shardset_make * restrict,
+                          const char * restrict, uint32_t,
+                          void * (*)(size_t), void (*)(void *));
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern uint32_t
+mcdb_shardset_make_shard (const struct mcdb_shardset_make * restrict,
+                          const char * restrict, size_t);
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_shardset_make_add (struct mcdb_shardset_make * restrict,
+                        const char * restrict, size_t,
+                        const char * restrict, size_t);
+
+__attribute_nonnull__
+__attribute_warn_unused_result__
+EXPORT extern int
+mcdb_shardset_make_finish (struct mcdb_shardset_make * restrict, const bool);
+
+__attribute_nonnull__
+EXPORT extern int
+mcdb_shardset_make_cleanup (struct mcdb_shardset_make * restrict);
+
 #ifdef __cplusplus
 }
 #endif
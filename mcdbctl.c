@@ -42,6 +42,7 @@
 
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>   /* open(), O_RDONLY */
 #include <stdio.h>   /* printf() */
 #include <stdlib.h>  /* malloc(), free(), EXIT_SUCCESS */
@@ -120,19 +121,25 @@ writev_loop(const int fd, struct iovec * restrict iov, int iovcnt, ssize_t sz)
     return (iovcnt == 0);
 }
 
-/* read and dump data section of mcdb */
-__attribute_nonnull__
+/* read and dump data section of mcdb (or of mcdb_overlay o, if not NULL) */
+__attribute_nonnull_x__((1))
 __attribute_warn_unused_result__
 static int
-mcdbctl_dump(struct mcdb * const restrict m);
+mcdbctl_dump(struct mcdb * const restrict m,
+             struct mcdb_overlay * const restrict o);
 
 static int
-mcdbctl_dump(struct mcdb * const restrict m)
+mcdbctl_dump(struct mcdb * const restrict m,
+             struct mcdb_overlay * const restrict o)
 {
+    struct mcdb_overlay_iter oiter;
     struct mcdb_iter iter;
+    struct mcdb_iter * const it = (o == NULL) ? &iter : &oiter.iter;
     uint32_t klen;
     uint32_t dlen;
-    unsigned char *mark = mcdb_madv_initmark(m->map->ptr, m->map->size, 0);
+    unsigned char *mark = o == NULL   /* (no madvise hints across two maps) */
+      ? mcdb_madv_initmark(m->map->ptr, m->map->size, 0)
+      : (unsigned char *)~(uintptr_t)0;
     int    iovcnt = 0;
     size_t iovlen = 0;
     size_t buflen = 0;             /* _XOPEN_IOV_MAX minimum is 16 */
@@ -144,10 +151,12 @@ mcdbctl_dump(struct mcdb * const restrict m)
     mcdb_iter_init(&iter, m);
     posix_madvise(iter.map, (size_t)(iter.eod - (unsigned char *)iter.map),
                   POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
-    while (mcdb_iter(&iter)) {
+    if (o != NULL)
+        mcdb_overlay_iter_init(&oiter, o);
+    while (o == NULL ? mcdb_iter(&iter) : mcdb_overlay_iter(&oiter)) {
 
-        klen = mcdb_iter_keylen(&iter);
-        dlen = mcdb_iter_datalen(&iter);
+        klen = mcdb_iter_keylen(it);
+        dlen = mcdb_iter_datalen(it);
 
         /* avoid printf("%.*s\n",...) due to mcdb arbitrary binary data */
         /* klen, dlen each limited to (2GB - 8); space for extra tokens exists*/
@@ -157,7 +166,7 @@ mcdbctl_dump(struct mcdb * const restrict m)
             iovcnt = 0;
             iovlen = 0;
             buflen = 0;
-            mcdb_madv_dontneed(iter.ptr, mark); /*hint to release memory pages*/
+            mcdb_madv_dontneed(it->ptr, mark); /*hint to release memory pages*/
         }
 
         iov[iovcnt].iov_base = "+";
@@ -180,7 +189,7 @@ mcdbctl_dump(struct mcdb * const restrict m)
         iov[iovcnt].iov_len  = 1;
         ++iovcnt;
 
-        iov[iovcnt].iov_base = mcdb_iter_keyptr(&iter);
+        iov[iovcnt].iov_base = mcdb_iter_keyptr(it);
         iov[iovcnt].iov_len  = klen;
         ++iovcnt;
 
@@ -196,10 +205,10 @@ mcdbctl_dump(struct mcdb * const restrict m)
             iovcnt = 0;
             iovlen = 0;
             buflen = 0;
-            mcdb_madv_dontneed(iter.ptr, mark); /*hint to release memory pages*/
+            mcdb_madv_dontneed(it->ptr, mark); /*hint to release memory pages*/
         }
 
-        iov[iovcnt].iov_base = mcdb_iter_dataptr(&iter);
+        iov[iovcnt].iov_base = mcdb_iter_dataptr(it);
         iov[iovcnt].iov_len  = dlen;
         ++iovcnt;
 
@@ -231,7 +240,7 @@ mcdbctl_stats(struct mcdb * const restrict m)
     uintptr_t iter_dpos;
     char *k;
     unsigned char *mark = mcdb_madv_initmark(m->map->ptr, m->map->size,
-                                             MCDB_HEADER_SZ);
+                                             m->map->data);
     unsigned long nrec = 0;
     unsigned long numd[11] = { 0,0,0,0,0,0,0,0,0,0,0 };
     int rv;
@@ -250,7 +259,7 @@ mcdbctl_stats(struct mcdb * const restrict m)
         iter_dpos = (uintptr_t)mcdb_iter_datapos(&iter);
         if ((rc = mcdb_findstart(m, k, mcdb_iter_keylen(&iter)))) {
             do { rc = mcdb_findnext(m, k, mcdb_iter_keylen(&iter));
-            } while (rc && mcdb_datapos(m) != iter_dpos);
+            } while (rc && mcdb_recdatapos(m) != iter_dpos);
         }
         if (!rc) return MCDB_ERROR_READFORMAT;
         ++numd[ ((m->loop < 11) ? m->loop - 1 : 10) ];
@@ -264,23 +273,31 @@ mcdbctl_stats(struct mcdb * const restrict m)
     return EXIT_SUCCESS;
 }
 
-__attribute_nonnull__
+__attribute_nonnull_x__((1,3))
 __attribute_warn_unused_result__
 static int
-mcdbctl_getseq(struct mcdb * const restrict m,
+mcdbctl_getseq(struct mcdb * restrict m,
+               struct mcdb_overlay * const restrict o,
                const char * const restrict key, unsigned long seq);
 
 static int
-mcdbctl_getseq(struct mcdb * const restrict m,
+mcdbctl_getseq(struct mcdb * restrict m,
+               struct mcdb_overlay * const restrict o,
                const char * const restrict key, unsigned long seq)
 {
     const size_t klen = strlen(key);
     struct iovec iov[2];
-    if (mcdb_findstart(m, key, klen)) {
+    if (o == NULL
+        ? mcdb_findstart(m, key, klen)
+        : mcdb_overlay_findstart(o, key, klen)) {
         bool rc;
-        while ((rc = mcdb_findnext(m, key, klen)) && seq--)
+        while ((rc = (o == NULL
+                      ? mcdb_findnext(m, key, klen)
+                      : mcdb_overlay_findnext(o, key, klen))) && seq--)
             ;
         if (rc) {
+            if (o != NULL)
+                m = o->cur;
             /* avoid printf("%.*s\n",...) due to mcdb arbitrary binary data */
             iov[0].iov_base = mcdb_dataptr(m);
             iov[0].iov_len  = mcdb_datalen(m);
@@ -294,20 +311,26 @@ mcdbctl_getseq(struct mcdb * const restrict m,
     return EXIT_FAILURE;
 }
 
-__attribute_nonnull__
+__attribute_nonnull_x__((1,3))
 __attribute_warn_unused_result__
 static int
-mcdbctl_getall(struct mcdb * const restrict m,
+mcdbctl_getall(struct mcdb * restrict m,
+               struct mcdb_overlay * const restrict o,
                const char * const restrict key);
 
 static int
-mcdbctl_getall(struct mcdb * const restrict m,
+mcdbctl_getall(struct mcdb * restrict m,
+               struct mcdb_overlay * const restrict o,
                const char * const restrict key)
 {
     const size_t klen = strlen(key);
     struct iovec iov[2];
-    if (mcdb_find(m, key, klen)) {
+    if (o == NULL
+        ? mcdb_find(m, key, klen)
+        : mcdb_overlay_find(o, key, klen)) {
         do {
+            if (o != NULL)
+                m = o->cur;
             /* avoid printf("%.*s\n",...) due to mcdb arbitrary binary data */
             iov[0].iov_base = mcdb_dataptr(m);
             iov[0].iov_len  = mcdb_datalen(m);
@@ -315,7 +338,9 @@ mcdbctl_getall(struct mcdb * const restrict m,
             iov[1].iov_len  = 1;
             if (!writev_loop(STDOUT_FILENO,iov,2,(ssize_t)(iov[0].iov_len+1)))
                 return MCDB_ERROR_WRITE;
-        } while (mcdb_findnext(m, key, klen));
+        } while (o == NULL
+                 ? mcdb_findnext(m, key, klen)
+                 : mcdb_overlay_findnext(o, key, klen));
         return EXIT_SUCCESS;
     }
     return EXIT_FAILURE;
@@ -324,13 +349,17 @@ mcdbctl_getall(struct mcdb * const restrict m,
 __attribute_nonnull__
 __attribute_warn_unused_result__
 static int
-mcdbctl_query(const int argc, char ** restrict argv);
+mcdbctl_query(int argc, char ** restrict argv);
 
 static int
-mcdbctl_query(const int argc, char ** restrict argv)
+mcdbctl_query(int argc, char ** restrict argv)
 {
     struct mcdb m;
     struct mcdb_mmap map;
+    struct mcdb_mmap dmap;
+    struct mcdb_overlay o;
+    struct mcdb_shardset s;
+    const char *delta = NULL;
     int rv;
     int fd;
     unsigned long seq = 0;
@@ -338,6 +367,12 @@ mcdbctl_query(const int argc, char ** restrict argv)
            MCDBCTL_DUMP, MCDBCTL_STATS }
       query_type = MCDBCTL_BAD_QUERY_TYPE;
 
+    /* optional delta mcdb layered over mcdb (get, dump) (see mcdb_overlay) */
+    if (((argc == 4 && 0 == strcmp(argv[1], "dump"))
+         || ((argc == 5 || argc == 6) && 0 == strcmp(argv[1], "get")))
+        && 0 == strncmp(argv[argc-1], "delta=", 6))
+        delta = argv[--argc]+6;
+
     /* validate args  (query type string == argv[1]) */
     if (argc > 3 && 0 == strcmp(argv[1], "get")) {
         if (argc == 5) {
@@ -370,21 +405,53 @@ mcdbctl_query(const int argc, char ** restrict argv)
     if (!rv) return MCDB_ERROR_READ;
     memset(&m, '\0', sizeof(m));      /*(not strictly necessary)*/
     m.map = &map;
+    /* get from shard set: manifest routes key to shard (see mcdb_shardset) */
+    memset(&s, '\0', sizeof(s));
+    if ((map.flags & MCDB_HDR_SHARDSET) && query_type != MCDBCTL_DUMP
+        && query_type != MCDBCTL_STATS) {
+        if (!mcdb_shardset_open(&s, argv[2], malloc, free)) {
+            mcdb_mmap_free(&map);
+            return MCDB_ERROR_READ;
+        }
+        /*(sets m.map to shard of key; rv is then set by query below)*/
+        rv = mcdb_shardset_findstart(&s, &m, argv[3], strlen(argv[3]));
+    }
+    if (delta != NULL) {
+        fd = nointr_open(delta, O_RDONLY, 0);
+        memset(&dmap, '\0', sizeof(dmap));  /*(init fn_free, fname)*/
+        rv = (fd != -1 && mcdb_mmap_init(&dmap, fd));
+        if (fd != -1)
+            (void) nointr_close(fd);
+        if (!rv) {
+            mcdb_shardset_close(&s);
+            mcdb_mmap_free(&map);
+            return MCDB_ERROR_READ;
+        }
+        if (!(dmap.flags & MCDB_HDR_DELTA)) {
+            mcdb_mmap_free(&dmap);
+            mcdb_shardset_close(&s);
+            mcdb_mmap_free(&map);
+            return MCDB_ERROR_READFORMAT;
+        }
+        memset(&o, '\0', sizeof(o));
+        o.base.map  = m.map;
+        o.delta.map = &dmap;
+    }
 
     /* run query */
     switch (query_type) {
       case MCDBCTL_GET:
-        rv = mcdbctl_getseq(&m, argv[3], seq);  /* key = argv[3] */
+        rv = mcdbctl_getseq(&m, delta ? &o : NULL, argv[3], seq);
         if (rv == EXIT_FAILURE)
             exit(100); /* not found: exit nonzero without errmsg */
         break;
       case MCDBCTL_GETALL:
-        rv = mcdbctl_getall(&m, argv[3]);       /* key = argv[3] */
+        rv = mcdbctl_getall(&m, delta ? &o : NULL, argv[3]);
         if (rv == EXIT_FAILURE)
             exit(100); /* not found: exit nonzero without errmsg */
         break;
       case MCDBCTL_DUMP:
-        rv = mcdbctl_dump(&m);
+        rv = mcdbctl_dump(&m, delta ? &o : NULL);
         break;
       case MCDBCTL_STATS:
         rv = mcdbctl_stats(&m);
@@ -395,30 +462,205 @@ mcdbctl_query(const int argc, char ** restrict argv)
         break;
     }
 
+    if (delta != NULL)
+        mcdb_mmap_free(&dmap);
+    mcdb_shardset_close(&s);
     mcdb_mmap_free(&map);
     return rv;
 }
 
+/* new mcdb is in place; warn if generation sidecar was not incremented */
+__attribute_nonnull__
+static void
+mcdbctl_gen_check(const struct mcdb_make * const restrict m);
+
+static void
+mcdbctl_gen_check(const struct mcdb_make * const restrict m)
+{
+    if (mcdb_makefn_gen_failed(m))
+        fprintf(stderr, "mcdbctl: warning: %s.gen not incremented: %s\n",
+                m->fname, strerror(m->gen_errno));
+}
+
 __attribute_nonnull__
 __attribute_warn_unused_result__
 static int
-mcdbctl_make(const int argc __attribute_unused__, char ** const restrict argv);
+mcdbctl_make(const int argc, char ** const restrict argv);
 
 static int
-mcdbctl_make(const int argc __attribute_unused__, char ** const restrict argv)
+mcdbctl_make(const int argc, char ** const restrict argv)
 {
-    /* assert(argc == 4); */                   /* must be checked by caller */
+    /* assert(argc >= 4); */                   /* must be checked by caller */
     /* assert(0 == strcmp(argv[1], "make")); *//* must be checked by caller */
     enum { BUFSZ = 65536 }; /* 64 KB buffer size */
+    struct mcdb_make m;
+    struct stat st;
     char * restrict buf = NULL;
+    size_t bufsz = BUFSZ;
+    int fd = STDIN_FILENO;
+    uint32_t hash_id = MCDB_HASH_DJB;
+    uint32_t hash_init;
+    uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t);
+    uint32_t flags = 0;
+    unsigned long slot_bits = MCDB_SLOT_BITS;
+    unsigned long nthreads = 1;
+    unsigned long membudget = 0;
+    unsigned long sizehint = 0;
+    unsigned long nshards = 0;
+    bool gen = false;
+    int bin = -1;  /* (cdb text input, else enum mcdb_makefmt_bin) */
+    char *endptr;
     char * const fname = argv[2];
     char * const input = argv[3];
-    const int rv = (input[0] == '-' && input[1] == '\0')
-      ? ((buf = malloc(BUFSZ)) != NULL)
-        ? mcdb_makefmt_fdintofile(STDIN_FILENO, buf, BUFSZ, fname, malloc, free)
-        : MCDB_ERROR_MALLOC
-      : mcdb_makefmt_fileintofile(input, fname, malloc, free);
-    free(buf);
+    int rv;
+
+    for (rv = 4; rv < argc; ++rv) {
+        if (0 == strcmp(argv[rv], "djb"))
+            hash_id = MCDB_HASH_DJB;
+        else if (0 == strcmp(argv[rv], "crc32c"))
+            hash_id = MCDB_HASH_CRC32C;
+        else if (0 == strcmp(argv[rv], "wy"))
+            hash_id = MCDB_HASH_WY;
+        else if (0 == strcmp(argv[rv], "mph"))
+            flags |= MCDB_HDR_MPH;
+        else if (0 == strcmp(argv[rv], "robinhood"))
+            flags |= MCDB_HDR_ROBINHOOD;
+        else if (0 == strcmp(argv[rv], "bucket"))
+            flags |= MCDB_HDR_BUCKET;
+        else if (0 == strcmp(argv[rv], "inline"))
+            flags |= MCDB_HDR_INLINE;
+        else if (0 == strcmp(argv[rv], "filter"))
+            flags |= MCDB_HDR_FILTER;
+        else if (0 == strcmp(argv[rv], "wide"))
+            flags |= MCDB_HDR_WIDE;
+        else if (0 == strcmp(argv[rv], "pow2"))
+            flags |= MCDB_HDR_POW2;
+        else if (0 == strcmp(argv[rv], "mulshift"))
+            flags |= MCDB_HDR_MULSHIFT;
+        else if (0 == strcmp(argv[rv], "gen"))
+            gen = true;
+        else if (0 == strcmp(argv[rv], "bin"))
+            bin = MCDB_MAKEFMT_BIN_NATIVE;
+        else if (0 == strcmp(argv[rv], "binbe"))
+            bin = MCDB_MAKEFMT_BIN_BE;
+        else if (0 == strncmp(argv[rv], "slotbits=", 9)) {
+            slot_bits = strtoul(argv[rv]+9, &endptr, 10);
+            if (argv[rv]+9 == endptr || *endptr != '\0'
+                || slot_bits < MCDB_SLOT_BITS || slot_bits > MCDB_SLOT_BITS_MAX)
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strncmp(argv[rv], "threads=", 8)) {
+            nthreads = strtoul(argv[rv]+8, &endptr, 10);
+            if (argv[rv]+8 == endptr || *endptr != '\0'
+                || nthreads == 0 || nthreads > MCDB_SLOTS)
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strncmp(argv[rv], "mem=", 4)) {
+            membudget = strtoul(argv[rv]+4, &endptr, 10);
+            if (argv[rv]+4 == endptr || *endptr != '\0'
+                || membudget == 0 || membudget > (SIZE_MAX >> 20))
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strncmp(argv[rv], "size=", 5)) {
+            sizehint = strtoul(argv[rv]+5, &endptr, 10);
+            if (argv[rv]+5 == endptr || *endptr != '\0'
+                || sizehint == 0 || sizehint > (SIZE_MAX >> 20))
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strncmp(argv[rv], "shards=", 7)) {
+            nshards = strtoul(argv[rv]+7, &endptr, 10);
+            if (argv[rv]+7 == endptr || *endptr != '\0'
+                || nshards == 0 || nshards > MCDB_SHARDS_MAX)
+                return MCDB_ERROR_USAGE;
+        }
+        else
+            return MCDB_ERROR_USAGE;
+    }
+    if (!mcdb_hash_lookup(hash_id, &hash_init, &hash_fn))
+        return MCDB_ERROR_USAGE;
+    if (nshards != 0 && (gen || bin != -1))  /* (cdb text input to shard set)*/
+        return MCDB_ERROR_USAGE;
+
+    if (input[0] == '-' && input[1] == '\0') {
+        if ((buf = malloc(BUFSZ)) == NULL)
+            return MCDB_ERROR_MALLOC;
+    }
+    else { /* mmap input file; fd -1 elides read()s */
+        if ((fd = nointr_open(input, O_RDONLY, 0)) == -1)
+            return MCDB_ERROR_READ;
+        if (fstat(fd, &st) != 0
+            || (!S_ISREG(st.st_mode) ? (errno = EINVAL) : 0)
+           #if !defined(_LP64) && !defined(__LP64__)
+            || (st.st_size > (off_t)SIZE_MAX ? (errno = EFBIG) : 0)
+           #endif
+            || (buf = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0))
+               == MAP_FAILED) {
+            const int errsave = errno;
+            (void) nointr_close(fd);
+            errno = errsave;
+            return MCDB_ERROR_READ;
+        }
+        (void) nointr_close(fd);
+        fd = -1;
+        bufsz = (size_t)st.st_size;
+        posix_madvise(buf, bufsz, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+    }
+
+    if (nshards != 0) {
+        /* shard set: each shard built with 1/n of mem and size hint, and
+         * shards finished concurrently with threads shared among shards */
+        struct mcdb_shardset_make s;
+        if (mcdb_shardset_make_start(&s, fname, (uint32_t)nshards,
+                                     malloc, free) == 0) {
+            for (uint32_t i = 0; i < s.n; ++i) {
+                s.mk[i].hash_id   = hash_id;
+                s.mk[i].hash_init = hash_init;
+                s.mk[i].hash_fn   = hash_fn;
+                s.mk[i].flags     = flags;
+                s.mk[i].slot_bits = (uint32_t)slot_bits;
+                s.mk[i].nthreads  = nthreads > nshards
+                                  ? (uint32_t)(nthreads / nshards)
+                                  : 1;
+                s.mk[i].membudget = ((size_t)membudget << 20) / nshards;
+                s.mk[i].sizehint  = ((size_t)sizehint << 20) / nshards;
+            }
+            s.nthreads = (uint32_t)nthreads;
+            rv = mcdb_makefmt_fdintoshards(&s, fd, buf, bufsz);
+        }
+        else
+            rv = (errno == ENOMEM ? MCDB_ERROR_MALLOC : MCDB_ERROR_WRITE);
+        mcdb_shardset_make_cleanup(&s);
+    }
+    else {
+        if (mcdb_makefn_start(&m, fname, malloc, free) == 0
+            && (!gen || mcdb_makefn_gencreate(&m) == 0)
+            && mcdb_make_start(&m, m.fd, malloc, free) == 0) {
+            /* set hash func after mcdb_make_start(), before adding records */
+            m.hash_id   = hash_id;
+            m.hash_init = hash_init;
+            m.hash_fn   = hash_fn;
+            m.flags     = flags;
+            m.slot_bits = (uint32_t)slot_bits;
+            m.nthreads  = (uint32_t)nthreads;
+            m.membudget = (size_t)membudget << 20;
+            m.sizehint  = (size_t)sizehint << 20;
+            rv = (bin == -1)
+              ? mcdb_makefmt_fdintomk(&m, fd, buf, bufsz)
+              : mcdb_makefmt_binintomk(&m, fd, buf, bufsz,
+                                       (enum mcdb_makefmt_bin)bin);
+        }
+        else
+            rv = (errno == ENOMEM ? MCDB_ERROR_MALLOC : MCDB_ERROR_WRITE);
+        if (rv == 0)
+            rv = mcdb_makefn_finish(&m, true) == 0 ? 0 : MCDB_ERROR_WRITE;
+        mcdbctl_gen_check(&m);
+        mcdb_makefn_cleanup(&m);
+    }
+
+    if (fd == -1)
+        munmap(buf, bufsz);
+    else
+        free(buf);
     return rv;
 }
 
@@ -433,7 +675,7 @@ mcdbctl_has_unique_keys(struct mcdb * const restrict m)
     struct mcdb_iter iter;
     char *k;
     unsigned char *mark = mcdb_madv_initmark(m->map->ptr, m->map->size,
-                                             MCDB_HEADER_SZ);
+                                             m->map->data);
     posix_madvise(m->map->ptr, m->map->size,
                   POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
     if (!mcdb_validate_slots(m))
@@ -467,7 +709,7 @@ mcdbctl_make_unique_keys(struct mcdb * const restrict m, const bool first)
     struct mcdb_make mk;
     char *k, *data;
     unsigned char *mark = mcdb_madv_initmark(m->map->ptr, m->map->size,
-                                             MCDB_HEADER_SZ);
+                                             m->map->data);
     uint32_t dlen;
     int rv = EXIT_SUCCESS;
     posix_madvise(m->map->ptr, m->map->size,
@@ -476,6 +718,14 @@ mcdbctl_make_unique_keys(struct mcdb * const restrict m, const bool first)
         return MCDB_ERROR_READFORMAT;
     if (mcdb_makefn_start(&mk, m->map->fname, malloc, free) == 0
         && mcdb_make_start(&mk, mk.fd, malloc, free) == 0) {
+        /* preserve hash function and index layout of input mcdb */
+        if (m->map->hash_id != MCDB_HASH_CUSTOM
+            && mcdb_hash_lookup(m->map->hash_id, &mk.hash_init, &mk.hash_fn)) {
+            mk.hash_id   = m->map->hash_id;
+            mk.hash_init = m->map->hash_init;
+        }
+        mk.flags = m->map->flags;
+        mk.slot_bits = m->map->slot_bits;
         mcdb_iter_init(&iter, m);
         while (mcdb_iter(&iter) && rv == EXIT_SUCCESS) {
             /* Technically, passing m (which contains m->map->ptr) and an
@@ -485,7 +735,8 @@ mcdbctl_make_unique_keys(struct mcdb * const restrict m, const bool first)
             dlen = mcdb_iter_datalen(&iter);
             k = (char *)mcdb_iter_keyptr(&iter);
             if (mcdb_find(m, k, mcdb_iter_keylen(&iter))) {
-                if (data == (char *)mcdb_dataptr(m)) { /*first value for key*/
+                if (data == (char *)m->map->ptr + mcdb_recdatapos(m)) {
+                    /* first value for key */
                     if (!first) {  /*!first: find last (final) value for key*/
                         while (mcdb_findnext(m, k, mcdb_iter_keylen(&iter))) {
                             data = (char *)mcdb_dataptr(m);
@@ -509,6 +760,7 @@ mcdbctl_make_unique_keys(struct mcdb * const restrict m, const bool first)
         if (rv == EXIT_SUCCESS) {
             if (mcdb_make_finish(&mk) != 0 || mcdb_makefn_finish(&mk,true) != 0)
                 rv = MCDB_ERROR_WRITE;
+            mcdbctl_gen_check(&mk);
         }
     }
     else
@@ -555,19 +807,421 @@ mcdbctl_uniq(const int argc, char ** const restrict argv)
     return rv;
 }
 
+/* delta: changes to merge into existing mcdb (see mcdbctl_merge()) */
+struct mcdbctl_delta {
+  const char *key;
+  const char *data;  /* NULL if tombstone (delete key) */
+  uint32_t klen;
+  uint32_t dlen;
+  bool drop;         /* superseded by later tombstone of key in delta, or
+                      * tombstone followed by upserts of key in delta */
+};
+
+/* parse decimal num (<= INT_MAX-8) followed by char c; NULL if invalid */
+__attribute_nonnull__
+static const char *
+mcdbctl_delta_num(const char * restrict p, const char * const restrict e,
+                  uint32_t * const restrict n, const char c);
+
+static const char *
+mcdbctl_delta_num(const char * restrict p, const char * const restrict e,
+                  uint32_t * const restrict n, const char c)
+{
+    const char * const s = p;
+    uint32_t x = 0;
+    while (p != e && ((uint32_t)(*p-'0')) <= 9u && x <= 214748363u)
+        x = x * 10 + (uint32_t)(*p++ - '0');
+    *n = x;
+    return (p != s && p != e && *p == c) ? p+1 : NULL;
+}
+
+/* parse delta (cdb text format plus tombstone records):
+ *   "+klen,dlen:key->data\n" (upsert: replace values of key)
+ *   "-klen:key\n"            (tombstone: delete key)
+ * ending with blank line ("\n")
+ * (d may be NULL to count records; returns num records or ~0 if invalid) */
+__attribute_nonnull_x__((1,2))
+static size_t
+mcdbctl_delta_parse(const char * restrict p, const char * const restrict e,
+                    struct mcdbctl_delta * const restrict d);
+
+static size_t
+mcdbctl_delta_parse(const char * restrict p, const char * const restrict e,
+                    struct mcdbctl_delta * const restrict d)
+{
+    size_t n = 0;
+    uint32_t klen;
+    uint32_t dlen = 0;
+    while (p != e && *p != '\n') {
+        const bool upsert = (*p++ == '+');
+        if (!upsert && p[-1] != '-')
+            return ~(size_t)0;
+        p = upsert
+          ? ((p = mcdbctl_delta_num(p, e, &klen, ',')) != NULL)
+              ? mcdbctl_delta_num(p, e, &dlen, ':')
+              : NULL
+          : mcdbctl_delta_num(p, e, &klen, ':');
+        if (p == NULL || (size_t)(e - p) < (size_t)klen + 1
+                                            + (upsert ? 2 + (size_t)dlen : 0))
+            return ~(size_t)0;
+        if (d != NULL) {
+            d[n].key  = p;
+            d[n].klen = klen;
+            d[n].data = upsert ? p + klen + 2 : NULL;
+            d[n].dlen = upsert ? dlen : 0;
+            d[n].drop = false;
+        }
+        p += klen;
+        if (upsert) {
+            if (p[0] != '-' || p[1] != '>')
+                return ~(size_t)0;
+            p += 2 + dlen;
+        }
+        if (*p++ != '\n')
+            return ~(size_t)0;
+        ++n;
+    }
+    return (p != e) ? n : ~(size_t)0;  /* (blank line ends delta) */
+}
+
+/* order delta records by key, then by order in delta */
+__attribute_nonnull__
+static int
+mcdbctl_delta_cmp(const void * const a, const void * const b);
+
+static int
+mcdbctl_delta_cmp(const void * const a, const void * const b)
+{
+    const struct mcdbctl_delta * const x =*(const struct mcdbctl_delta **)a;
+    const struct mcdbctl_delta * const y =*(const struct mcdbctl_delta **)b;
+    int c;
+    if (x->klen != y->klen)
+        return (x->klen < y->klen) ? -1 : 1;
+    c = memcmp(x->key, y->key, x->klen);
+    return (c != 0) ? c : (x < y) ? -1 : (x > y);
+}
+
+__attribute_nonnull__
+static int
+mcdbctl_uintptr_cmp(const void * const a, const void * const b);
+
+static int
+mcdbctl_uintptr_cmp(const void * const a, const void * const b)
+{
+    const uintptr_t x = *(const uintptr_t *)a;
+    const uintptr_t y = *(const uintptr_t *)b;
+    return (x < y) ? -1 : (x > y);
+}
+
+/* positions of records in mcdb with keys in delta (sorted) (records to skip
+ * when copying records of mcdb), and mark delta records superseded in delta
+ * (m may be NULL to only mark delta records)
+ * (returns num positions in *skip (allocated), or ~0 upon error) */
+__attribute_nonnull_x__((2,4))
+__attribute_warn_unused_result__
+static size_t
+mcdbctl_delta_skip(struct mcdb * const restrict m,
+                   struct mcdbctl_delta * const restrict d, const size_t n,
+                   uintptr_t ** const restrict skip);
+
+static size_t
+mcdbctl_delta_skip(struct mcdb * const restrict m,
+                   struct mcdbctl_delta * const restrict d, const size_t n,
+                   uintptr_t ** const restrict skip)
+{
+    struct mcdbctl_delta ** const restrict x =
+      (struct mcdbctl_delta **)malloc((n ? n : 1) * sizeof(*x));
+    uintptr_t *s = NULL;
+    size_t ns = 0;
+    size_t sz = 0;
+    size_t u, v, t;
+    if (x == NULL)
+        return ~(size_t)0;
+    for (u = 0; u < n; ++u)
+        x[u] = d+u;
+    qsort(x, n, sizeof(*x), mcdbctl_delta_cmp);
+    for (u = 0; u < n; u = v) {
+        /* group of records with same key; upserts before last tombstone and
+         * all values of key in mcdb are replaced */
+        for (v = u+1, t = u; v < n && x[v]->klen == x[u]->klen
+                              && 0 == memcmp(x[v]->key,x[u]->key,x[u]->klen);
+             ++v) {
+            if (x[v]->data == NULL)
+                t = v;
+        }
+        if (x[t]->data == NULL) {
+            x[t]->drop = (t+1 != v); /*(tombstone not needed if upserts follow)*/
+            for (; t > u; --t)
+                x[t-1]->drop = true;
+        }
+        if (m != NULL && mcdb_find(m, x[u]->key, x[u]->klen)) {
+            do {
+                if (ns == sz) {
+                    uintptr_t * const p = (uintptr_t *)
+                      realloc(s, (sz = sz ? sz << 1 : 1024) * sizeof(*s));
+                    if (p == NULL) {
+                        free(s);
+                        free(x);
+                        return ~(size_t)0;
+                    }
+                    s = p;
+                }
+                s[ns++] = mcdb_recdatapos(m) - mcdb_keylen(m) - 8;
+            } while (mcdb_findnext(m, x[u]->key, x[u]->klen));
+        }
+    }
+    free(x);
+    if (ns)
+        qsort(s, ns, sizeof(*s), mcdbctl_uintptr_cmp);
+    *skip = s;
+    return ns;
+}
+
+/* load delta from file: text format (see mcdbctl_delta_parse()), or delta mcdb
+ * (MCDB_HDR_DELTA) (e.g. to compact mcdb_overlay with mcdbctl merge)
+ * (*d is allocated and refers to *buf, mmap of file of *sz bytes) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static int
+mcdbctl_delta_load(const char * const restrict fname,
+                   char ** const restrict buf, size_t * const restrict sz,
+                   struct mcdbctl_delta ** const restrict d,
+                   size_t * const restrict n);
+
+static int
+mcdbctl_delta_load(const char * const restrict fname,
+                   char ** const restrict buf, size_t * const restrict sz,
+                   struct mcdbctl_delta ** const restrict d,
+                   size_t * const restrict n)
+{
+    struct stat st;
+    char *p;
+    int fd;
+
+    if ((fd = nointr_open(fname, O_RDONLY, 0)) == -1)
+        return MCDB_ERROR_READ;
+    if (fstat(fd, &st) != 0
+        || (!S_ISREG(st.st_mode) || st.st_size == 0 ? (errno = EINVAL) : 0)
+       #if !defined(_LP64) && !defined(__LP64__)
+        || (st.st_size > (off_t)SIZE_MAX ? (errno = EFBIG) : 0)
+       #endif
+        || (p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0))
+           == MAP_FAILED) {
+        const int errsave = errno;
+        (void) nointr_close(fd);
+        errno = errsave;
+        return MCDB_ERROR_READ;
+    }
+    (void) nointr_close(fd);
+    *buf = p;
+    *sz  = (size_t)st.st_size;
+
+    if (*sz >= MCDB_HDR_SZ && 0 == memcmp(p,MCDB_HDR_MAGIC,MCDB_HDR_MAGIC_SZ)){
+        /* delta mcdb: op byte follows data of each record */
+        struct mcdb_mmap map;
+        struct mcdb m;
+        struct mcdb_iter iter;
+        size_t u = 0;
+        memset(&map, '\0', sizeof(map));
+        map.ptr  = (unsigned char *)p;
+        map.size = *sz;
+        if (!mcdb_mmap_init_header(&map) || !(map.flags & MCDB_HDR_DELTA))
+            return MCDB_ERROR_READFORMAT;
+        if ((*d = malloc((map.n ? map.n : 1) * sizeof(**d))) == NULL)
+            return MCDB_ERROR_MALLOC;
+        m.map = &map;
+        mcdb_iter_init(&iter, &m);
+        while (u < map.n && mcdb_iter(&iter)) {
+            const bool upsert = (iter.dlen != 0
+                                 && iter.ptr[-1] == MCDB_DELTA_UPSERT);
+            (*d)[u].key  = (char *)mcdb_iter_keyptr(&iter);
+            (*d)[u].klen = iter.klen;
+            (*d)[u].data = upsert ? (char *)mcdb_iter_dataptr(&iter) : NULL;
+            (*d)[u].dlen = upsert ? iter.dlen - 1 : 0;
+            (*d)[u].drop = false;
+            ++u;
+        }
+        *n = u;
+        return EXIT_SUCCESS;
+    }
+
+    if ((*n = mcdbctl_delta_parse(p, p + *sz, NULL)) == ~(size_t)0)
+        return MCDB_ERROR_READFORMAT;
+    if ((*d = malloc((*n ? *n : 1) * sizeof(**d))) == NULL)
+        return MCDB_ERROR_MALLOC;
+    (void) mcdbctl_delta_parse(p, p + *sz, *d);
+    return EXIT_SUCCESS;
+}
+
+/* mcdbctl merge <mcdb> <delta> <new mcdb>
+ * new mcdb is records of mcdb with keys not in delta (records copied in runs;
+ * hashes of keys taken from index of mcdb), followed by upserts in delta */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static int
+mcdbctl_merge(char ** const restrict argv);
+
+static int
+mcdbctl_merge(char ** const restrict argv)
+{
+    /* assert(argc == 5); */                    /* must be checked by caller */
+    /* assert(0 == strcmp(argv[1], "merge")); *//* must be checked by caller */
+    struct mcdb m;
+    struct mcdb_make mk;
+    struct mcdbctl_delta *d = NULL;
+    uintptr_t *skip = NULL;
+    char *buf = NULL;
+    size_t sz = 0;
+    size_t n = 0;
+    size_t ns = 0;
+    int rv;
+
+    m.map = mcdb_mmap_create(NULL,NULL,argv[2],malloc,free); /*fname=argv[2]*/
+    if (m.map == NULL)
+        rv = MCDB_ERROR_READ;
+    else if (!mcdb_validate_slots(&m) || (m.map->flags & MCDB_HDR_DELTA))
+        rv = MCDB_ERROR_READFORMAT;
+    else if ((rv = mcdbctl_delta_load(argv[3], &buf, &sz, &d, &n))
+             == EXIT_SUCCESS
+             && (ns = mcdbctl_delta_skip(&m, d, n, &skip)) == ~(size_t)0)
+        rv = MCDB_ERROR_MALLOC;
+
+    if (rv == EXIT_SUCCESS) {
+        if (mcdb_makefn_start(&mk, argv[4], malloc, free) == 0
+            && mcdb_make_start(&mk, mk.fd, malloc, free) == 0) {
+            /* preserve hash function and index layout of input mcdb */
+            if (m.map->hash_id != MCDB_HASH_CUSTOM
+                && mcdb_hash_lookup(m.map->hash_id,&mk.hash_init,&mk.hash_fn)){
+                mk.hash_id   = m.map->hash_id;
+                mk.hash_init = m.map->hash_init;
+            }
+            mk.flags     = m.map->flags;
+            mk.slot_bits = m.map->slot_bits;
+            mk.sizehint  = m.map->size + sz;
+            posix_madvise(m.map->ptr, m.map->size, POSIX_MADV_SEQUENTIAL);
+            rv = mcdb_make_addmcdb(&mk, m.map, skip, ns) == 0
+              ? EXIT_SUCCESS
+              : MCDB_ERROR_WRITE;
+            for (size_t u = 0; u < n && rv == EXIT_SUCCESS; ++u) {
+                if (d[u].data != NULL && !d[u].drop
+                    && mcdb_make_add(&mk, d[u].key, d[u].klen,
+                                     d[u].data, d[u].dlen) != 0)
+                    rv = MCDB_ERROR_WRITE;
+            }
+            if (rv == EXIT_SUCCESS
+                && (mcdb_make_finish(&mk) != 0
+                    || mcdb_makefn_finish(&mk, true) != 0))
+                rv = MCDB_ERROR_WRITE;
+            mcdbctl_gen_check(&mk);
+        }
+        else
+            rv = (errno == ENOMEM ? MCDB_ERROR_MALLOC : MCDB_ERROR_WRITE);
+        mcdb_make_destroy(&mk);
+        mcdb_makefn_cleanup(&mk);
+    }
+
+    free(skip);
+    free(d);
+    if (m.map != NULL)
+        mcdb_mmap_destroy(m.map);
+    if (buf != NULL)
+        munmap(buf, sz);
+    return rv;
+}
+
+/* mcdbctl delta <delta mcdb> <delta>
+ * delta mcdb (MCDB_HDR_DELTA) (for mcdb_overlay) of last upserts of each key
+ * (or tombstone if last change to key deletes key) */
+__attribute_nonnull__
+__attribute_warn_unused_result__
+static int
+mcdbctl_make_delta(char ** const restrict argv);
+
+static int
+mcdbctl_make_delta(char ** const restrict argv)
+{
+    /* assert(argc == 4); */                    /* must be checked by caller */
+    /* assert(0 == strcmp(argv[1], "delta")); *//* must be checked by caller */
+    struct mcdb_make mk;
+    struct mcdbctl_delta *d = NULL;
+    uintptr_t *skip = NULL;
+    char *buf = NULL;
+    size_t sz = 0;
+    size_t n = 0;
+    int rv;
+
+    if ((rv = mcdbctl_delta_load(argv[3], &buf, &sz, &d, &n)) == EXIT_SUCCESS
+        && mcdbctl_delta_skip(NULL, d, n, &skip) == ~(size_t)0)
+        rv = MCDB_ERROR_MALLOC;
+
+    if (rv == EXIT_SUCCESS) {
+        if (mcdb_makefn_start(&mk, argv[2], malloc, free) == 0
+            && mcdb_make_start(&mk, mk.fd, malloc, free) == 0) {
+            mk.flags |= MCDB_HDR_DELTA;
+            for (size_t u = 0; u < n && rv == EXIT_SUCCESS; ++u) {
+                if (!d[u].drop
+                    && (d[u].data != NULL
+                        ? mcdb_make_delta_add(&mk, d[u].key, d[u].klen,
+                                              d[u].data, d[u].dlen)
+                        : mcdb_make_delta_del(&mk, d[u].key, d[u].klen)) != 0)
+                    rv = MCDB_ERROR_WRITE;
+            }
+            if (rv == EXIT_SUCCESS
+                && (mcdb_make_finish(&mk) != 0
+                    || mcdb_makefn_finish(&mk, true) != 0))
+                rv = MCDB_ERROR_WRITE;
+            mcdbctl_gen_check(&mk);
+        }
+        else
+            rv = (errno == ENOMEM ? MCDB_ERROR_MALLOC : MCDB_ERROR_WRITE);
+        mcdb_make_destroy(&mk);
+        mcdb_makefn_cleanup(&mk);
+    }
+
+    free(skip);
+    free(d);
+    if (buf != NULL)
+        munmap(buf, sz);
+    return rv;
+}
+
 static const char * const restrict mcdb_usage =
-   "mcdbctl make  <fname.mcdb> <datafile|->\n"
+   "mcdbctl make  <fname.mcdb> <datafile|-> [\"djb\"|\"crc32c\"|\"wy\"]"
+   " [\"mph\"|\"robinhood\"|\"bucket\"] [\"inline\"] [\"filter\"]\n"
+   "                      [\"pow2\"|\"mulshift\"] [\"slotbits=\"(8-20)] [\"gen\"]\n"
+   "                      [\"wide\"]\n"
+   "                      [\"bin\"|\"binbe\"]\n"
+   "                      [\"threads=\"N] [\"mem=\"MB] [\"size=\"MB]"
+   " [\"shards=\"N]\n"
    "         mcdbctl uniq  <fname.mcdb> [\"first\"|\"last\"]\n"
-   "         mcdbctl dump  <fname.mcdb>\n"
+   "         mcdbctl merge <fname.mcdb> <delta> <new.mcdb>\n"
+   "         mcdbctl delta <delta.mcdb> <delta>\n"
+   "         mcdbctl dump  <fname.mcdb> [\"delta=\"<delta.mcdb>]\n"
    "         mcdbctl stats <fname.mcdb>\n"
-   "         mcdbctl get   <fname.mcdb> <key> [seq|\"all\"]\n";
+   "         mcdbctl get   <fname.mcdb> <key> [seq|\"all\"]"
+   " [\"delta=\"<delta.mcdb>]\n";
 
 /*
- * mcdbctl get   <mcdb> <key> [seq|"all"]
- * mcdbctl dump  <mcdb>
+ * mcdbctl get   <mcdb> <key> [seq|"all"] ["delta="<delta mcdb>]
+ * mcdbctl dump  <mcdb> ["delta="<delta mcdb>]
  * mcdbctl stats <mcdb>
- * mcdbctl make  <mcdb> <input-file>
+ * mcdbctl make  <mcdb> <input-file> ["djb"|"crc32c"|"wy"]
+ *                                    ["mph"|"robinhood"|"bucket"] ["inline"]
+ *                                    ["filter"] ["pow2"|"mulshift"]
+ *                                    ["slotbits="(8-20)] ["gen"]
+ *                                    ["wide"]
+ *                                    ["bin"|"binbe"]
+ *                                    ["threads="N] ["mem="MB] ["size="MB]
+ *                                    ["shards="N]
  * mcdbctl uniq  <mcdb> ["first"|"last"]
+ * mcdbctl merge <mcdb> <delta> <new mcdb>
+ * mcdbctl delta <delta mcdb> <delta>
+ *
+ * "wide" makes mcdb with 64-bit hash (khash and key fingerprint in each hash
+ * table entry), which is not limited to approx 2 billion records.
+ *
+ * "shards="N makes shard set of N shards (mcdb files <mcdb>.<i>.XXXXXX) and
+ * manifest <mcdb> naming shards; get routes key through manifest to shard.
  *
  * mcdbctl tools require mcdb filename be specified on the command line.
  * djb cdb tools take cdb on stdin, since able to mmap stdin backed by file.
@@ -576,10 +1230,14 @@ int
 main(int argc, char ** const restrict argv)
 {
     int rv;
-    if (argc == 4 && 0 == strcmp(argv[1], "make"))
+    if (argc >= 4 && 0 == strcmp(argv[1], "make"))
         rv = mcdbctl_make(argc, argv);
     else if ((argc == 3 || argc == 4) && 0 == strcmp(argv[1], "uniq"))
         rv = mcdbctl_uniq(argc, argv);
+    else if (argc == 5 && 0 == strcmp(argv[1], "merge"))
+        rv = mcdbctl_merge(argv);
+    else if (argc == 4 && 0 == strcmp(argv[1], "delta"))
+        rv = mcdbctl_make_delta(argv);
     else
         rv = mcdbctl_query(argc, argv);
 
@@ -24,7 +24,7 @@
 #endif
 
 #include "nss_mcdb.h"
-#include "../plasma/plasma_membar.h"
+#include "../plasma/plasma_atomic.h"
 #include "../plasma/plasma_stdtypes.h"
 
 #include <sys/stat.h>
@@ -71,6 +71,33 @@
 #define NSS_MCDB_DBPATH "/etc/mcdb/"
 #endif
 
+/* compile-time setting for detection of updated mcdb
+ * By default, each lookup stat()s the mcdb to check for updates.
+ * NSS_MCDB_WATCH_MS limits stat() to once per NSS_MCDB_WATCH_MS milliseconds
+ * for each mcdb.  NSS_MCDB_WATCH_GENERATION detects updates with generation
+ * number in <db>.mcdb.gen sidecar (if present; see 'mcdbctl make ... gen'),
+ * and NSS_MCDB_WATCH_INOTIFY (Linux) detects updates with inotify in a watcher
+ * thread, with NSS_MCDB_WATCH_MS as fallback interval.
+ * (see mcdb_mmap_watch() in mcdb.h)
+ * NSS_MCDB_WATCH_MS defaults to 0 (stat() on each lookup) so that an update is
+ * seen by the very next lookup in every process (e.g. useradd, then chown to
+ * new user); an interval would delay visibility up to interval after update,
+ * and generation sidecar and inotify require 'gen' mcdb or a watcher thread */
+#ifndef NSS_MCDB_WATCH_MS
+#define NSS_MCDB_WATCH_MS 0
+#endif
+#ifdef NSS_MCDB_WATCH_GENERATION
+#define NSS_MCDB_WATCH_FLAG_GEN MCDB_WATCH_GENERATION
+#else
+#define NSS_MCDB_WATCH_FLAG_GEN 0
+#endif
+#ifdef NSS_MCDB_WATCH_INOTIFY
+#define NSS_MCDB_WATCH_FLAG_INOTIFY MCDB_WATCH_INOTIFY
+#else
+#define NSS_MCDB_WATCH_FLAG_INOTIFY 0
+#endif
+#define NSS_MCDB_WATCH_FLAGS (NSS_MCDB_WATCH_FLAG_GEN|NSS_MCDB_WATCH_FLAG_INOTIFY)
+
 /* NOTE: path to db must match up to enum nss_dbtype index
  * (static two-dimensional array instead of ptrs to reduce num DSO relocations)
  * (+14 for longest name, e.g. "protocols.mcdb") */
@@ -156,8 +183,10 @@ _nss_mcdb_db_openshared(const enum nss_dbtype dbtype)
      * a reference to maps to keep them available. */
     if ((rc = (NULL != mcdb_mmap_create_h(map, NULL, _nss_dbnames[dbtype],
                                           malloc, free)))) {
-        plasma_membar_StoreStore();
-        _nss_mcdb_mmap[dbtype] = map;
+        if (NSS_MCDB_WATCH_MS != 0 || NSS_MCDB_WATCH_FLAGS != 0)
+            (void) mcdb_mmap_watch(map, NSS_MCDB_WATCH_MS,NSS_MCDB_WATCH_FLAGS);
+        plasma_atomic_store_explicit(&_nss_mcdb_mmap[dbtype], map,
+                                     memory_order_release);
     }
 
     pthread_mutex_unlock(&_nss_mcdb_global_mutex);
@@ -187,14 +216,17 @@ __attribute_regparm__((1))
 static struct mcdb_mmap *
 _nss_mcdb_db_getshared(const enum nss_dbtype dbtype)
 {
+    struct mcdb_mmap *map;
+
     /* reuse set*ent(),get*ent(),end*end() session if open in current thread */
     if (_nss_mcdb_st[dbtype].map != NULL)
         return _nss_mcdb_st[dbtype].map;
 
     /* check if db is open and up-to-date, or else open db
      * (continue with open database if failure refreshing) */
-    if (__builtin_expect(_nss_mcdb_mmap[dbtype] != 0, true)) {
-        plasma_membar_ld_datadep(); /*(thread ld order dep access map struct)*/
+    map = plasma_atomic_load_explicit(&_nss_mcdb_mmap[dbtype],
+                                      memory_order_acquire);
+    if (__builtin_expect(map != NULL, true)) {
         /* protocols, rpc, services unlikely to change often in most configs
          * Therefore, skip stat() check if configured (default skips stat())
          * (Implication: must restart nscd if any of these three files change)*/
@@ -205,7 +237,7 @@ _nss_mcdb_db_getshared(const enum nss_dbtype dbtype)
           default:
             /*(void)mcdb_mmap_refresh_threadsafe(&_nss_mcdb_mmap[dbtype]);*/
             (void)(__builtin_expect(
-               !mcdb_mmap_refresh_check_h(_nss_mcdb_mmap[dbtype]), true)
+               !mcdb_mmap_refresh_check_h(map), true)
                ||  __builtin_expect(
                mcdb_mmap_reopen_threadsafe_h(&_nss_mcdb_mmap[dbtype]), true));
             break;
@@ -226,7 +258,7 @@ nss_mcdb_setent(const enum nss_dbtype dbtype,
 {
     struct mcdb * const restrict m = &_nss_mcdb_st[dbtype];
     if (m->map != NULL || (m->map = _nss_mcdb_db_getshared(dbtype)) != NULL) {
-        m->hpos = (uintptr_t)(m->map->ptr + MCDB_HEADER_SZ);
+        m->hpos = (uintptr_t)(m->map->ptr + m->map->data);
         return NSS_STATUS_SUCCESS;
     }
     return NSS_STATUS_UNAVAIL;
@@ -358,7 +390,9 @@ nss_mcdb_buf_decode(struct mcdb * const restrict m,
 bool
 nss_mcdb_refresh_check(const enum nss_dbtype dbtype)
 {
+    struct mcdb_mmap *map;
     return (0 <= (int)dbtype && dbtype < NSS_DBTYPE_SENTINEL)
-        && _nss_mcdb_mmap[dbtype] != NULL
-        && mcdb_mmap_refresh_check_h(_nss_mcdb_mmap[dbtype]);
+        && (map = plasma_atomic_load_explicit(&_nss_mcdb_mmap[dbtype],
+                                              memory_order_acquire)) != NULL
+        && mcdb_mmap_refresh_check_h(map);
 }
@@ -213,6 +213,11 @@ touch empty.mcdb
 mcdbget empty.mcdb foo 2>/dev/null
 rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
 
+echo '--- mcdbget rejects file which is not an mcdb'
+cat ../random.in ../random.in ../random.in > notmcdb.mcdb
+mcdbget notmcdb.mcdb foo 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
 
 echo '--- mcdbmake and mcdbdump handle random.mcdb'
 mcdbmake random.mcdb - < ../random.in
@@ -230,6 +235,283 @@ echo '--- mcdbstats handles random.mcdb'
 mcdbstats random.mcdb >/dev/null
 rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
 
+echo '--- mcdbmake handles hash function selection'
+for hash in djb crc32c wy; do
+  mcdbctl make random.$hash.mcdb - $hash < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.$hash.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+mcdbctl make random.bad.mcdb - nohash < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbmake creates v1 mcdb unless v2 features are requested'
+# (random.mcdb is byte-identical to mcdb created by v1-only mcdbctl make,
+#  so readers which predate v2 can read it; checked by cksum of v1 mcdb)
+v=`od -An -tx1 -N1 random.mcdb | tr -d ' '`
+[ "$v" = "00" ] || echo 1>&2 "FAIL random.mcdb not v1: $v"
+v=`cksum < random.mcdb | tr -s ' ' ' '`
+[ "$v" = "2981782701 103168" ] \
+  || echo 1>&2 "FAIL random.mcdb differs from v1: $v"
+cmp -s random.mcdb random.djb.mcdb || echo 1>&2 "FAIL djb mcdb not v1"
+v=`od -An -tx1 -N1 random.crc32c.mcdb | tr -d ' '`
+[ "$v" = "89" ] || echo 1>&2 "FAIL random.crc32c.mcdb not v2: $v"
+mcdbdump random.crc32c.mcdb | cmp -s - random.dump \
+  || echo 1>&2 "FAIL v2 dump differs from v1 dump"
+
+echo '--- mcdbmake handles index layout selection'
+mcdbdump random.djb.mcdb > random.djb.dump
+for layout in mph robinhood bucket inline filter pow2 mulshift slotbits=16; do
+  mcdbctl make random.$layout.mcdb - $layout < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.$layout.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.$layout.mcdb | cmp -s - random.djb.dump \
+    || echo 1>&2 "FAIL $layout dump"
+done
+mcdbctl make random.bad.mcdb - mph robinhood < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make random.bad.mcdb - mph inline < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
+for layout in djb robinhood bucket inline slotbits=12; do
+  mcdbctl make random.$layout.mcdb - $layout < ../random.in
+  mcdbctl make random.par.mcdb - $layout threads=4 < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp -s random.par.mcdb random.$layout.mcdb || echo 1>&2 "FAIL $layout par"
+done
+mcdbctl make random.par.mcdb ../random.in threads=4
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp -s random.par.mcdb random.djb.mcdb || echo 1>&2 "FAIL par input"
+head -c 50000 ../random.in > random.bad.in
+mcdbctl make random.bad.mcdb random.bad.in threads=4 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make random.bad.mcdb - threads=0 < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbmake spills hash entries to disk within mem budget'
+awk 'BEGIN { for (i = 0; i < 200000; ++i) {
+               k = "key" i; printf "+%d,%d:%s->%s\n", length(k), 4, k, "data"
+             }
+             print "" }' > spill.in
+mcdbctl make spill.mcdb spill.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+for layout in djb mph filter slotbits=12; do
+  TMPDIR=. mcdbctl make spill.mem.mcdb spill.in $layout mem=1
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl make spill.$layout.mcdb spill.in $layout
+  cmp -s spill.mem.mcdb spill.$layout.mcdb || echo 1>&2 "FAIL $layout spill"
+done
+
+echo '--- mcdbmake maps output in large windows with size hint'
+for size in 1 64; do
+  mcdbctl make spill.size.mcdb spill.in size=$size
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp -s spill.size.mcdb spill.mcdb || echo 1>&2 "FAIL size=$size"
+done
+mcdbctl make spill.size.mcdb spill.in size=0 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbmake reads binary length-prefixed input'
+le=`printf '\001\000\000\000' | od -An -tu4 | tr -d ' '`
+awk -v le="$le" 'BEGIN { for (i = 0; i < 1000; ++i) {
+               k = "key" i; d = "data" i
+               printf "+%d,%d:%s->%s\n", length(k), length(d), k, d
+               printf "\\000\\000\\000\\%03o\\000\\000\\000\\%03o%s%s",
+                      length(k), length(d), k, d > "bin.be.fmt"
+               if (le == 1)
+                 printf "\\%03o\\000\\000\\000\\%03o\\000\\000\\000%s%s",
+                        length(k), length(d), k, d > "bin.ne.fmt"
+               else
+                 printf "\\000\\000\\000\\%03o\\000\\000\\000\\%03o%s%s",
+                        length(k), length(d), k, d > "bin.ne.fmt"
+             }
+             print "" }' > bin.in
+printf "`cat bin.be.fmt`" > bin.be
+printf "`cat bin.ne.fmt`" > bin.ne
+mcdbctl make bin.mcdb bin.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make bin.be.mcdb bin.be binbe
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp -s bin.be.mcdb bin.mcdb || echo 1>&2 "FAIL binbe"
+mcdbctl make bin.ne.mcdb - bin < bin.ne
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp -s bin.ne.mcdb bin.mcdb || echo 1>&2 "FAIL bin"
+head -c 1000 bin.be > bin.bad
+mcdbctl make bin.bad.mcdb bin.bad binbe 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
+
+echo '--- mcdbctl merge rebuilds from mcdb plus delta'
+awk 'BEGIN { for (i = 0; i < 20000; ++i) {
+               k = "key" i; d = "data" i
+               r = sprintf("+%d,%d:%s->%s\n", length(k), length(d), k, d)
+               printf "%s", r
+               if (i % 10 == 2) {
+                 d = "new" i
+                 r = sprintf("+%d,%d:%s->%s\n", length(k), length(d), k, d)
+                 printf "+%d,1:%s->x\n", length(k), k > "merge.d"
+                 printf "-%d:%s\n", length(k), k > "merge.d"
+                 printf "%s", r > "merge.d"
+                 u = u r
+               }
+               else if (i % 10 == 1)
+                 printf "-%d:%s\n", length(k), k > "merge.d"
+               else
+                 printf "%s", r > "merge.exp.in"
+             }
+             for (i = 20000; i < 20100; ++i) {
+               k = "key" i; d = "data" i
+               r = sprintf("+%d,%d:%s->%s\n", length(k), length(d), k, d)
+               printf "%s", r > "merge.d"
+               printf "-%d:%s\n", length(k), k > "merge.d"
+               if (i % 2 == 0) { printf "%s", r > "merge.d"; u = u r }
+             }
+             printf "%s\n", u > "merge.exp.in"
+             print "" > "merge.d"
+             print "" }' > merge.in
+for layout in djb crc32c mph robinhood bucket inline; do
+  mcdbctl make merge.$layout.mcdb merge.in $layout
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl merge merge.$layout.mcdb merge.d merge.new.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl make merge.exp.mcdb merge.exp.in $layout
+  cmp -s merge.new.mcdb merge.exp.mcdb || echo 1>&2 "FAIL $layout merge"
+done
+head -c 1000 merge.d > merge.bad
+mcdbctl merge merge.djb.mcdb merge.bad merge.new.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
+
+echo '--- mcdb_overlay layers delta mcdb over base mcdb'
+mcdbctl delta merge.delta.mcdb merge.d
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl merge merge.djb.mcdb merge.d merge.new.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump merge.new.mcdb > merge.new.dump
+mcdbctl dump merge.djb.mcdb delta=merge.delta.mcdb > merge.overlay.dump
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp -s merge.new.dump merge.overlay.dump || echo 1>&2 "FAIL overlay dump"
+mcdbctl get merge.djb.mcdb key1 delta=merge.delta.mcdb
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+out=`mcdbctl get merge.djb.mcdb key2 all delta=merge.delta.mcdb`
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "$out" = "new2" ] || echo 1>&2 "FAIL overlay key2 all: $out"
+out=`mcdbctl get merge.djb.mcdb key3 0 delta=merge.delta.mcdb`
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "$out" = "data3" ] || echo 1>&2 "FAIL overlay key3: $out"
+out=`mcdbctl get merge.djb.mcdb key20000 delta=merge.delta.mcdb`
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "$out" = "data20000" ] || echo 1>&2 "FAIL overlay key20000: $out"
+mcdbctl get merge.djb.mcdb key1 delta=merge.djb.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+mcdbctl merge merge.djb.mcdb merge.delta.mcdb merge.compact.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp -s merge.compact.mcdb merge.new.mcdb || echo 1>&2 "FAIL compact"
+
+
+echo '--- mcdbctl make shards= builds shard set with manifest'
+mcdbctl make shard.mcdb merge.in shards=4 crc32c threads=2
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make shard.one.mcdb merge.in crc32c
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump shard.one.mcdb | sort > shard.one.dump
+for f in shard.mcdb.*.*; do mcdbctl dump $f; done | grep -v '^$' | sort \
+  > shard.set.dump
+grep -v '^$' shard.one.dump | cmp -s - shard.set.dump || echo 1>&2 "FAIL shards"
+out=`mcdbctl get shard.mcdb key2 all`
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "$out" = "data2" ] || echo 1>&2 "FAIL shard key2 all: $out"
+mcdbctl get shard.mcdb key20001
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+ls shard.mcdb.*.* > shard.old
+mcdbctl make shard.mcdb - shards=3 < merge.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+ls shard.mcdb.*.* | cmp -s - shard.old && echo 1>&2 "FAIL shards replaced"
+[ `ls shard.mcdb.*.* | wc -l` -eq 3 ] || echo 1>&2 "FAIL old shards removed"
+out=`mcdbctl get shard.mcdb key3`
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "$out" = "data3" ] || echo 1>&2 "FAIL shard key3: $out"
+for k in key20001 key20099 nokey; do
+  mcdbctl get shard.mcdb $k
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $k $rc"
+done
+mcdbctl make shard.mcdb merge.in shards=0 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+
+
+echo '--- mcdbctl make wide builds mcdb with 64-bit hash'
+for opt in robinhood mph filter crc32c; do
+  mcdbctl make wide.mcdb merge.in wide $opt
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl dump wide.mcdb | sort | cmp -s - shard.one.dump \
+    || echo 1>&2 "FAIL wide $opt"
+  mcdbctl get wide.mcdb key2 all > /dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl get wide.mcdb key20001
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+done
+mcdbctl make wide.mcdb merge.in wide bucket 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
+
+echo '--- mcdbmake increments generation sidecar'
+mcdbctl make gen.mcdb - gen < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+g1=`od -An -tx1 gen.mcdb.gen`
+mcdbctl make gen.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+g2=`od -An -tx1 gen.mcdb.gen`
+[ -n "$g1" ] && [ "$g1" != "$g2" ] || echo 1>&2 "FAIL gen not incremented"
+rm -f gen.mcdb.gen && mkdir gen.mcdb.gen
+mcdbctl make gen.mcdb merge.in 2>gen.err
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+grep -q 'gen not incremented: Is a directory' gen.err \
+  || echo 1>&2 "FAIL gen warning"
+out=`mcdbctl get gen.mcdb key3`
+[ "$out" = "data3" ] || echo 1>&2 "FAIL gen mcdb not replaced"
+rmdir gen.mcdb.gen
+
+
+echo '--- mcdb_mmap_watch() detects replaced mcdb'
+for backend in generation inotify interval; do
+  testmcdbwatch watch.$backend.mcdb $backend
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $backend $rc"
+done
+
+
+echo '--- mcdb_make_sub_add() merges records of producer threads'
+testmcdbmake seq.mcdb 100000
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+testmcdbmake par.mcdb 100000 4
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp -s seq.mcdb par.mcdb || echo 1>&2 "FAIL sub-builders"
+testmcdbmake hashed.mcdb 100000 1 hashed
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp -s seq.mcdb hashed.mcdb || echo 1>&2 "FAIL mcdb_make_add_hashed()"
+testmcdbmake batch.mcdb 100000 1 batch
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp -s seq.mcdb batch.mcdb || echo 1>&2 "FAIL mcdb_make_add_batch()"
+testmcdbmake seed.mcdb 100000 1 seed
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp -s seq.mcdb seed.mcdb && echo 1>&2 "FAIL hash_init not applied"
+out=`mcdbget seed.mcdb 00042424`
+rc=$?; [ $rc -eq 0 ] && [ "$out" = "00042424" ] || echo 1>&2 "FAIL seed get"
+mcdbget seed.mcdb 00100000 >/dev/null
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL seed get miss $rc"
+mcdbtest seed.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+
+echo '--- batched lookup matches lookup of each key'
+testmcdbbatch batch.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+
+echo '--- thread registration survives concurrent rebuild and refresh'
+testmcdbthreads reg.mcdb 4 100
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
 
 echo '--- testzero works'
 testzero 5 test.mcdb
@@ -0,0 +1,240 @@
+/*
+ * testmcdbbatch - correctness test of batched lookup against mcdb_find()
+ *
+ * Copyright (c) 2011, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#include "mcdb.h"
+#include "mcdb_make.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>     /* open() */
+#include <stdio.h>     /* fprintf() snprintf() */
+#include <stdlib.h>    /* malloc(), free() */
+#include <string.h>    /* memcmp() */
+#include <unistd.h>    /* close() unlink() */
+
+/* testmcdbbatch <fname>
+ * (for each index layout and option, and for each hash func, build mcdb and
+ *  compare each result of mcdb_findtag_batch() (found, dpos, dlen, and values
+ *  of repeated keys from mcdb_findtagnext()) with mcdb_findtagstart() and
+ *  mcdb_findtagnext() of each key.  Keys looked up include misses, repeated
+ *  keys, keys repeated within the batch, and tagged keys.  Data read with
+ *  mcdb_read() at mcdb_datapos() and mcdb_recdatapos() is also checked) */
+
+#define TESTMCDB_NRECS 3000
+#define TESTMCDB_NKEYS (TESTMCDB_NRECS * 2)
+#define TESTMCDB_TAGC  ((unsigned char)'T')
+
+static const uint32_t testmcdb_flags[] = {
+  0,
+  MCDB_HDR_MPH,
+  MCDB_HDR_ROBINHOOD,
+  MCDB_HDR_BUCKET,
+  MCDB_HDR_INLINE,
+  MCDB_HDR_FILTER,
+  MCDB_HDR_WIDE,
+  MCDB_HDR_ROBINHOOD | MCDB_HDR_INLINE | MCDB_HDR_FILTER,
+  MCDB_HDR_BUCKET | MCDB_HDR_FILTER,
+  MCDB_HDR_WIDE | MCDB_HDR_MPH,
+  MCDB_HDR_WIDE | MCDB_HDR_ROBINHOOD | MCDB_HDR_FILTER
+};
+
+static const uint32_t testmcdb_hash[] = {
+  MCDB_HASH_DJB,
+  MCDB_HASH_CRC32C,
+  MCDB_HASH_WY,
+  MCDB_HASH_DJB       /* (with non-default seed) */
+};
+
+/* key i: "k<i>"; every 7th key has a second value, every 5th key also is
+ * added with tag char (key "T" "k<i>") */
+static int
+testmcdb_build (const char * const fname, const uint32_t flags,
+                const uint32_t hash_id, const int seed)
+{
+    struct mcdb_make m;
+    char k[24];
+    char d[24];
+    size_t klen;
+    size_t dlen;
+    uint32_t u;
+    int rc = -1;
+    const int fd = open(fname, O_RDWR|O_CREAT|O_TRUNC, 0666);
+    if (fd == -1)
+        return -1;
+    if (mcdb_make_start(&m, fd, malloc, free) == 0) {
+        m.flags = flags;
+        if (mcdb_hash_lookup(hash_id, &m.hash_init, &m.hash_fn)) {
+            m.hash_id = hash_id;
+            if (seed)
+                m.hash_init = 0x9e3779b9u;
+            rc = 0;
+        }
+        for (u = 0; rc == 0 && u < TESTMCDB_NRECS; ++u) {
+            k[0] = (char)TESTMCDB_TAGC;
+            klen = (size_t)snprintf(k+1, sizeof(k)-1, "k%u", u);
+            dlen = (size_t)snprintf(d, sizeof(d), "v%u", u);
+            rc = mcdb_make_add(&m, k+1, klen, d, dlen);
+            if (rc == 0 && u % 7 == 0) {
+                dlen = (size_t)snprintf(d, sizeof(d), "w%u", u);
+                rc = mcdb_make_add(&m, k+1, klen, d, dlen);
+            }
+            if (rc == 0 && u % 5 == 0) {
+                dlen = (size_t)snprintf(d, sizeof(d), "t%u", u);
+                rc = mcdb_make_add(&m, k, klen+1, d, dlen);
+            }
+        }
+        if (rc == 0)
+            rc = mcdb_make_finish(&m);
+        else
+            mcdb_make_destroy(&m);
+    }
+    return (close(fd) == 0) ? rc : -1;
+}
+
+/* lookup keys: hits, misses, repeated keys, and keys repeated within batch */
+static size_t
+testmcdb_keys (char (* const kbuf)[24], const char ** const keys,
+               size_t * const klens)
+{
+    size_t n = 0;
+    uint32_t u;
+    for (u = 0; n < TESTMCDB_NKEYS - 1; ++u, ++n) {
+        klens[n] = (size_t)snprintf(kbuf[n], sizeof(kbuf[n]),
+                                    (u % 3 == 1) ? "m%u" : "k%u", u);
+        keys[n]  = kbuf[n];
+        if (u % 11 == 0 && n > 0) {   /* same key as preceding lookup */
+            ++n;
+            klens[n] = klens[n-1];
+            keys[n]  = keys[n-1];
+        }
+    }
+    return n;
+}
+
+/* data at mcdb_datapos() (copy in entry if inlined) and mcdb_recdatapos()
+ * (in data section) read by mcdb_read() must match mcdb_dataptr() */
+static int
+testmcdb_check_datapos (const struct mcdb * const restrict m)
+{
+    char buf[64];
+    const uint32_t dlen = mcdb_datalen(m);
+    const uintptr_t rpos = mcdb_recdatapos(m);
+    return dlen <= sizeof(buf)
+        && rpos >= m->map->data   /*(map->eod may exclude last pad bytes)*/
+        && rpos + dlen <= m->map->eod + MCDB_PAD_MASK
+        && mcdb_read(m, mcdb_recdatapos(m), dlen, buf) != NULL
+        && memcmp(buf, mcdb_dataptr(m), dlen) == 0
+        && mcdb_read(m, mcdb_datapos(m), dlen, buf) != NULL
+        && memcmp(buf, mcdb_dataptr(m), dlen) == 0
+      ? 0
+      : -1;
+}
+
+static int
+testmcdb_compare (struct mcdb * const restrict mb,
+                  struct mcdb * const restrict m1,
+                  const char * const key, const size_t klen,
+                  const unsigned char tagc)
+{
+    bool fb = mcdb_found(mb);
+    bool f1 = mcdb_findtagstart(m1, key, klen, tagc)
+           && mcdb_findtagnext(m1, key, klen, tagc);
+    while (fb == f1 && fb) {
+        if (mb->dpos != m1->dpos || mb->dlen != m1->dlen
+            || testmcdb_check_datapos(m1) != 0)
+            return -1;
+        fb = mcdb_findtagnext(mb, key, klen, tagc);
+        f1 = mcdb_findtagnext(m1, key, klen, tagc);
+    }
+    return (fb == f1) ? 0 : -1;
+}
+
+int
+main (int argc, char **argv)
+{
+    static char kbuf[TESTMCDB_NKEYS][24];
+    static const char *keys[TESTMCDB_NKEYS];
+    static size_t klens[TESTMCDB_NKEYS];
+    static struct mcdb mb[TESTMCDB_NKEYS];
+    struct mcdb m1;
+    struct mcdb_mmap *map;
+    size_t n;
+    size_t i;
+    size_t nf;
+    size_t nfound;
+    size_t f;
+    size_t h;
+    unsigned int t;
+    int rc = 0;
+    if (argc < 2) return -1;
+    n = testmcdb_keys(kbuf, keys, klens);
+
+    for (f = 0; f < sizeof(testmcdb_flags)/sizeof(*testmcdb_flags); ++f) {
+      for (h = 0; h < sizeof(testmcdb_hash)/sizeof(*testmcdb_hash); ++h) {
+        if (testmcdb_build(argv[1], testmcdb_flags[f], testmcdb_hash[h],
+                           h == 3) != 0
+            || (map = mcdb_mmap_create(NULL, NULL, argv[1],
+                                       malloc, free)) == NULL) {
+            fprintf(stderr, "testmcdbbatch: flags 0x%x hash %u: build failed\n",
+                    (unsigned int)testmcdb_flags[f],
+                    (unsigned int)testmcdb_hash[h]);
+            rc = 1;
+            continue;
+        }
+        for (t = 0; t < 2; ++t) {
+            const unsigned char tagc = (t == 0) ? 0 : TESTMCDB_TAGC;
+            for (i = 0; i < n; ++i)
+                mb[i].map = map;
+            m1.map = map;
+            nfound = mcdb_findtag_batch(mb, n, keys, klens, tagc);
+            for (i = 0, nf = 0; i < n; ++i) {
+                nf += mcdb_found(mb+i);
+                if (testmcdb_compare(mb+i, &m1, keys[i], klens[i], tagc) != 0){
+                    fprintf(stderr, "testmcdbbatch: flags 0x%x hash %u "
+                            "seed 0x%x tag %u: mismatch key %.*s\n",
+                            (unsigned int)testmcdb_flags[f],
+                            (unsigned int)testmcdb_hash[h],
+                            (unsigned int)map->hash_init, (unsigned int)tagc,
+                            (int)klens[i], keys[i]);
+                    rc = 1;
+                    break;
+                }
+            }
+            if (nf != nfound || nf == 0) {
+                fprintf(stderr, "testmcdbbatch: flags 0x%x hash %u "
+                        "seed 0x%x tag %u: found count %lu != %lu\n",
+                        (unsigned int)testmcdb_flags[f],
+                        (unsigned int)testmcdb_hash[h],
+                        (unsigned int)map->hash_init, (unsigned int)tagc,
+                        (unsigned long)nfound, (unsigned long)nf);
+                rc = 1;
+            }
+        }
+        mcdb_mmap_destroy(map);
+      }
+    }
+    unlink(argv[1]);
+    return rc;
+}
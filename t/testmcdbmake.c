@@ -32,8 +32,57 @@
 #include <fcntl.h>     /* open() */
 #include <stdio.h>     /* snprintf() */
 #include <stdlib.h>    /* malloc(), free(), strtoul() */
-#include <string.h>    /* memset() */
+#include <string.h>    /* memset() strcmp() */
 #include <unistd.h>    /* close() */
+#ifdef _THREAD_SAFE
+#include <pthread.h>
+
+/* testmcdbmake <fname> <nrecs> <nthreads>
+ * (each thread generates and stores range of records with a sub-builder;
+ *  sub-builders created in order of ranges, so mcdb is same as single thread)*/
+
+struct testmcdbmake_range {
+  struct mcdb_make_sub *sub;
+  unsigned long u;
+  unsigned long e;
+  pthread_t tid;
+};
+
+static void *
+testmcdbmake_thread (void * const arg)
+{
+    char buf[24];
+    struct testmcdbmake_range * const r = (struct testmcdbmake_range *)arg;
+    while (r->u < r->e) {
+        snprintf(buf, sizeof(buf), "%08lu", r->u);           /*generate record*/
+        if (0 != mcdb_make_sub_add(r->sub,buf,8,buf,8))      /*store record*/
+            break;
+        ++r->u;
+    }
+    return NULL;
+}
+
+static unsigned long
+testmcdbmake_threads (struct mcdb_make * const m, const unsigned long e,
+                      const unsigned long n)
+{
+    struct testmcdbmake_range r[64];
+    unsigned long u = 0;
+    unsigned long t;
+    for (t = 0; t < n; ++t) {
+        r[t].u = e / n * t;
+        r[t].e = (t+1 < n) ? e / n * (t+1) : e;
+        if ((r[t].sub = mcdb_make_sub_start(m)) == NULL
+            || pthread_create(&r[t].tid, NULL, testmcdbmake_thread, r+t) != 0)
+            break;
+    }
+    while (t) {
+        pthread_join(r[--t].tid, NULL);
+        u += r[t].u - e / n * t;
+    }
+    return u;
+}
+#endif
 
 int
 main (int argc, char **argv)
@@ -41,14 +90,58 @@ main (int argc, char **argv)
     char buf[16];
     unsigned long u = 0;
     unsigned long e;
+    unsigned long n = 1;
     struct mcdb_make m;
+    struct mcdb_khash kh;
+    char bbuf[64][16];
+    const char *keys[64];
+    size_t klens[64];
+    unsigned long k;
     int fd;
+    /* testmcdbmake <fname> <nrecs> <nthreads> "hashed"|"batch"|"seed"
+     * (hash each key with mcdb_khash_init() and add with
+     *  mcdb_make_add_hashed(), or add 64 records at a time with
+     *  mcdb_make_add_batch(); mcdb is same as with mcdb_make_add())
+     * (or seed default hash with non-default hash_init recorded in header) */
+    const int hashed = (argc > 4 && 0 == strcmp(argv[4], "hashed"));
+    const int batch  = (argc > 4 && 0 == strcmp(argv[4], "batch"));
+    const int seed   = (argc > 4 && 0 == strcmp(argv[4], "seed"));
     if (argc < 3) return -1;
     e = strtoul(argv[2], NULL, 10);
     if (e > 100000000u) return -1;  /*(only 8 decimal chars below; can change)*/
+  #ifdef _THREAD_SAFE
+    if (argc > 3) n = strtoul(argv[3], NULL, 10);
+    if (n == 0 || n > 64) return -1;
+  #endif
     unlink(argv[1]);   /* unlink for repeatable test; ignore error if missing */
     if ((fd = open(argv[1],O_RDWR|O_CREAT,0666)) != -1
         && mcdb_make_start(&m,fd,malloc,free) == 0) {
+        /* projected mcdb size: 24-byte records, 2 hash table entries each */
+        m.sizehint = (size_t)e * (24 + 16) + (MCDB_SLOTS << 4) + MCDB_HEADER_SZ;
+        if (seed)
+            m.hash_init = 0x9e3779b9u;
+      #ifdef _THREAD_SAFE
+        if (n > 1)
+            u = testmcdbmake_threads(&m, e, n);
+        else
+      #endif
+        if (hashed) {
+            do { snprintf(buf, sizeof(buf), "%08lu", u);     /*generate record*/
+                 if (!mcdb_khash_init(&kh,m.hash_id,m.hash_init,buf,8,0)) break;
+            } while (0 == mcdb_make_add_hashed(&m,buf,8,buf,8,&kh) && ++u < e);
+        }
+        else if (batch) {
+            for (; u < e; u += k) {
+                for (k = 0; k < 64 && u+k < e; ++k) {     /*generate records*/
+                    snprintf(bbuf[k], sizeof(bbuf[k]), "%08lu", u+k);
+                    keys[k]  = bbuf[k];
+                    klens[k] = 8;
+                }
+                if (0 != mcdb_make_add_batch(&m,k,keys,klens,keys,klens))
+                    break;                                 /*store records*/
+            }
+        }
+        else
         /* generate and store records (generate 8-byte key and use as value)  */
         do { snprintf(buf, sizeof(buf), "%08lu", u);         /*generate record*/
         } while (0 == mcdb_make_add(&m,buf,8,buf,8) && ++u < e);/*store record*/
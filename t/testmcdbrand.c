@@ -39,6 +39,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -47,6 +48,10 @@ int main (int argc, char *argv[])
     const char *p;
     const char *end;
     struct mcdb m;
+    struct mcdb mb[64];
+    const char *keys[64];
+    size_t klens[64];
+    size_t i, n = 0;
     struct mcdb_mmap map;
     struct stat st;
     int fd;
@@ -54,6 +59,9 @@ int main (int argc, char *argv[])
     /* input stream must have keys of constant len 8 */
 
     if (argc < 3) return -1;
+    /* optional batch size (up to 64) to query using mcdb_find_batch() */
+    if (argc > 3 && ((n = strtoul(argv[3], NULL, 10)) == 0 || n > 64))
+        return -1;
 
     /* open mcdb */
     if ((fd = open(argv[1], O_RDONLY, 0777)) == -1) {perror("open"); return -1;}
@@ -63,6 +71,11 @@ int main (int argc, char *argv[])
     memset(&m, '\0', sizeof(m));
     m.map = &map;
     mcdb_mmap_prefault(m.map);
+    for (i = 0; i < n; ++i) {
+        memset(&mb[i], '\0', sizeof(struct mcdb));
+        mb[i].map = &map;
+        klens[i] = klen;
+    }
 
     /* open input file */
     if ((fd = open(argv[2], O_RDONLY, 0777)) == -1) {perror("open"); return -1;}
@@ -76,7 +89,15 @@ int main (int argc, char *argv[])
 
     /* read each key from input mmap and query mcdb
      * (no error checking since key might not exist) */
-    for (end = p+st.st_size; p < end; p += klen)
+    end = p+st.st_size;
+    if (n) {
+        while ((size_t)(end - p) >= n*klen) {
+            for (i = 0; i < n; ++i, p += klen)
+                keys[i] = p;
+            (void)mcdb_find_batch(mb, n, keys, klens);
+        }
+    }
+    for (; p < end; p += klen)
         fd = mcdb_find(&m, p, klen); /*(reuse fd; avoid unused result warning)*/
     return 0;
 }
@@ -0,0 +1,232 @@
+/*
+ * testmcdbthreads - stress test of mcdb thread registration while refreshing
+ *
+ * Copyright (c) 2011, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#include "mcdb.h"
+#include "mcdb_make.h"
+#include "mcdb_makefn.h"
+#include "plasma/plasma_atomic.h"
+
+#include <stdio.h>     /* fprintf() snprintf() rename() */
+#include <stdlib.h>    /* malloc(), free(), strtoul() */
+#include <string.h>    /* memcmp() memset() */
+#include <utime.h>     /* utime() */
+
+/* testmcdbthreads <fname> <nthreads> <nrebuilds>
+ * (nthreads query threads each register use of shared map, look up keys and
+ *  check data, then unregister, while main thread rebuilds mcdb and calls
+ *  mcdb_mmap_refresh_threadsafe() nrebuilds times.  Maps are poisoned when
+ *  free'd, so a map released while registered by a thread is detected.
+ *  A thread which exits while still registered is also started for each
+ *  rebuild; at end only the current map must remain allocated) */
+
+#ifdef _THREAD_SAFE
+#include <pthread.h>
+
+#define TESTMCDB_NKEYS 1000
+
+static struct mcdb_mmap *testmcdb_shared;
+static int testmcdb_done;
+static int testmcdb_fail;
+#define testmcdb_flag_get(p) \
+  plasma_atomic_load_explicit((p), memory_order_relaxed)
+#define testmcdb_flag_set(p) \
+  plasma_atomic_store_explicit((p), 1, memory_order_relaxed)
+static unsigned long testmcdb_nmaps; /* allocated struct mcdb_mmap */
+static pthread_mutex_t testmcdb_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* (allocation size stored before block so that block is poisoned on free) */
+static void *
+testmcdb_malloc (const size_t sz)
+{
+    size_t * const p = malloc(sz + 16);
+    if (p == NULL)
+        return NULL;
+    *p = sz;
+    if (sz == sizeof(struct mcdb_mmap)) {
+        pthread_mutex_lock(&testmcdb_mutex);
+        ++testmcdb_nmaps;
+        pthread_mutex_unlock(&testmcdb_mutex);
+    }
+    return (char *)p + 16;
+}
+
+static void
+testmcdb_free (void * const v)
+{
+    size_t * const p = (size_t *)((char *)v - 16);
+    if (*p == sizeof(struct mcdb_mmap)) {
+        pthread_mutex_lock(&testmcdb_mutex);
+        --testmcdb_nmaps;
+        pthread_mutex_unlock(&testmcdb_mutex);
+    }
+    memset(p, 0, *p + 16);
+    free(p);
+}
+
+static void
+testmcdb_failmsg (const char * const msg)
+{
+    testmcdb_flag_set(&testmcdb_fail);
+    fprintf(stderr, "testmcdbthreads: %s\n", msg);
+}
+
+/* build mcdb with keys 00000000..00000999 and data "<key>-<gen>"
+ * (mtime set to gen so that each rebuild is detected by stat() mtime check) */
+static int
+testmcdb_build (const char * const fname, const unsigned long gen)
+{
+    struct mcdb_make m;
+    struct utimbuf ut;
+    char tmp[4096];
+    char buf[24];
+    unsigned long u;
+    int rc;
+    if ((size_t)snprintf(tmp, sizeof(tmp), "%s.new", fname) >= sizeof(tmp))
+        return -1;
+    if (mcdb_makefn_start(&m, tmp, malloc, free) != 0)
+        return -1;
+    rc = mcdb_make_start(&m, m.fd, malloc, free);
+    for (u = 0; rc == 0 && u < TESTMCDB_NKEYS; ++u) {
+        snprintf(buf, sizeof(buf), "%08lu-%08lu", u, gen);
+        rc = mcdb_make_add(&m, buf, 8, buf, 17);
+    }
+    if (rc == 0)
+        rc = mcdb_make_finish(&m);
+    else
+        mcdb_make_destroy(&m);
+    if (rc == 0)
+        rc = mcdb_makefn_finish(&m, false);
+    mcdb_makefn_cleanup(&m);
+    ut.actime = ut.modtime = (time_t)(1000000000 + gen);
+    return (rc == 0 && utime(tmp, &ut) == 0 && rename(tmp, fname) == 0)
+      ? 0
+      : -1;
+}
+
+static void *
+testmcdb_query (void * const arg)
+{
+    struct mcdb m;
+    char buf[24];
+    unsigned long u = (unsigned long)(uintptr_t)arg;
+    unsigned long i;
+    while (!testmcdb_flag_get(&testmcdb_done)
+           && !testmcdb_flag_get(&testmcdb_fail)) {
+        m.map = mcdb_mmap_thread_registration(&testmcdb_shared,
+                                              MCDB_REGISTER_USE_INCR);
+        if (m.map == NULL) {
+            testmcdb_failmsg("register failed");
+            break;
+        }
+        for (i = 0; i < 16; ++i, u = (u + 7) % TESTMCDB_NKEYS) {
+            if (i == 8)    /*(move registration to newest map, if any)*/
+                (void) mcdb_thread_refresh_self(&m);
+            snprintf(buf, sizeof(buf), "%08lu", u);
+            if (m.map->ptr == NULL) {
+                testmcdb_failmsg("map released while registered");
+                break;
+            }
+            if (!mcdb_find(&m, buf, 8) || mcdb_datalen(&m) != 17
+                || memcmp(mcdb_dataptr(&m), buf, 8) != 0) {
+                testmcdb_failmsg("lookup failed");
+                break;
+            }
+        }
+        if (!mcdb_mmap_thread_registration(&m.map, MCDB_REGISTER_USE_DECR))
+            testmcdb_failmsg("unregister failed");
+    }
+    return NULL;
+}
+
+/* register use of map and exit without unregistering */
+static void *
+testmcdb_exit_registered (void * const arg)
+{
+    struct mcdb m;
+    (void)arg;
+    m.map = mcdb_mmap_thread_registration(&testmcdb_shared,
+                                          MCDB_REGISTER_USE_INCR);
+    if (m.map == NULL || !mcdb_find(&m, "00000000", 8))
+        testmcdb_failmsg("register failed");
+    return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+    pthread_t tid[64];
+    pthread_t etid;
+    unsigned long n;
+    unsigned long r;
+    unsigned long u;
+    unsigned long t;
+    if (argc < 4) return -1;
+    n = strtoul(argv[2], NULL, 10);
+    r = strtoul(argv[3], NULL, 10);
+    if (n == 0 || n > 64) return -1;
+
+    if (testmcdb_build(argv[1], 0) != 0
+        || (testmcdb_shared = mcdb_mmap_create(NULL, NULL, argv[1],
+                                               testmcdb_malloc,
+                                               testmcdb_free)) == NULL) {
+        testmcdb_failmsg("create failed");
+        return 1;
+    }
+    for (t = 0; t < n; ++t) {
+        if (pthread_create(tid+t, NULL, testmcdb_query,
+                           (void *)(uintptr_t)(t*131)) != 0)
+            break;
+    }
+    for (u = 1; u <= r && !testmcdb_flag_get(&testmcdb_fail); ++u) {
+        if (pthread_create(&etid, NULL, testmcdb_exit_registered, NULL) == 0)
+            pthread_join(etid, NULL);
+        if (testmcdb_build(argv[1], u) != 0
+            || !mcdb_mmap_refresh_threadsafe(&testmcdb_shared))
+            testmcdb_failmsg("rebuild/refresh failed");
+    }
+    testmcdb_flag_set(&testmcdb_done);
+    while (t)
+        pthread_join(tid[--t], NULL);
+
+    /* maps registered by exited threads must have been released */
+    if (!testmcdb_fail
+        && (testmcdb_build(argv[1], u) != 0
+            || !mcdb_mmap_refresh_threadsafe(&testmcdb_shared)))
+        testmcdb_failmsg("rebuild/refresh failed");
+    if (!testmcdb_fail && testmcdb_nmaps != 1)
+        testmcdb_failmsg("outdated map not released");
+    mcdb_mmap_destroy(testmcdb_shared);
+    return testmcdb_fail;
+}
+
+#else
+
+int
+main (void)
+{
+    return 0;  /* (registration by threads requires _THREAD_SAFE) */
+}
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * testmcdbwatch - test of mcdb_mmap_watch() change notification backends
+ *
+ * Copyright (c) 2011, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#include "mcdb.h"
+#include "mcdb_make.h"
+#include "mcdb_makefn.h"
+
+#include <stdio.h>     /* fprintf() snprintf() */
+#include <stdlib.h>    /* malloc(), free() */
+#include <string.h>    /* strcmp() */
+#include <time.h>      /* nanosleep() */
+#include <utime.h>     /* utime() */
+
+/* testmcdbwatch <fname> "generation"|"inotify"|"interval"
+ * (build mcdb, mcdb_mmap_create() and mcdb_mmap_watch() with backend, then
+ *  replace mcdb and check that mcdb_mmap_refresh_check() flips to true, and
+ *  is false again after mcdb_mmap_refresh().  generation and inotify watches
+ *  use a long fallback interval, so that a flip is due to the backend and
+ *  not to stat() of mcdb; interval watch must not flip before interval) */
+
+#define TESTMCDB_INTERVAL_MS 500
+
+/* build mcdb (with generation sidecar if gen) with mtime of given seconds
+ * (or current time if mtime is 0; utime() would be another inotify event) */
+static int
+testmcdb_build (const char * const fname, const int gen, const time_t mtime)
+{
+    struct mcdb_make m;
+    struct utimbuf ut;
+    char buf[24];
+    int rc;
+    if (mcdb_makefn_start(&m, fname, malloc, free) != 0)
+        return -1;
+    rc = (!gen || mcdb_makefn_gencreate(&m) == 0)
+      ? mcdb_make_start(&m, m.fd, malloc, free)
+      : -1;
+    if (rc == 0) {
+        snprintf(buf, sizeof(buf), "%08lu", (unsigned long)mtime);
+        rc = mcdb_make_add(&m, "key", 3, buf, 8);
+        if (rc == 0)
+            rc = mcdb_make_finish(&m);
+        else
+            mcdb_make_destroy(&m);
+    }
+    if (rc == 0)
+        rc = mcdb_makefn_finish(&m, false);
+    mcdb_makefn_cleanup(&m);
+    ut.actime = ut.modtime = mtime;
+    return (rc == 0 && !mcdb_makefn_gen_failed(&m)
+            && (mtime == 0 || utime(fname, &ut) == 0))
+      ? 0
+      : -1;
+}
+
+/* poll mcdb_mmap_refresh_check() for up to ms milliseconds */
+static bool
+testmcdb_poll (const struct mcdb_mmap * const map, unsigned int ms)
+{
+    const struct timespec ts = { 0, 10000000 }; /* 10 ms */
+    for (;;) {
+        if (mcdb_mmap_refresh_check(map))
+            return true;
+        if (ms < 10)
+            return false;
+        ms -= 10;
+        nanosleep(&ts, NULL);
+    }
+}
+
+static int
+testmcdb_fail (const char * const backend, const char * const msg)
+{
+    fprintf(stderr, "testmcdbwatch: %s: %s\n", backend, msg);
+    return 1;
+}
+
+int
+main (int argc, char **argv)
+{
+    struct mcdb_mmap *map;
+    const char *backend;
+    unsigned int interval;
+    unsigned int wait;
+    int flags;
+    int gen;
+    int rc = 0;
+    if (argc < 3) return -1;
+    backend = argv[2];
+    if (0 == strcmp(backend, "generation")) {
+        flags = MCDB_WATCH_GENERATION; gen = 1; interval = 3600000; wait = 0;
+    }
+    else if (0 == strcmp(backend, "inotify")) {
+      #if defined(__linux__) && defined(_THREAD_SAFE)
+        flags = MCDB_WATCH_INOTIFY;    gen = 0; interval = 3600000; wait = 5000;
+      #else
+        return 0;  /* (inotify watch requires Linux and _THREAD_SAFE) */
+      #endif
+    }
+    else if (0 == strcmp(backend, "interval")) {
+        flags = 0; gen = 0; interval = TESTMCDB_INTERVAL_MS;
+        wait = TESTMCDB_INTERVAL_MS * 4;
+    }
+    else
+        return -1;
+
+    if (testmcdb_build(argv[1], gen, (time_t)1000000000) != 0
+        || (map = mcdb_mmap_create(NULL, NULL, argv[1], malloc, free)) == NULL)
+        return testmcdb_fail(backend, "create failed");
+    if (!mcdb_mmap_watch(map, interval, flags))
+        rc = testmcdb_fail(backend, "watch failed");
+    else if (mcdb_mmap_refresh_check(map))
+        rc = testmcdb_fail(backend, "refresh check true before update");
+    else if (testmcdb_build(argv[1], gen, (time_t)(flags == MCDB_WATCH_INOTIFY
+                                                   ? 0 : 1000000001)) != 0)
+        rc = testmcdb_fail(backend, "rebuild failed");
+    else if (flags == 0 && mcdb_mmap_refresh_check(map))
+        rc = testmcdb_fail(backend, "refresh check true before interval");
+    else if (!testmcdb_poll(map, wait))
+        rc = testmcdb_fail(backend, "refresh check not true after update");
+    else if (!mcdb_mmap_refresh(map))
+        rc = testmcdb_fail(backend, "refresh failed");
+    else if (mcdb_mmap_refresh_check(map))
+        rc = testmcdb_fail(backend, "refresh check true after refresh");
+    mcdb_mmap_destroy(map);
+    return rc;
+}
@@ -145,3 +145,519 @@ uint32_to_ascii_base10_loop (uint32_t x, char * const restrict buf)
     memcpy(buf, b+i, 12-i);
     return (uint32_t)(12-i);
 }
+
+
+/* CRC32C (Castagnoli) polynomial 0x1EDC6F41 (reflected 0x82F63B78) */
+static const uint32_t uint32_crc32c_table[256] = {
+  0x00000000u, 0xf26b8303u, 0xe13b70f7u, 0x1350f3f4u,
+  0xc79a971fu, 0x35f1141cu, 0x26a1e7e8u, 0xd4ca64ebu,
+  0x8ad958cfu, 0x78b2dbccu, 0x6be22838u, 0x9989ab3bu,
+  0x4d43cfd0u, 0xbf284cd3u, 0xac78bf27u, 0x5e133c24u,
+  0x105ec76fu, 0xe235446cu, 0xf165b798u, 0x030e349bu,
+  0xd7c45070u, 0x25afd373u, 0x36ff2087u, 0xc494a384u,
+  0x9a879fa0u, 0x68ec1ca3u, 0x7bbcef57u, 0x89d76c54u,
+  0x5d1d08bfu, 0xaf768bbcu, 0xbc267848u, 0x4e4dfb4bu,
+  0x20bd8edeu, 0xd2d60dddu, 0xc186fe29u, 0x33ed7d2au,
+  0xe72719c1u, 0x154c9ac2u, 0x061c6936u, 0xf477ea35u,
+  0xaa64d611u, 0x580f5512u, 0x4b5fa6e6u, 0xb93425e5u,
+  0x6dfe410eu, 0x9f95c20du, 0x8cc531f9u, 0x7eaeb2fau,
+  0x30e349b1u, 0xc288cab2u, 0xd1d83946u, 0x23b3ba45u,
+  0xf779deaeu, 0x05125dadu, 0x1642ae59u, 0xe4292d5au,
+  0xba3a117eu, 0x4851927du, 0x5b016189u, 0xa96ae28au,
+  0x7da08661u, 0x8fcb0562u, 0x9c9bf696u, 0x6ef07595u,
+  0x417b1dbcu, 0xb3109ebfu, 0xa0406d4bu, 0x522bee48u,
+  0x86e18aa3u, 0x748a09a0u, 0x67dafa54u, 0x95b17957u,
+  0xcba24573u, 0x39c9c670u, 0x2a993584u, 0xd8f2b687u,
+  0x0c38d26cu, 0xfe53516fu, 0xed03a29bu, 0x1f682198u,
+  0x5125dad3u, 0xa34e59d0u, 0xb01eaa24u, 0x42752927u,
+  0x96bf4dccu, 0x64d4cecfu, 0x77843d3bu, 0x85efbe38u,
+  0xdbfc821cu, 0x2997011fu, 0x3ac7f2ebu, 0xc8ac71e8u,
+  0x1c661503u, 0xee0d9600u, 0xfd5d65f4u, 0x0f36e6f7u,
+  0x61c69362u, 0x93ad1061u, 0x80fde395u, 0x72966096u,
+  0xa65c047du, 0x5437877eu, 0x4767748au, 0xb50cf789u,
+  0xeb1fcbadu, 0x197448aeu, 0x0a24bb5au, 0xf84f3859u,
+  0x2c855cb2u, 0xdeeedfb1u, 0xcdbe2c45u, 0x3fd5af46u,
+  0x7198540du, 0x83f3d70eu, 0x90a324fau, 0x62c8a7f9u,
+  0xb602c312u, 0x44694011u, 0x5739b3e5u, 0xa55230e6u,
+  0xfb410cc2u, 0x092a8fc1u, 0x1a7a7c35u, 0xe811ff36u,
+  0x3cdb9bddu, 0xceb018deu, 0xdde0eb2au, 0x2f8b6829u,
+  0x82f63b78u, 0x709db87bu, 0x63cd4b8fu, 0x91a6c88cu,
+  0x456cac67u, 0xb7072f64u, 0xa457dc90u, 0x563c5f93u,
+  0x082f63b7u, 0xfa44e0b4u, 0xe9141340u, 0x1b7f9043u,
+  0xcfb5f4a8u, 0x3dde77abu, 0x2e8e845fu, 0xdce5075cu,
+  0x92a8fc17u, 0x60c37f14u, 0x73938ce0u, 0x81f80fe3u,
+  0x55326b08u, 0xa759e80bu, 0xb4091bffu, 0x466298fcu,
+  0x1871a4d8u, 0xea1a27dbu, 0xf94ad42fu, 0x0b21572cu,
+  0xdfeb33c7u, 0x2d80b0c4u, 0x3ed04330u, 0xccbbc033u,
+  0xa24bb5a6u, 0x502036a5u, 0x4370c551u, 0xb11b4652u,
+  0x65d122b9u, 0x97baa1bau, 0x84ea524eu, 0x7681d14du,
+  0x2892ed69u, 0xdaf96e6au, 0xc9a99d9eu, 0x3bc21e9du,
+  0xef087a76u, 0x1d63f975u, 0x0e330a81u, 0xfc588982u,
+  0xb21572c9u, 0x407ef1cau, 0x532e023eu, 0xa145813du,
+  0x758fe5d6u, 0x87e466d5u, 0x94b49521u, 0x66df1622u,
+  0x38cc2a06u, 0xcaa7a905u, 0xd9f75af1u, 0x2b9cd9f2u,
+  0xff56bd19u, 0x0d3d3e1au, 0x1e6dcdeeu, 0xec064eedu,
+  0xc38d26c4u, 0x31e6a5c7u, 0x22b65633u, 0xd0ddd530u,
+  0x0417b1dbu, 0xf67c32d8u, 0xe52cc12cu, 0x1747422fu,
+  0x49547e0bu, 0xbb3ffd08u, 0xa86f0efcu, 0x5a048dffu,
+  0x8ecee914u, 0x7ca56a17u, 0x6ff599e3u, 0x9d9e1ae0u,
+  0xd3d3e1abu, 0x21b862a8u, 0x32e8915cu, 0xc083125fu,
+  0x144976b4u, 0xe622f5b7u, 0xf5720643u, 0x07198540u,
+  0x590ab964u, 0xab613a67u, 0xb831c993u, 0x4a5a4a90u,
+  0x9e902e7bu, 0x6cfbad78u, 0x7fab5e8cu, 0x8dc0dd8fu,
+  0xe330a81au, 0x115b2b19u, 0x020bd8edu, 0xf0605beeu,
+  0x24aa3f05u, 0xd6c1bc06u, 0xc5914ff2u, 0x37faccf1u,
+  0x69e9f0d5u, 0x9b8273d6u, 0x88d28022u, 0x7ab90321u,
+  0xae7367cau, 0x5c18e4c9u, 0x4f48173du, 0xbd23943eu,
+  0xf36e6f75u, 0x0105ec76u, 0x12551f82u, 0xe03e9c81u,
+  0x34f4f86au, 0xc69f7b69u, 0xd5cf889du, 0x27a40b9eu,
+  0x79b737bau, 0x8bdcb4b9u, 0x988c474du, 0x6ae7c44eu,
+  0xbe2da0a5u, 0x4c4623a6u, 0x5f16d052u, 0xad7d5351u
+};
+
+__attribute_nonnull__
+__attribute_pure__
+static uint32_t
+uint32_hash_crc32c_table(uint32_t h, const unsigned char * restrict buf,
+                         size_t sz);
+
+static uint32_t
+uint32_hash_crc32c_table(uint32_t h, const unsigned char * restrict buf,
+                         size_t sz)
+{
+    for (; sz; --sz, ++buf)
+        h = uint32_crc32c_table[(h ^ *buf) & 0xFF] ^ (h >> 8);
+    return h;
+}
+
+#if defined(__x86_64__) && (__has_attribute(target) \
+ || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__==4 && __GNUC_MINOR__>=9))))
+#define UINT32_HASH_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+__attribute_nonnull__
+__attribute_pure__
+static uint32_t
+uint32_hash_crc32c_sse42(uint32_t h, const unsigned char * restrict buf,
+                         size_t sz);
+
+__attribute__((target("sse4.2")))
+static uint32_t
+uint32_hash_crc32c_sse42(uint32_t h, const unsigned char * restrict buf,
+                         size_t sz)
+{
+    uint64_t c = h;
+    uint64_t u;
+    for (; sz >= 8; sz -= 8, buf += 8) {
+        memcpy(&u, buf, 8);
+        c = __builtin_ia32_crc32di(c, u);
+    }
+    h = (uint32_t)c;
+    for (; sz; --sz, ++buf)
+        h = __builtin_ia32_crc32qi(h, *buf);
+    return h;
+}
+
+/* CRC32C implementation, chosen once at load (not probed on each call) */
+static uint32_t (*uint32_hash_crc32c_impl)(uint32_t,
+                                           const unsigned char * restrict,
+                                           size_t) = uint32_hash_crc32c_table;
+
+__attribute__((constructor))
+static void
+uint32_hash_crc32c_init (void);
+
+__attribute__((constructor))
+static void
+uint32_hash_crc32c_init (void)
+{
+    __builtin_cpu_init(); /*(required before __builtin_cpu_supports() here)*/
+    if (__builtin_cpu_supports("sse4.2"))
+        uint32_hash_crc32c_impl = uint32_hash_crc32c_sse42;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define UINT32_HASH_CRC32C_ARMV8
+#endif
+
+/* CRC32C hash function (raw CRC; no inversion of initial or final value)
+ * (chainable, like djb hash: h(h(init,a),b) == h(init,a+b))
+ * (crc32 instruction processes 8 bytes per instruction on x86_64 with SSE4.2
+ *  and on ARMv8 with CRC extension; table-driven, byte at a time, otherwise)
+ * (x86_64: SSE4.2 support is checked once, by constructor, at load) */
+uint32_t
+uint32_hash_crc32c(uint32_t h, const void * const restrict vbuf,
+                   const size_t sz)
+{
+    const unsigned char * restrict buf = (const unsigned char *)vbuf;
+  #if defined(UINT32_HASH_CRC32C_SSE42)
+    return uint32_hash_crc32c_impl(h, buf, sz);
+  #elif defined(UINT32_HASH_CRC32C_ARMV8)
+    size_t n = sz;
+    uint64_t u;
+    for (; n >= 8; n -= 8, buf += 8) {
+        memcpy(&u, buf, 8);
+        h = __crc32cd(h, u);
+    }
+    for (; n; --n, ++buf)
+        h = __crc32cb(h, *buf);
+    return h;
+  #endif
+    return uint32_hash_crc32c_table(h, buf, sz);
+}
+
+
+/* wyhash-style hash function
+ * (reimplementation of the mixing construction of wyhash (public domain)
+ *  by Wang Yi: https://github.com/wangyi-fudan/wyhash)
+ * 64-bit multiply and fold of 128-bit product, 16 to 48 bytes per iteration.
+ * Not chainable, so first byte of buffer is folded into seed, permitting
+ * tagged mcdb keys (tag char + key) to be hashed without copying key.
+ * Byte order of loads is little-endian on all platforms (portable mcdb). */
+
+#define UINT32_HASH_WY_P0 UINT64_C(0xa0761d6478bd642f)
+#define UINT32_HASH_WY_P1 UINT64_C(0xe7037ed1a0b428db)
+#define UINT32_HASH_WY_P2 UINT64_C(0x8ebc6af09c88c6e3)
+#define UINT32_HASH_WY_P3 UINT64_C(0x589965cc75374cc3)
+
+static inline void
+uint32_hash_wy_mum(uint64_t * const restrict a, uint64_t * const restrict b)
+{
+  #ifdef __SIZEOF_INT128__
+    __extension__ const unsigned __int128 r = (unsigned __int128)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+  #else
+    const uint64_t ha = *a >> 32, la = (uint32_t)*a;
+    const uint64_t hb = *b >> 32, lb = (uint32_t)*b;
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t = rl + (rm0 << 32);
+    const uint64_t lo = t + (rm1 << 32);
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+  #endif
+}
+
+static inline uint64_t
+uint32_hash_wy_mix(uint64_t a, uint64_t b)
+{
+    uint32_hash_wy_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t
+uint32_hash_wy_r8(const unsigned char * const restrict p)
+{
+  #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t u;
+    memcpy(&u, p, 8);
+    return u;
+  #else
+    return  (uint64_t)p[0]        | ((uint64_t)p[1] <<  8)
+         | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24)
+         | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40)
+         | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+  #endif
+}
+
+static inline uint64_t
+uint32_hash_wy_r4(const unsigned char * const restrict p)
+{
+  #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint32_t u;
+    memcpy(&u, p, 4);
+    return u;
+  #else
+    return  (uint64_t)p[0]        | ((uint64_t)p[1] <<  8)
+         | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24);
+  #endif
+}
+
+/* c is first byte of key (0..255), or 256 if key is empty */
+__attribute_pure__
+static uint32_t
+uint32_hash_wy_seeded(const uint32_t h, const uint32_t c,
+                      const unsigned char * restrict p, const size_t sz);
+
+static uint32_t
+uint32_hash_wy_seeded(const uint32_t h, const uint32_t c,
+                      const unsigned char * restrict p, const size_t sz)
+{
+    uint64_t seed = ((uint64_t)h << 32) | (c + 1);
+    uint64_t a, b;
+    seed ^= uint32_hash_wy_mix(seed ^ UINT32_HASH_WY_P0, UINT32_HASH_WY_P1);
+    if (__builtin_expect( (sz <= 16), 1)) {
+        if (sz >= 4) {
+            const size_t q = (sz >> 3) << 2;
+            a = (uint32_hash_wy_r4(p) << 32) | uint32_hash_wy_r4(p+q);
+            b = (uint32_hash_wy_r4(p+sz-4) << 32) | uint32_hash_wy_r4(p+sz-4-q);
+        }
+        else if (sz > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[sz>>1] << 8) | p[sz-1];
+            b = 0;
+        }
+        else
+            a = b = 0;
+    }
+    else {
+        size_t i = sz;
+        if (i > 48) {
+            uint64_t s1 = seed, s2 = seed;
+            do {
+                seed = uint32_hash_wy_mix(uint32_hash_wy_r8(p)   ^ UINT32_HASH_WY_P1,
+                                          uint32_hash_wy_r8(p+8) ^ seed);
+                s1 = uint32_hash_wy_mix(uint32_hash_wy_r8(p+16) ^ UINT32_HASH_WY_P2,
+                                        uint32_hash_wy_r8(p+24) ^ s1);
+                s2 = uint32_hash_wy_mix(uint32_hash_wy_r8(p+32) ^ UINT32_HASH_WY_P3,
+                                        uint32_hash_wy_r8(p+40) ^ s2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= s1 ^ s2;
+        }
+        while (i > 16) {
+            seed = uint32_hash_wy_mix(uint32_hash_wy_r8(p)   ^ UINT32_HASH_WY_P1,
+                                      uint32_hash_wy_r8(p+8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = uint32_hash_wy_r8(p+i-16);
+        b = uint32_hash_wy_r8(p+i-8);
+    }
+    a ^= UINT32_HASH_WY_P1;
+    b ^= seed;
+    uint32_hash_wy_mum(&a, &b);
+    a = uint32_hash_wy_mix(a ^ UINT32_HASH_WY_P0 ^ sz, b ^ UINT32_HASH_WY_P1);
+    return (uint32_t)a ^ (uint32_t)(a >> 32);
+}
+
+uint32_t
+uint32_hash_wy(uint32_t h, const void * const restrict vbuf, const size_t sz)
+{
+    const unsigned char * const restrict buf = (const unsigned char *)vbuf;
+    return (sz != 0)
+      ? uint32_hash_wy_seeded(h, buf[0], buf+1, sz-1)
+      : uint32_hash_wy_seeded(h, 256u, buf, 0);
+}
+
+uint32_t
+uint32_hash_wy_tag(uint32_t h, const unsigned char tagc,
+                   const void * const restrict vbuf, const size_t sz)
+{
+    return uint32_hash_wy_seeded(h, tagc, (const unsigned char *)vbuf, sz);
+}
+
+
+/* multi-buffer djb hash
+ * djb hash is a serial dependency chain (h*33 ^ c) for each byte, so hash
+ * multiple buffers at once, one buffer per 32-bit SIMD lane (16 lanes AVX-512,
+ * 8 lanes AVX2, 4 lanes SSE2), 4 bytes of each buffer loaded at a time, over
+ * the bytes common to the buffers in the group, and then finish each buffer
+ * with a scalar tail.  (h*33 is shift and add; no 32-bit multiply needed)
+ * 4 bytes of each buffer are loaded into lanes with hardware gather (AVX2 and
+ * AVX-512) or, 16 bytes at a time, with 4x4 transpose of 32-bit words (SSE2).
+ * Kernel is chosen once, by constructor, at load (not probed on each call).
+ * Results are identical to uint32_hash_djb() of each buffer. */
+
+#if defined(__x86_64__) && (__has_attribute(target) \
+ || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__==4 && __GNUC_MINOR__>=9))))
+#define UINT32_HASH_DJB_MULTI_X86
+#include <immintrin.h>
+
+/* djb hash 4 bytes of word in each of 4 lanes of c into 4 lanes of h */
+__attribute_pure__
+static __m128i
+uint32_hash_djb_x4_word(__m128i h, __m128i c);
+
+static __m128i
+uint32_hash_djb_x4_word(__m128i h, __m128i c)
+{
+    const __m128i ff = _mm_set1_epi32(0xFF);
+    for (uint32_t k = 0; k < 4; ++k, c = _mm_srli_epi32(c, 8))
+        h = _mm_xor_si128(_mm_add_epi32(h, _mm_slli_epi32(h, 5)),
+                          _mm_and_si128(c, ff));
+    return h;
+}
+
+/* hash len bytes (multiple of 4) of each of 4 buffers into 4 lanes of hv[] */
+__attribute_nonnull__
+static void
+uint32_hash_djb_x4_sse2(uint32_t * const restrict hv,
+                        const char * const * const restrict bufs,
+                        const size_t len);
+
+static void
+uint32_hash_djb_x4_sse2(uint32_t * const restrict hv,
+                        const char * const * const restrict bufs,
+                        const size_t len)
+{
+    __m128i h = _mm_loadu_si128((const __m128i *)hv);
+    __m128i r0, r1, r2, r3, t0, t1, t2, t3;
+    uint32_t w0, w1, w2, w3;
+    size_t j = 0;
+    for (; j + 16 <= len; j += 16) {
+        /* transpose 4x4 32-bit words: row per buffer into word per lane */
+        r0 = _mm_loadu_si128((const __m128i *)(bufs[0]+j));
+        r1 = _mm_loadu_si128((const __m128i *)(bufs[1]+j));
+        r2 = _mm_loadu_si128((const __m128i *)(bufs[2]+j));
+        r3 = _mm_loadu_si128((const __m128i *)(bufs[3]+j));
+        t0 = _mm_unpacklo_epi32(r0, r1);
+        t1 = _mm_unpacklo_epi32(r2, r3);
+        t2 = _mm_unpackhi_epi32(r0, r1);
+        t3 = _mm_unpackhi_epi32(r2, r3);
+        h = uint32_hash_djb_x4_word(h, _mm_unpacklo_epi64(t0, t1));
+        h = uint32_hash_djb_x4_word(h, _mm_unpackhi_epi64(t0, t1));
+        h = uint32_hash_djb_x4_word(h, _mm_unpacklo_epi64(t2, t3));
+        h = uint32_hash_djb_x4_word(h, _mm_unpackhi_epi64(t2, t3));
+    }
+    for (; j < len; j += 4) {
+        memcpy(&w0, bufs[0]+j, 4);
+        memcpy(&w1, bufs[1]+j, 4);
+        memcpy(&w2, bufs[2]+j, 4);
+        memcpy(&w3, bufs[3]+j, 4);
+        h = uint32_hash_djb_x4_word(h, _mm_set_epi32((int)w3, (int)w2,
+                                                     (int)w1, (int)w0));
+    }
+    _mm_storeu_si128((__m128i *)hv, h);
+}
+
+/* hash len bytes (multiple of 4) of each of 8 buffers into 8 lanes of hv[] */
+__attribute__((target("avx2")))
+__attribute_nonnull__
+static void
+uint32_hash_djb_x8_avx2(uint32_t * const restrict hv,
+                        const char * const * const restrict bufs,
+                        const size_t len);
+
+__attribute__((target("avx2")))
+static void
+uint32_hash_djb_x8_avx2(uint32_t * const restrict hv,
+                        const char * const * const restrict bufs,
+                        const size_t len)
+{
+    const __m256i ff = _mm256_set1_epi32(0xFF);
+    const __m256i four = _mm256_set1_epi64x(4);
+    __m256i h = _mm256_loadu_si256((const __m256i *)hv);
+    __m256i c;
+    /* (gather from 64-bit addresses of buffers; base address 0) */
+    __m256i a0 = _mm256_set_epi64x((int64_t)(intptr_t)bufs[3],
+                                   (int64_t)(intptr_t)bufs[2],
+                                   (int64_t)(intptr_t)bufs[1],
+                                   (int64_t)(intptr_t)bufs[0]);
+    __m256i a1 = _mm256_set_epi64x((int64_t)(intptr_t)bufs[7],
+                                   (int64_t)(intptr_t)bufs[6],
+                                   (int64_t)(intptr_t)bufs[5],
+                                   (int64_t)(intptr_t)bufs[4]);
+    for (size_t j = 0; j < len; j += 4) {
+        c = _mm256_inserti128_si256(
+              _mm256_castsi128_si256(_mm256_i64gather_epi32(NULL, a0, 1)),
+              _mm256_i64gather_epi32(NULL, a1, 1), 1);
+        a0 = _mm256_add_epi64(a0, four);
+        a1 = _mm256_add_epi64(a1, four);
+        for (uint32_t k = 0; k < 4; ++k, c = _mm256_srli_epi32(c, 8))
+            h = _mm256_xor_si256(_mm256_add_epi32(h, _mm256_slli_epi32(h, 5)),
+                                 _mm256_and_si256(c, ff));
+    }
+    _mm256_storeu_si256((__m256i *)hv, h);
+}
+
+/* hash len bytes (multiple of 4) of each of 16 buffers into 16 lanes of hv[]*/
+__attribute__((target("avx512f")))
+__attribute_nonnull__
+static void
+uint32_hash_djb_x16_avx512(uint32_t * const restrict hv,
+                           const char * const * const restrict bufs,
+                           const size_t len);
+
+__attribute__((target("avx512f")))
+static void
+uint32_hash_djb_x16_avx512(uint32_t * const restrict hv,
+                           const char * const * const restrict bufs,
+                           const size_t len)
+{
+    const __m512i ff = _mm512_set1_epi32(0xFF);
+    const __m512i four = _mm512_set1_epi64(4);
+    __m512i h = _mm512_loadu_si512((const void *)hv);
+    __m512i c;
+    /* (gather from 64-bit addresses of buffers; base address 0) */
+    __m512i a0 = _mm512_set_epi64((int64_t)(intptr_t)bufs[7],
+                                  (int64_t)(intptr_t)bufs[6],
+                                  (int64_t)(intptr_t)bufs[5],
+                                  (int64_t)(intptr_t)bufs[4],
+                                  (int64_t)(intptr_t)bufs[3],
+                                  (int64_t)(intptr_t)bufs[2],
+                                  (int64_t)(intptr_t)bufs[1],
+                                  (int64_t)(intptr_t)bufs[0]);
+    __m512i a1 = _mm512_set_epi64((int64_t)(intptr_t)bufs[15],
+                                  (int64_t)(intptr_t)bufs[14],
+                                  (int64_t)(intptr_t)bufs[13],
+                                  (int64_t)(intptr_t)bufs[12],
+                                  (int64_t)(intptr_t)bufs[11],
+                                  (int64_t)(intptr_t)bufs[10],
+                                  (int64_t)(intptr_t)bufs[9],
+                                  (int64_t)(intptr_t)bufs[8]);
+    for (size_t j = 0; j < len; j += 4) {
+        c = _mm512_inserti64x4(
+              _mm512_castsi256_si512(_mm512_i64gather_epi32(a0, NULL, 1)),
+              _mm512_i64gather_epi32(a1, NULL, 1), 1);
+        a0 = _mm512_add_epi64(a0, four);
+        a1 = _mm512_add_epi64(a1, four);
+        for (uint32_t k = 0; k < 4; ++k, c = _mm512_srli_epi32(c, 8))
+            h = _mm512_xor_si512(_mm512_add_epi32(h, _mm512_slli_epi32(h, 5)),
+                                 _mm512_and_si512(c, ff));
+    }
+    _mm512_storeu_si512((void *)hv, h);
+}
+
+/* multi-buffer djb kernel and its number of lanes, chosen once at load */
+static void (*uint32_hash_djb_multi_kernel)(uint32_t * restrict,
+                                            const char * const * restrict,
+                                            size_t) = uint32_hash_djb_x4_sse2;
+static size_t uint32_hash_djb_multi_lanes = 4;
+
+__attribute__((constructor))
+static void
+uint32_hash_djb_multi_init (void);
+
+__attribute__((constructor))
+static void
+uint32_hash_djb_multi_init (void)
+{
+    __builtin_cpu_init(); /*(required before __builtin_cpu_supports() here)*/
+    if (__builtin_cpu_supports("avx512f")) {
+        uint32_hash_djb_multi_kernel = uint32_hash_djb_x16_avx512;
+        uint32_hash_djb_multi_lanes  = 16;
+    }
+    else if (__builtin_cpu_supports("avx2")) {
+        uint32_hash_djb_multi_kernel = uint32_hash_djb_x8_avx2;
+        uint32_hash_djb_multi_lanes  = 8;
+    }
+}
+#endif
+
+void
+uint32_hash_djb_multi(const uint32_t h,
+                      const char * const * const restrict bufs,
+                      const size_t * const restrict szs, const size_t n,
+                      uint32_t * const restrict out)
+{
+    size_t i = 0;
+  #if defined(UINT32_HASH_DJB_MULTI_X86)
+    const size_t lanes = uint32_hash_djb_multi_lanes;
+    size_t len;
+    size_t u;
+    for (; n - i >= lanes; i += lanes) {
+        for (u = 0, len = szs[i]; u < lanes; ++u) {
+            out[i+u] = h;
+            if (len > szs[i+u])
+                len = szs[i+u];
+        }
+        len &= ~(size_t)3;  /* (bytes common to buffers of group, 4 at a time)*/
+        if (len != 0)
+            uint32_hash_djb_multi_kernel(out+i, bufs+i, len);
+        for (u = 0; u < lanes; ++u)  /* scalar tails */
+            out[i+u] = uint32_hash_djb(out[i+u], bufs[i+u]+len, szs[i+u]-len);
+    }
+  #endif
+    for (; i < n; ++i)
+        out[i] = uint32_hash_djb(h, bufs[i], szs[i]);
+}
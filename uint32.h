@@ -98,6 +98,47 @@ uint32_hash_djb(uint32_t h, const void * const restrict vbuf, const size_t sz)
 }
 #endif
 
+/* djb hash of each of n buffers (each seeded with h) into out[]
+ * (multi-buffer: buffers hashed in SIMD lanes, if available (x86_64);
+ *  results are identical to uint32_hash_djb() of each buffer) */
+__attribute_nonnull__
+__attribute_nothrow__
+void
+uint32_hash_djb_multi(uint32_t, const char * const * restrict,
+                      const size_t * restrict, size_t, uint32_t * restrict);
+
+/* CRC32C hash function (hardware crc32 instruction, if available)
+ * (raw CRC; chainable, like djb hash) */
+
+#define UINT32_HASH_CRC32C_INIT 0xFFFFFFFFu
+
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_pure__
+__attribute_warn_unused_result__
+uint32_t
+uint32_hash_crc32c(uint32_t, const void * restrict, size_t);
+
+/* wyhash-style hash function (64-bit multiply, 8 bytes at a time)
+ * (not chainable; uint32_hash_wy_tag(h,c,buf,sz) equals the result of
+ *  uint32_hash_wy(h,buf2,sz+1) where buf2 is char c followed by buf) */
+
+#define UINT32_HASH_WY_INIT 0u
+
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_pure__
+__attribute_warn_unused_result__
+uint32_t
+uint32_hash_wy(uint32_t, const void * restrict, size_t);
+
+__attribute_nonnull__
+__attribute_nothrow__
+__attribute_pure__
+__attribute_warn_unused_result__
+uint32_t
+uint32_hash_wy_tag(uint32_t, unsigned char, const void * restrict, size_t);
+
 __attribute_nonnull__
 __attribute_nothrow__
 __attribute_pure__